@@ -18,6 +18,7 @@
 
 #include <cinttypes>
 
+#include "net/event_loop.h"
 #include "util/file.h"
 #include "util/log.h"
 #include "util/string.h"
@@ -27,42 +28,60 @@
 
 namespace au {
 
-FileReceiver::FileReceiver(APRSInterface* aprs_interface)
-    : aprs_interface_(aprs_interface) {}
+FileReceiver::FileReceiver(const std::vector<APRSInterface*>& aprs_interfaces)
+    : aprs_interfaces_(aprs_interfaces) {}
 
 bool FileReceiver::Receive(const CallsignConfig& callsign,
     const CallsignConfig& peer_callsign) {
-  const CallsignConfig kBroadcastDestination({kBroadcastCallsign, 0});
-
-  while (true) {
-    Packet packet;
-    CallsignConfig source;
-    std::vector<CallsignConfig> digipeaters;
-    if (!aprs_interface_->ReceiveBroadcastPacket(
-          &packet, &source, &digipeaters)) {
-      continue;
-    }
+  EventLoop event_loop;
+  for (auto* aprs_interface : aprs_interfaces_) {
+    event_loop.AddInterface(aprs_interface,
+        [this, aprs_interface, &callsign, &peer_callsign](
+            const CallsignConfig& source,
+            const CallsignConfig& destination,
+            const std::vector<CallsignConfig>& /*digipeaters*/,
+            const std::string& payload) {
+          if (!peer_callsign.IsEmpty() && !(source == peer_callsign)) {
+            return;
+          }
+
+          Packet packet;
+          if (aprs_interface->ReceiveDirectedFrame(
+                source, destination, callsign, payload, &packet)
+              || aprs_interface->ReceiveBroadcastFrame(
+                source, destination, payload, &packet)) {
+            HandlePacket(packet);
+          }
+        });
+  }
 
-    switch (packet.type_case()) {
-      case Packet::kFileTransferHeader:
-      LOGI("received transfer request with id %" PRIu32 " for file '%s'",
-          packet.file_transfer_header().id(),
-          StringFormatNonPrintables(
-            packet.file_transfer_header().filename()).c_str());
-        HandleTransferHeader(packet.file_transfer_header());
-        break;
-      case Packet::kFileTransferChunk:
-      LOGI("received transfer chunk id %" PRIu32 " for transfer %" PRIu32,
-          packet.file_transfer_chunk().chunk_id(),
-          packet.file_transfer_chunk().id());
-        HandleTransferChunk(packet.file_transfer_chunk());
-        break;
-      default:
-        LOGE("invalid packet received");
-    }
+  if (!event_loop.Run()) {
+    LOGE("failed to run event loop");
+    return false;
   }
 
-  return true;
+  LOGE("all interfaces have failed");
+  return false;
+}
+
+void FileReceiver::HandlePacket(const Packet& packet) {
+  switch (packet.type_case()) {
+    case Packet::kFileTransferHeader:
+    LOGI("received transfer request with id %" PRIu32 " for file '%s'",
+        packet.file_transfer_header().id(),
+        StringFormatNonPrintables(
+          packet.file_transfer_header().filename()).c_str());
+      HandleTransferHeader(packet.file_transfer_header());
+      break;
+    case Packet::kFileTransferChunk:
+    LOGI("received transfer chunk id %" PRIu32 " for transfer %" PRIu32,
+        packet.file_transfer_chunk().chunk_id(),
+        packet.file_transfer_chunk().id());
+      HandleTransferChunk(packet.file_transfer_chunk());
+      break;
+    default:
+      LOGE("invalid packet received");
+  }
 }
 
 uint32_t FileReceiver::FileChunks::GetId() const {
@@ -111,8 +130,11 @@ void FileReceiver::HandleTransferHeader(
   } else if (file_chunks->is_complete) {
     return;
   } else {
+    // The header is interleaved with the chunks of the file, so the chunks
+    // may all have arrived before the first copy of it that was received.
     file_chunks->last_time_us = GetTimeNowUs();
     file_chunks->header = header;
+    AssembleFile(file_chunks);
   }
 }
 
@@ -173,35 +195,43 @@ void FileReceiver::HandleTransferChunk(
           return a.chunk_id() < b.chunk_id();
         });
 
-    chunk_id = 1;
-    std::string file_contents;
-    for (const auto& chunk : file_chunks->chunks) {
-      if (chunk.chunk_id() != chunk_id++) {
-        break;
-      }
+    AssembleFile(file_chunks);
+  }
+}
 
-      file_contents += chunk.chunk();
+void FileReceiver::AssembleFile(FileChunks* file_chunks) {
+  uint32_t chunk_id = 1;
+  std::string file_contents;
+  for (const auto& chunk : file_chunks->chunks) {
+    if (chunk.chunk_id() != chunk_id++) {
+      break;
     }
 
+    file_contents += chunk.chunk();
+  }
+
+  if (!file_chunks->header.has_filename()) {
     if (!file_contents.empty()) {
-      if (!file_chunks->header.has_filename()) {
-        LOGI("header unavilable to write file contents for transfer %" PRIu32,
-            file_chunks->GetId());
-      } else {
-        // TODO(aarossig): sanitize the path.
-        LOGI("writing file '%s' to disk",
-            file_chunks->header.filename().c_str());
-        WriteStringToFile(file_chunks->header.filename(),
-            file_contents);
-      }
+      LOGI("header unavilable to write file contents for transfer %" PRIu32,
+          file_chunks->GetId());
     }
 
-    if (file_contents.size() == file_chunks->header.size()) {
-      LOGI("file transfer '%s' complete",
-          file_chunks->header.filename().c_str());
-      file_chunks->chunks.clear();
-      file_chunks->is_complete = true;
-    }
+    return;
+  }
+
+  if (!file_contents.empty()) {
+    // TODO(aarossig): sanitize the path.
+    LOGI("writing file '%s' to disk",
+        file_chunks->header.filename().c_str());
+    WriteStringToFile(file_chunks->header.filename(),
+        file_contents);
+  }
+
+  if (file_contents.size() == file_chunks->header.size()) {
+    LOGI("file transfer '%s' complete",
+        file_chunks->header.filename().c_str());
+    file_chunks->chunks.clear();
+    file_chunks->is_complete = true;
   }
 }
 
@@ -18,6 +18,7 @@
 #define APRS_UTILS_APRS_FILE_COPY_FILE_RECEIVER_H_
 
 #include <string>
+#include <vector>
 
 #include "net/aprs_interface.h"
 #include "util/non_copyable.h"
@@ -27,16 +28,19 @@ namespace au {
 // A class that is responsible for receiving a file from an SDR link.
 class FileReceiver : public NonCopyable {
  public:
-  // Setup the file receiver.
-  FileReceiver(APRSInterface* aprs_interface);
+  // Setup the file receiver with the interfaces to receive from.
+  FileReceiver(const std::vector<APRSInterface*>& aprs_interfaces);
 
-  // Receives a file from the supplied callsign.
+  // Receives files on all interfaces. Broadcast files are received from any
+  // station, and files sent directly to the supplied callsign are
+  // acknowledged. If a peer callsign is supplied, only frames from the peer
+  // are handled.
   bool Receive(const CallsignConfig& callsign,
       const CallsignConfig& peer_callsign);
 
  private:
-  // The interface to send/receive APRS pakcets over.
-  APRSInterface* const aprs_interface_;
+  // The interfaces to receive APRS packets from.
+  const std::vector<APRSInterface*> aprs_interfaces_;
 
   // Incoming chunks for a file.
   struct FileChunks {
@@ -62,11 +66,19 @@ class FileReceiver : public NonCopyable {
   // Checks if a file transfer has been started for a given id.
   FileChunks* GetFileChunksForId(uint32_t id);
 
+  // Handles a complete packet received from any interface.
+  void HandlePacket(const Packet& packet);
+
   // Handles a file transfer header.
   void HandleTransferHeader(const Packet::FileTransferHeader& header);
 
   // Handles a file transfer chunk.
   void HandleTransferChunk(const Packet::FileTransferChunk& chunk);
+
+  // Writes the contiguous chunks received so far to disk once the header has
+  // been received, and marks the transfer complete when the whole file has
+  // been received.
+  void AssembleFile(FileChunks* file_chunks);
 };
 
 }  // namespace au
@@ -69,9 +69,7 @@ bool FileSender::Send(const std::string& filename, size_t max_chunk_size,
   if (broadcast_mode) {
     return SendBroadcast(header, chunks, callsign, digipeaters);
   } else {
-    // TODO: implement directed mode.
-    LOGE("directed mode is not supported yet");
-    return false;
+    return SendDirected(header, chunks, callsign, peer_callsign, digipeaters);
   }
 }
 
@@ -80,9 +78,31 @@ bool FileSender::SendBroadcast(
     const std::vector<Packet::FileTransferChunk>& chunks,
     const CallsignConfig& callsign,
     const std::vector<CallsignConfig>& digipeaters) {
+  // Send the whole file at once so that the chunks are interleaved.
+  std::vector<Packet> packets(chunks.size() + 1);
+  *packets[0].mutable_file_transfer_header() = header;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    *packets[i + 1].mutable_file_transfer_chunk() = chunks[i];
+  }
+
+  if (!aprs_interface_->SendBroadcastPackets(packets, callsign,
+        digipeaters)) {
+    LOGE("failed to send file");
+    return false;
+  }
+
+  return true;
+}
+
+bool FileSender::SendDirected(
+    const Packet::FileTransferHeader& header,
+    const std::vector<Packet::FileTransferChunk>& chunks,
+    const CallsignConfig& callsign, const CallsignConfig& peer_callsign,
+    const std::vector<CallsignConfig>& digipeaters) {
   Packet packet;
   *packet.mutable_file_transfer_header() = header;
-  if (!aprs_interface_->SendBroadcastPacket(packet, callsign, digipeaters)) {
+  if (!aprs_interface_->SendDirectedPacket(packet, callsign, peer_callsign,
+        digipeaters)) {
     LOGE("failed to send header");
     return false;
   }
@@ -90,8 +110,8 @@ bool FileSender::SendBroadcast(
   for (size_t i = 0; i < chunks.size(); i++) {
     packet.Clear();
     *packet.mutable_file_transfer_chunk() = chunks[i];
-    if (!aprs_interface_->SendBroadcastPacket(
-          packet, callsign, digipeaters)) {
+    if (!aprs_interface_->SendDirectedPacket(packet, callsign, peer_callsign,
+          digipeaters)) {
       LOGE("failed to send chunk %zu", i);
       return false;
     }
@@ -50,6 +50,13 @@ class FileSender : public NonCopyable {
       const CallsignConfig& callsign,
       const std::vector<CallsignConfig>& digipeaters);
 
+  // Sends a file to a single peer, which acknowledges the chunks that it
+  // receives so that only lost chunks are sent again.
+  bool SendDirected(const Packet::FileTransferHeader& header,
+      const std::vector<Packet::FileTransferChunk>& chunks,
+      const CallsignConfig& callsign, const CallsignConfig& peer_callsign,
+      const std::vector<CallsignConfig>& digipeaters);
+
   // Returns the next transfer id.
   uint32_t GetNextTransferId();
 };
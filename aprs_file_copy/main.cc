@@ -18,9 +18,13 @@
 
 #include "aprs_file_copy/file_sender.h"
 #include "aprs_file_copy/file_receiver.h"
+#include "net/agw_aprs_interface.h"
+#include "net/aprs_is_filter.h"
 #include "net/internet_aprs_interface.h"
+#include "net/redundant_aprs_interface.h"
 #include "net/tnc_aprs_interface.h"
 #include "util/log.h"
+#include "util/string.h"
 
 #define LOG_TAG "APRSFileCopy"
 
@@ -34,9 +38,6 @@ constexpr char kVersion[] = "0.0.1";
 int main(int argc, char** argv) {
   // Init.
   LOGI("start");
-  if (SDLNet_Init() < 0) {
-    LOGFATAL("SDL_Init failed: %s", SDLNet_GetError());
-  }
 
   // Command line flags.
   TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
@@ -61,24 +62,118 @@ int main(int argc, char** argv) {
       "aprs_transmit_interval_s",
       "The amount of time between APRS transmissions.",
       false, au::APRSInterface::kDefaultTransmitIntervalS, "seconds", cmd);
+  TCLAP::ValueArg<uint32_t> aprs_max_bytes_per_minute_arg("",
+      "aprs_max_bytes_per_minute",
+      "The number of bytes that may be transmitted per minute across all "
+      "transfers. Zero disables the limit.",
+      false, au::APRSInterface::kDefaultMaxBytesPerMinute, "bytes", cmd);
   TCLAP::ValueArg<size_t> aprs_max_packet_size_arg("", "aprs_max_packet_size",
       "The maximum size of an APRS packet to transfer.",
       false, au::APRSInterface::kDefaultMaxPacketSize, "bytes", cmd);
   TCLAP::ValueArg<size_t> aprs_retransmit_count_arg("",
       "aprs_retransmit_count", "The number of times to retransmit a packet.",
       false, au::APRSInterface::kDefaultRetransmitCount, "count", cmd);
+  TCLAP::ValueArg<float> aprs_fec_redundancy_arg("", "aprs_fec_redundancy",
+      "The number of erasure coded repair chunks to send for each packet, as "
+      "a fraction of the number of chunks it is split into. Zero disables "
+      "forward error correction.",
+      false, au::APRSInterface::kDefaultFECRedundancy, "fraction", cmd);
+  TCLAP::ValueArg<size_t> aprs_directed_window_size_arg("",
+      "aprs_directed_window_size",
+      "The number of chunks to send to a peer between acknowledgements.",
+      false, au::APRSInterface::kDefaultDirectedWindowSize, "count", cmd);
+  TCLAP::MultiArg<std::string> digipeater_arg("", "digipeater",
+      "A digipeater to send through, such as WIDE1-1. May be repeated to form "
+      "a path.", false, "callsign", cmd);
+  TCLAP::SwitchArg aprs_ignore_digipeats_arg("", "aprs_ignore_digipeats",
+      "Retransmit broadcast chunks even if they have been heard repeated by "
+      "a digipeater.", cmd);
+  TCLAP::SwitchArg aprs_base91_arg("", "aprs_base91",
+      "Encode chunks with base91 rather than base64, which carries more data "
+      "per frame but can only be decoded by receivers that support it.", cmd);
+  TCLAP::SwitchArg aprs_compact_header_arg("", "aprs_compact_header",
+      "Send chunks with a compact bit-packed header rather than protobuf "
+      "framing, which can only be decoded by receivers that support it.", cmd);
   TCLAP::ValueArg<std::string> tnc_hostname_arg("", "tnc_hostname",
       "The hostname of the TNC to connect to.", false, "localhost",
       "hostname", cmd);
   TCLAP::ValueArg<uint16_t> tnc_port_arg("", "tnc_port",
     "The port of the TNC to connect to.", false, 8001,
     "port", cmd);
+  TCLAP::ValueArg<int> tnc_kiss_port_arg("", "tnc_kiss_port",
+      "The KISS port of the TNC to use, for TNCs with more than one radio.",
+      false, 0, "port", cmd);
+  TCLAP::MultiArg<int> receive_kiss_port_arg("", "receive_kiss_port",
+      "Additional KISS ports of the TNC to receive files from at the same "
+      "time. May be repeated.", false, "port", cmd);
+  TCLAP::ValueArg<size_t> tnc_tx_queue_size_arg("", "tnc_tx_queue_size",
+      "The maximum number of frames to queue for transmission to the TNC.",
+      false, au::KISSConnection::kDefaultMaxQueuedTxFrames, "frames", cmd);
+  TCLAP::SwitchArg tnc_tx_drop_when_full_arg("", "tnc_tx_drop_when_full",
+      "Set to true to drop frames when the TNC transmit queue is full rather "
+      "than waiting for it to drain.", cmd);
+  TCLAP::ValueArg<uint32_t> kiss_tx_delay_ms_arg("", "kiss_tx_delay_ms",
+      "The time for the TNC to wait after keying the transmitter.", false,
+      au::TNCAPRSInterface::kDefaultKISSParameters.tx_delay_ms, "ms", cmd);
+  TCLAP::ValueArg<int> kiss_persistence_arg("", "kiss_persistence",
+      "The probability of the TNC transmitting when the channel is clear, "
+      "scaled to 0-255.", false,
+      au::TNCAPRSInterface::kDefaultKISSParameters.persistence, "p", cmd);
+  TCLAP::ValueArg<uint32_t> kiss_slot_time_ms_arg("", "kiss_slot_time_ms",
+      "The time for the TNC to wait between checks of the channel.", false,
+      au::TNCAPRSInterface::kDefaultKISSParameters.slot_time_ms, "ms", cmd);
+  TCLAP::ValueArg<uint32_t> kiss_tx_tail_ms_arg("", "kiss_tx_tail_ms",
+      "The time for the TNC to hold the transmitter after sending.", false,
+      au::TNCAPRSInterface::kDefaultKISSParameters.tx_tail_ms, "ms", cmd);
+  TCLAP::SwitchArg kiss_full_duplex_arg("", "kiss_full_duplex",
+      "Set to true to have the TNC transmit without waiting for the channel "
+      "to clear.", cmd);
+  TCLAP::SwitchArg kiss_ack_mode_arg("", "kiss_ack_mode",
+      "Set to true to pace transmissions from when the TNC reports that each "
+      "frame has been transmitted. The TNC must support the KISS ACKMODE "
+      "extension.", cmd);
+  TCLAP::SwitchArg kiss_restore_defaults_arg("", "kiss_restore_defaults",
+      "Set to true to restore the default KISS parameters of the TNC once the "
+      "transfer is complete.", cmd);
+  TCLAP::SwitchArg use_agw_arg("", "use_agw",
+      "Set to true to connect to the TNC with the AGWPE protocol rather than "
+      "KISS.", cmd);
+  TCLAP::ValueArg<std::string> agw_hostname_arg("", "agw_hostname",
+      "The hostname of the AGWPE server to connect to.", false, "localhost",
+      "hostname", cmd);
+  TCLAP::ValueArg<uint16_t> agw_port_arg("", "agw_port",
+      "The port of the AGWPE server to connect to.", false,
+      au::AGWAPRSInterface::kDefaultPort, "port", cmd);
+  TCLAP::ValueArg<int> agw_radio_port_arg("", "agw_radio_port",
+      "The radio port of the AGWPE server to use.", false, 0, "port", cmd);
+  TCLAP::MultiArg<std::string> receive_tnc_arg("", "receive_tnc",
+      "Additional TNCs to receive files from at the same time, formatted as "
+      "hostname:port. May be repeated.", false, "hostname:port", cmd);
   TCLAP::ValueArg<std::string> aprs_is_hostname_arg("", "aprs_is_hostname",
       "The hostname of the APRS-IS service to connect to.", false,
       "rotate.aprs.net", "hostname", cmd);
   TCLAP::ValueArg<uint16_t> aprs_is_port_arg("", "aprs_is_port",
-      "The port of the APRS-IS service to connect to.", false, 10152,
-      "port", cmd);
+      "The port of the APRS-IS service to connect to. The default port only "
+      "sends packets that match the filter.", false,
+      au::InternetAPRSInterface::kDefaultPort, "port", cmd);
+  TCLAP::MultiArg<std::string> aprs_is_redundant_hostname_arg("",
+      "aprs_is_redundant_hostname", "Additional APRS-IS services to receive "
+      "from at the same time, keeping the first copy of each packet. May be "
+      "repeated.", false, "hostname", cmd);
+  TCLAP::ValueArg<uint32_t> aprs_is_idle_timeout_ms_arg("",
+      "aprs_is_idle_timeout_ms", "The time without any packet or keepalive "
+      "from an APRS-IS service after which the connection is restored, or 0 "
+      "to wait indefinitely.", false,
+      au::InternetAPRSInterface::kDefaultIdleTimeoutMs, "ms", cmd);
+  TCLAP::MultiArg<std::string> aprs_is_buddy_arg("", "aprs_is_buddy",
+      "Also receive all packets sent by this station from APRS-IS. May be "
+      "repeated.", false, "callsign", cmd);
+  TCLAP::ValueArg<std::string> aprs_is_range_arg("", "aprs_is_range",
+      "Also receive all packets from stations within a distance of a position "
+      "from APRS-IS.", false, "", "latitude,longitude,km", cmd);
+  TCLAP::ValueArg<std::string> aprs_is_filter_arg("", "aprs_is_filter",
+      "An additional APRS-IS filter, in the APRS-IS filter syntax.", false, "",
+      "filter", cmd);
   cmd.parse(argc, argv);
 
   // Validate arguments.
@@ -86,35 +181,235 @@ int main(int argc, char** argv) {
     LOGFATAL("unable to use APRS-IS to send files");
   }
 
+  if (!use_aprs_is_arg.getValue() && (!aprs_is_buddy_arg.getValue().empty()
+        || aprs_is_range_arg.isSet() || aprs_is_filter_arg.isSet())) {
+    LOGFATAL("APRS-IS filters can only be used with APRS-IS");
+  }
+
+  if (!use_aprs_is_arg.getValue()
+      && (!aprs_is_redundant_hostname_arg.getValue().empty()
+        || aprs_is_idle_timeout_ms_arg.isSet())) {
+    LOGFATAL("APRS-IS connection options can only be used with APRS-IS");
+  }
+
+  if (use_aprs_is_arg.getValue() && use_agw_arg.getValue()) {
+    LOGFATAL("unable to use APRS-IS and AGWPE together");
+  }
+
+  if (agw_radio_port_arg.getValue() < 0
+      || agw_radio_port_arg.getValue() > 255) {
+    LOGFATAL("invalid AGWPE radio port %d", agw_radio_port_arg.getValue());
+  }
+
+  if (!receive_tnc_arg.getValue().empty() && !receive_arg.getValue()) {
+    LOGFATAL("additional TNCs can only be used to receive files");
+  }
+
+  if (!receive_kiss_port_arg.getValue().empty()
+      && (!receive_arg.getValue() || use_aprs_is_arg.getValue()
+          || use_agw_arg.getValue())) {
+    LOGFATAL("additional KISS ports can only be used to receive from a TNC");
+  }
+
+  if (tnc_kiss_port_arg.getValue() < 0 || tnc_kiss_port_arg.getValue()
+      >= static_cast<int>(au::KISSConnection::kPortCount)) {
+    LOGFATAL("invalid KISS port %d", tnc_kiss_port_arg.getValue());
+  }
+
+  // Each KISS port has a single receive queue, so it may only be received
+  // from once.
+  std::vector<bool> kiss_port_used(au::KISSConnection::kPortCount);
+  kiss_port_used[tnc_kiss_port_arg.getValue()] = true;
+  for (int kiss_port : receive_kiss_port_arg.getValue()) {
+    if (kiss_port < 0
+        || kiss_port >= static_cast<int>(au::KISSConnection::kPortCount)) {
+      LOGFATAL("invalid KISS port %d", kiss_port);
+    } else if (kiss_port_used[kiss_port]) {
+      LOGFATAL("KISS port %d is received from more than once", kiss_port);
+    }
+
+    kiss_port_used[kiss_port] = true;
+  }
+
+  if (kiss_persistence_arg.getValue() < 0
+      || kiss_persistence_arg.getValue() > 255) {
+    LOGFATAL("invalid KISS persistence %d", kiss_persistence_arg.getValue());
+  }
+
+  bool kiss_parameters_set = kiss_tx_delay_ms_arg.isSet()
+      || kiss_persistence_arg.isSet() || kiss_slot_time_ms_arg.isSet()
+      || kiss_tx_tail_ms_arg.isSet() || kiss_full_duplex_arg.getValue()
+      || kiss_ack_mode_arg.getValue() || kiss_restore_defaults_arg.getValue();
+  if (kiss_parameters_set
+      && (use_aprs_is_arg.getValue() || use_agw_arg.getValue())) {
+    LOGFATAL("KISS parameters can only be used with a KISS TNC");
+  }
+
   // TODO: parse all callsign arguments into CallsignConfig.
 
   au::APRSInterface::Config aprs_config;
   aprs_config.transmit_interval_s = aprs_transmit_interval_s_arg.getValue();
   aprs_config.retransmit_count = aprs_retransmit_count_arg.getValue();
   aprs_config.max_packet_size = aprs_max_packet_size_arg.getValue();
+  aprs_config.fec_redundancy = aprs_fec_redundancy_arg.getValue();
+  aprs_config.directed_window_size =
+      aprs_directed_window_size_arg.getValue();
+  aprs_config.skip_digipeated_retransmits =
+      !aprs_ignore_digipeats_arg.getValue();
+  aprs_config.max_bytes_per_minute = aprs_max_bytes_per_minute_arg.getValue();
+  aprs_config.payload_encoding = aprs_base91_arg.getValue()
+      ? au::APRSInterface::PayloadEncoding::kBase91
+      : au::APRSInterface::PayloadEncoding::kBase64;
+  aprs_config.compact_chunk_header = aprs_compact_header_arg.getValue();
 
   // Setup the APRS interface.
   std::unique_ptr<au::APRSInterface> aprs_interface;
+  std::shared_ptr<au::KISSConnection> kiss_connection;
+  au::TNCAPRSInterface* tnc_interface = nullptr;
   if (use_aprs_is_arg.getValue()) {
-    aprs_interface = std::make_unique<au::InternetAPRSInterface>(
-        aprs_config, au::CallsignConfig({callsign_arg.getValue(), 0}),
-        aprs_is_hostname_arg.getValue(), aprs_is_port_arg.getValue());
+    // Only request the packets that may carry files.
+    au::APRSISFilter filter;
+    filter.AddDestination(au::kBroadcastCallsign);
+    for (const auto& buddy : aprs_is_buddy_arg.getValue()) {
+      au::CallsignConfig buddy_callsign;
+      if (!buddy_callsign.FromString(buddy)) {
+        LOGFATAL("invalid callsign '%s'", buddy.c_str());
+      }
+
+      filter.AddBuddy(buddy_callsign);
+    }
+
+    if (!aprs_is_range_arg.getValue().empty()) {
+      auto range = au::StringSplit(aprs_is_range_arg.getValue(), ",");
+      if (range.size() != 3) {
+        LOGFATAL("invalid range '%s', expected latitude,longitude,km",
+            aprs_is_range_arg.getValue().c_str());
+      }
+
+      filter.AddRange(std::stod(range[0]), std::stod(range[1]),
+          std::stod(range[2]));
+    }
+
+    filter.AddRaw(aprs_is_filter_arg.getValue());
+    std::vector<std::string> hostnames = {aprs_is_hostname_arg.getValue()};
+    for (const auto& hostname : aprs_is_redundant_hostname_arg.getValue()) {
+      hostnames.push_back(hostname);
+    }
+
+    std::vector<std::unique_ptr<au::InternetAPRSInterface>> interfaces;
+    for (const auto& hostname : hostnames) {
+      interfaces.push_back(std::make_unique<au::InternetAPRSInterface>(
+          aprs_config, au::CallsignConfig({callsign_arg.getValue(), 0}),
+          hostname, aprs_is_port_arg.getValue(), filter.ToString()));
+
+      // The full feed ignores the filter and sends every packet, most of
+      // which cannot carry files, so drop those before they are parsed.
+      // Packets let through by the filter on other ports are kept.
+      if (aprs_is_port_arg.getValue()
+          == au::InternetAPRSInterface::kFullFeedPort) {
+        interfaces.back()->SetLineFilter(au::kBroadcastCallsign,
+            au::APRSInterface::kBinaryPayloadPrefix);
+      }
+
+      interfaces.back()->SetIdleTimeout(
+          aprs_is_idle_timeout_ms_arg.getValue());
+    }
+
+    if (interfaces.size() == 1) {
+      aprs_interface = std::move(interfaces.front());
+    } else {
+      aprs_interface = std::make_unique<au::RedundantAPRSInterface>(
+          aprs_config, std::move(interfaces));
+    }
+  } else if (use_agw_arg.getValue()) {
+    aprs_interface = std::make_unique<au::AGWAPRSInterface>(aprs_config,
+        agw_hostname_arg.getValue(), agw_port_arg.getValue(),
+        agw_radio_port_arg.getValue());
   } else {
-    aprs_interface = std::make_unique<au::TNCAPRSInterface>(
-        aprs_config, tnc_hostname_arg.getValue(), tnc_port_arg.getValue());
+    au::KISSConnection::Config kiss_config;
+    kiss_config.max_queued_tx_frames = tnc_tx_queue_size_arg.getValue();
+    kiss_config.tx_overflow_policy = tnc_tx_drop_when_full_arg.getValue()
+        ? au::KISSConnection::OverflowPolicy::kDrop
+        : au::KISSConnection::OverflowPolicy::kBlock;
+    kiss_connection = std::make_shared<au::KISSConnection>(kiss_config,
+        tnc_hostname_arg.getValue(), tnc_port_arg.getValue());
+    auto tnc = std::make_unique<au::TNCAPRSInterface>(
+        aprs_config, kiss_connection, tnc_kiss_port_arg.getValue());
+    tnc_interface = tnc.get();
+    tnc_interface->SetAckMode(kiss_ack_mode_arg.getValue());
+    aprs_interface = std::move(tnc);
+
+    // Only send the parameters that have been overridden.
+    bool parameters_sent = true;
+    if (kiss_tx_delay_ms_arg.isSet()) {
+      parameters_sent &= tnc_interface->SetTxDelay(
+          kiss_tx_delay_ms_arg.getValue());
+    }
+
+    if (kiss_persistence_arg.isSet()) {
+      parameters_sent &= tnc_interface->SetPersistence(
+          kiss_persistence_arg.getValue());
+    }
+
+    if (kiss_slot_time_ms_arg.isSet()) {
+      parameters_sent &= tnc_interface->SetSlotTime(
+          kiss_slot_time_ms_arg.getValue());
+    }
+
+    if (kiss_tx_tail_ms_arg.isSet()) {
+      parameters_sent &= tnc_interface->SetTxTail(
+          kiss_tx_tail_ms_arg.getValue());
+    }
+
+    if (kiss_full_duplex_arg.getValue()) {
+      parameters_sent &= tnc_interface->SetFullDuplex(true);
+    }
+
+    if (!parameters_sent) {
+      LOGFATAL("failed to set KISS parameters");
+    }
   }
 
   // Perform the file transger operation.
   int return_code = -1;
   if (!send_file_arg.getValue().empty()) {
+    std::vector<au::CallsignConfig> digipeaters;
+    for (const auto& digipeater : digipeater_arg.getValue()) {
+      digipeaters.emplace_back();
+      if (!digipeaters.back().FromString(digipeater)) {
+        LOGFATAL("invalid digipeater '%s'", digipeater.c_str());
+      }
+    }
+
     au::FileSender file_sender(aprs_interface.get());
     if (file_sender.Send(send_file_arg.getValue(),
           max_file_chunk_size_arg.getValue(), {callsign_arg.getValue(), 0},
-          {peer_callsign_arg.getValue(), 0}, {})) {
+          {peer_callsign_arg.getValue(), 0}, digipeaters)) {
       return_code = 0;
     }
   } else if (receive_arg.getValue()) {
-    au::FileReceiver file_receiver(aprs_interface.get());
+    std::vector<std::unique_ptr<au::APRSInterface>> receive_interfaces;
+    std::vector<au::APRSInterface*> aprs_interfaces = {aprs_interface.get()};
+    for (int kiss_port : receive_kiss_port_arg.getValue()) {
+      receive_interfaces.push_back(std::make_unique<au::TNCAPRSInterface>(
+          aprs_config, kiss_connection, kiss_port));
+      aprs_interfaces.push_back(receive_interfaces.back().get());
+    }
+
+    for (const auto& receive_tnc : receive_tnc_arg.getValue()) {
+      auto separator_pos = receive_tnc.rfind(':');
+      if (separator_pos == std::string::npos) {
+        LOGFATAL("invalid TNC '%s', expected hostname:port",
+            receive_tnc.c_str());
+      }
+
+      receive_interfaces.push_back(std::make_unique<au::TNCAPRSInterface>(
+          aprs_config, receive_tnc.substr(0, separator_pos),
+          std::stoi(receive_tnc.substr(separator_pos + 1))));
+      aprs_interfaces.push_back(receive_interfaces.back().get());
+    }
+
+    au::FileReceiver file_receiver(aprs_interfaces);
     if (file_receiver.Receive({callsign_arg.getValue(), 0},
           {peer_callsign_arg.getValue(), 0})) {
       return_code = 0;
@@ -123,7 +418,12 @@ int main(int argc, char** argv) {
     LOGFATAL("must specify whether to send or receive");
   }
 
-  SDLNet_Quit();
+  if (kiss_restore_defaults_arg.getValue() && !tnc_interface->SetKISSParameters(
+        au::TNCAPRSInterface::kDefaultKISSParameters)) {
+    LOGE("failed to restore default KISS parameters");
+    return_code = -1;
+  }
+
   LOGI("success");
   return return_code;
 }
@@ -0,0 +1,346 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <tclap/CmdLine.h>
+
+#include "net/agw_aprs_interface.h"
+#include "net/ax25_frame_view.h"
+#include "util/log.h"
+#include "util/string.h"
+
+#define LOG_TAG "AGWBenchmark"
+
+// A description of the program.
+constexpr char kDescription[] =
+    "Sends frames through an AGWAPRSInterface to a fake AGWPE server on a "
+    "local port. The server checks the 'K' frames, answers the 'y' queries "
+    "with a draining transmit queue, echoes each frame back in fragments "
+    "among frames that must be ignored and drops the connection "
+    "periodically. Reports the frames per second and the reconnects.";
+
+// The version of the program.
+constexpr char kVersion[] = "0.0.1";
+
+// Offsets of the fields of an AGWPE frame header, which match those used by
+// AGWAPRSInterface.
+constexpr size_t kHeaderPortOffset = 0;
+constexpr size_t kHeaderKindOffset = 4;
+constexpr size_t kHeaderDataSizeOffset = 28;
+
+// The radio port that the interface uses.
+constexpr uint8_t kRadioPort = 1;
+
+// The time to wait for a frame to be echoed back.
+constexpr uint32_t kReceiveTimeoutMs = 5000;
+
+// Exposes the frame level methods of the AGW interface.
+class AGWInterface : public au::AGWAPRSInterface {
+ public:
+  using au::AGWAPRSInterface::AGWAPRSInterface;
+  using au::AGWAPRSInterface::Send;
+  using au::AGWAPRSInterface::Receive;
+  using au::AGWAPRSInterface::WaitForTransmitComplete;
+};
+
+// Counters kept by the fake server.
+struct ServerStats {
+  // The number of connections accepted.
+  size_t connection_count = 0;
+
+  // The number of 'K' frames received.
+  size_t raw_frame_count = 0;
+
+  // The number of 'y' queries answered.
+  size_t query_count = 0;
+};
+
+// Appends a little-endian 32-bit integer to a buffer.
+void AppendUint32(uint32_t value, std::vector<uint8_t>* buffer) {
+  for (size_t i = 0; i < 4; i++) {
+    buffer->push_back((value >> (i * 8)) & 0xff);
+  }
+}
+
+// Reads a little-endian 32-bit integer.
+uint32_t ReadUint32(const uint8_t* data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16)
+      | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+// Appends an AGWPE frame to a buffer.
+void AppendFrame(uint8_t port, char kind, const uint8_t* data, size_t size,
+    std::vector<uint8_t>* buffer) {
+  size_t header_offset = buffer->size();
+  buffer->resize(header_offset + kHeaderDataSizeOffset, 0);
+  (*buffer)[header_offset + kHeaderPortOffset] = port;
+  (*buffer)[header_offset + kHeaderKindOffset] = kind;
+  AppendUint32(size, buffer);
+  AppendUint32(0, buffer);
+  buffer->insert(buffer->end(), data, data + size);
+}
+
+// A fake AGWPE server that accepts one connection at a time on a local port
+// from a thread.
+class FakeAGWServer {
+ public:
+  // Starts listening. The connection is dropped after every drop_interval
+  // 'K' frames, without echoing the frame, and each frame sent keeps the
+  // transmit queue busy for queue_depth queries.
+  FakeAGWServer(size_t drop_interval, uint32_t queue_depth, uint32_t seed)
+      : drop_interval_(drop_interval),
+        queue_depth_(queue_depth),
+        rng_(seed),
+        outstanding_frame_count_(0) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_size = sizeof(address);
+    if (listen_fd_ < 0
+        || bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&address),
+            sizeof(address)) < 0
+        || listen(listen_fd_, 1) < 0
+        || getsockname(listen_fd_,
+            reinterpret_cast<struct sockaddr*>(&address), &address_size) < 0) {
+      LOGFATAL("failed to listen: %s (%d)", strerror(errno), errno);
+    }
+
+    port_ = ntohs(address.sin_port);
+    thread_ = std::thread(&FakeAGWServer::Serve, this);
+  }
+
+  // Stops accepting connections and waits for the current one to close.
+  ~FakeAGWServer() {
+    shutdown(listen_fd_, SHUT_RDWR);
+    thread_.join();
+    close(listen_fd_);
+  }
+
+  // Returns the port that the server listens on.
+  uint16_t GetPort() const { return port_; }
+
+  // Returns the counters of the server. Only valid once the server has been
+  // stopped or the client is idle.
+  const ServerStats& GetStats() const { return stats_; }
+
+ private:
+  const size_t drop_interval_;
+  const uint32_t queue_depth_;
+  std::mt19937 rng_;
+  int listen_fd_;
+  uint16_t port_;
+  std::thread thread_;
+  ServerStats stats_;
+
+  // The number of frames reported to be waiting to be transmitted.
+  uint32_t outstanding_frame_count_;
+
+  // Accepts connections until the listening socket is shut down.
+  void Serve() {
+    int fd;
+    while ((fd = accept(listen_fd_, nullptr, nullptr)) >= 0) {
+      stats_.connection_count++;
+      ServeConnection(fd);
+      close(fd);
+    }
+  }
+
+  // Handles the frames of a connection until it is closed by either end.
+  void ServeConnection(int fd) {
+    std::vector<uint8_t> rx_buffer;
+    bool raw_monitoring = false;
+    uint8_t read_buffer[4096];
+    ssize_t read_result;
+    while ((read_result = read(fd, read_buffer, sizeof(read_buffer))) > 0) {
+      rx_buffer.insert(rx_buffer.end(), read_buffer,
+          read_buffer + read_result);
+      size_t offset = 0;
+      while (rx_buffer.size() - offset >= au::AGWAPRSInterface::kHeaderSize) {
+        const uint8_t* header = &rx_buffer[offset];
+        uint32_t data_size = ReadUint32(&header[kHeaderDataSizeOffset]);
+        size_t frame_size = au::AGWAPRSInterface::kHeaderSize + data_size;
+        if (rx_buffer.size() - offset < frame_size) {
+          break;
+        }
+
+        char kind = header[kHeaderKindOffset];
+        if (header[kHeaderPortOffset] != kRadioPort) {
+          LOGFATAL("frame for radio port %" PRIu8, header[kHeaderPortOffset]);
+        } else if (!raw_monitoring && kind != 'k') {
+          LOGFATAL("frame of kind '%c' before raw monitoring", kind);
+        }
+
+        if (kind == 'k') {
+          raw_monitoring = true;
+        } else if (kind == 'K') {
+          if (!HandleRawFrame(fd, header + au::AGWAPRSInterface::kHeaderSize,
+                data_size)) {
+            return;
+          }
+        } else if (kind == 'y') {
+          std::vector<uint8_t> reply;
+          std::vector<uint8_t> count;
+          AppendUint32(outstanding_frame_count_, &count);
+          AppendFrame(kRadioPort, 'y', count.data(), count.size(), &reply);
+          WriteFragmented(fd, reply);
+          stats_.query_count++;
+          if (outstanding_frame_count_ > 0) {
+            outstanding_frame_count_--;
+          }
+        } else {
+          LOGFATAL("unexpected frame of kind '%c'", kind);
+        }
+
+        offset += frame_size;
+      }
+
+      rx_buffer.erase(rx_buffer.begin(), rx_buffer.begin() + offset);
+    }
+  }
+
+  // Checks a raw frame and echoes it back surrounded by frames that must be
+  // ignored. Returns false if the connection is to be dropped.
+  bool HandleRawFrame(int fd, const uint8_t* data, size_t size) {
+    au::AX25FrameView frame;
+    if (size < 1 || data[0] != 0x00 || !frame.Parse(data + 1, size - 1)
+        || !frame.IsAPRSFrame()) {
+      LOGFATAL("malformed raw frame");
+    }
+
+    stats_.raw_frame_count++;
+    outstanding_frame_count_ = queue_depth_;
+    if (drop_interval_ != 0 && stats_.raw_frame_count % drop_interval_ == 0) {
+      return false;
+    }
+
+    // A frame for another radio port and a frame of an unknown kind are sent
+    // around the echo.
+    std::vector<uint8_t> reply;
+    AppendFrame(kRadioPort + 1, 'K', data, size, &reply);
+    AppendFrame(kRadioPort, 'T', data, size, &reply);
+    AppendFrame(kRadioPort, 'K', data, size, &reply);
+    WriteFragmented(fd, reply);
+    return true;
+  }
+
+  // Writes a buffer in random pieces so that frames are split across reads.
+  void WriteFragmented(int fd, const std::vector<uint8_t>& buffer) {
+    size_t offset = 0;
+    while (offset < buffer.size()) {
+      size_t size = std::min<size_t>(buffer.size() - offset, 1 + rng_() % 64);
+      ssize_t result = send(fd, buffer.data() + offset, size, MSG_NOSIGNAL);
+      if (result < 0) {
+        return;
+      }
+
+      offset += result;
+      std::this_thread::yield();
+    }
+  }
+};
+
+int main(int argc, char** argv) {
+  // Command line flags.
+  TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
+  TCLAP::ValueArg<size_t> frame_count_arg("", "frame_count",
+      "The number of frames to send.", false, 20, "count", cmd);
+  TCLAP::ValueArg<size_t> drop_interval_arg("", "drop_interval",
+      "The number of frames received by the server between dropped "
+      "connections. Zero never drops the connection.", false, 7, "count",
+      cmd);
+  TCLAP::ValueArg<uint32_t> queue_depth_arg("", "queue_depth",
+      "The number of queries that the transmit queue of the server stays "
+      "busy for after each frame.", false, 2, "count", cmd);
+  TCLAP::ValueArg<uint32_t> seed_arg("", "seed",
+      "The seed of the fragmentation of the replies.", false, 1, "seed", cmd);
+  cmd.parse(argc, argv);
+
+  FakeAGWServer server(drop_interval_arg.getValue(),
+      queue_depth_arg.getValue(), seed_arg.getValue());
+
+  au::APRSInterface::Config config = {};
+  config.transmit_interval_s = 0.0f;
+  config.retransmit_count = 0;
+  config.max_packet_size = au::APRSInterface::kDefaultMaxPacketSize;
+
+  au::CallsignConfig source;
+  au::CallsignConfig destination;
+  au::CallsignConfig digipeater;
+  source.FromString("N0CALL-7");
+  destination.FromString("APZ222");
+  digipeater.FromString("WIDE1-1");
+
+  // Send each frame until it is echoed back. A frame that is lost to a dropped
+  // connection is sent again once the interface has reconnected.
+  size_t frame_count = frame_count_arg.getValue();
+  size_t resend_count = 0;
+  auto start_time = std::chrono::steady_clock::now();
+  {
+    AGWInterface interface(config, "127.0.0.1", server.GetPort(),
+        kRadioPort);
+    for (size_t i = 0; i < frame_count; i++) {
+      std::string payload = au::StringFormat(">frame %zu", i);
+      interface.Send(payload, source, destination, {digipeater});
+      if (!interface.WaitForTransmitComplete()) {
+        LOGI("frame %zu lost, sending again", i);
+        resend_count++;
+        i--;
+        continue;
+      }
+
+      au::CallsignConfig rx_source;
+      au::CallsignConfig rx_destination;
+      std::vector<au::CallsignConfig> rx_digipeaters;
+      std::string rx_payload;
+      if (!interface.Receive(&rx_source, &rx_destination, &rx_digipeaters,
+            &rx_payload, kReceiveTimeoutMs)) {
+        LOGFATAL("frame %zu was not echoed", i);
+      } else if (!(rx_source == source) || !(rx_destination == destination)
+          || rx_digipeaters.size() != 1 || !(rx_digipeaters[0] == digipeater)
+          || rx_payload != payload) {
+        LOGFATAL("echo of frame %zu does not match", i);
+      }
+    }
+
+    const auto& reconnect_stats = interface.GetReconnectStats();
+    LOGI("reconnected %" PRIu64 " times, %" PRIu64 "ms offline",
+        reconnect_stats.reconnect_count, reconnect_stats.downtime_us / 1000);
+  }
+
+  double time_s = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time).count();
+  const auto& stats = server.GetStats();
+  LOGI("sent %zu frames with %zu resent in %.2fs, %.1f frames/s", frame_count,
+      resend_count, time_s, frame_count / time_s);
+  LOGI("server accepted %zu connections, received %zu frames, answered %zu "
+      "queries", stats.connection_count, stats.raw_frame_count,
+      stats.query_count);
+  return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <random>
+#include <string>
+
+#include <tclap/CmdLine.h>
+
+#include "net/aprs_interface.h"
+#include "net/kiss_frame_builder.h"
+#include "util/base91.h"
+#include "util/log.h"
+#include "util/string.h"
+
+#define LOG_TAG "CodecBenchmark"
+
+// A description of the program.
+constexpr char kDescription[] =
+    "Measures the throughput and size overhead of the base64 and base91 text "
+    "encodings of binary payloads.";
+
+// The version of the program.
+constexpr char kVersion[] = "0.0.1";
+
+// Returns the time in seconds taken to invoke the function the supplied number
+// of times.
+template<typename Function>
+double Measure(size_t iteration_count, Function function) {
+  auto start_time = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iteration_count; i++) {
+    function();
+  }
+
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time).count();
+}
+
+// Logs the throughput of an operation on the supplied number of bytes.
+void LogThroughput(const char* name, size_t size, size_t iteration_count,
+    double time_s) {
+  LOGI("%-24s %8.1f MB/s %8.1f ns/payload", name,
+      size * iteration_count / time_s / 1e6,
+      time_s / iteration_count * 1e9);
+}
+
+int main(int argc, char** argv) {
+  // Command line flags.
+  TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
+  TCLAP::ValueArg<size_t> payload_size_arg("", "payload_size",
+      "The size of each payload to encode, such as a serialized chunk.",
+      false, au::APRSInterface::kDefaultMaxPacketSize, "bytes", cmd);
+  TCLAP::ValueArg<size_t> iteration_count_arg("", "iteration_count",
+      "The number of payloads to encode and decode with each codec.",
+      false, 1000000, "count", cmd);
+  TCLAP::ValueArg<uint32_t> seed_arg("", "seed",
+      "The seed of the random payload.", false, 1, "seed", cmd);
+  cmd.parse(argc, argv);
+
+  size_t size = payload_size_arg.getValue();
+  size_t iteration_count = iteration_count_arg.getValue();
+  std::mt19937 rng(seed_arg.getValue());
+  std::string payload(size, '\0');
+  for (auto& byte : payload) {
+    byte = rng();
+  }
+
+  const auto* data = reinterpret_cast<const uint8_t*>(payload.data());
+  std::string base64 = au::StringBase64Encode(payload);
+  std::string base91 = au::Base91::Encode(payload);
+  std::string decoded;
+  if (!au::Base91::Decode(base91.data(), base91.size(), &decoded)
+      || decoded != payload || au::StringBase64Decode(base64) != payload) {
+    LOGFATAL("payload did not survive encoding");
+  }
+
+  LOGI("payload=%zu bytes base64=%zu chars (%.1f%%) base91=%zu chars "
+      "(%.1f%%)", size, base64.size(), 100.0 * base64.size() / size - 100.0,
+      base91.size(), 100.0 * base91.size() / size - 100.0);
+
+  // The results are accumulated so that the work is not optimized away.
+  size_t result_size = 0;
+  LogThroughput("base64 encode", size, iteration_count,
+      Measure(iteration_count, [&] {
+        result_size += au::StringBase64Encode(payload).size();
+      }));
+  LogThroughput("base91 encode", size, iteration_count,
+      Measure(iteration_count, [&] {
+        result_size += au::Base91::Encode(payload).size();
+      }));
+
+  au::KISSFrameBuilder frame_builder;
+  const au::CallsignConfig source({"N0CALL", 0});
+  const au::CallsignConfig destination({au::kBroadcastCallsign, 0});
+  LogThroughput("base64 kiss frame", size, iteration_count,
+      Measure(iteration_count, [&] {
+        frame_builder.Begin(0, source, destination, {});
+        frame_builder.AppendBase64(data, size);
+        result_size += frame_builder.End().size();
+      }));
+  LogThroughput("base91 kiss frame", size, iteration_count,
+      Measure(iteration_count, [&] {
+        frame_builder.Begin(0, source, destination, {});
+        frame_builder.AppendBase91(data, size);
+        result_size += frame_builder.End().size();
+      }));
+
+  LogThroughput("base64 decode", size, iteration_count,
+      Measure(iteration_count, [&] {
+        result_size += au::StringBase64Decode(base64).size();
+      }));
+  LogThroughput("base91 decode", size, iteration_count,
+      Measure(iteration_count, [&] {
+        decoded.clear();
+        au::Base91::Decode(base91.data(), base91.size(), &decoded);
+        result_size += decoded.size();
+      }));
+
+  LOGI("encoded %zu bytes in total", result_size);
+  return 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <tclap/CmdLine.h>
+
+#include "net/kiss_deframer.h"
+#include "util/log.h"
+
+#define LOG_TAG "DeframerBenchmark"
+
+// A description of the program.
+constexpr char kDescription[] =
+    "Measures the frames per second and the system calls per frame needed to "
+    "receive a stream of KISS frames, reading one byte at a time as the TNC "
+    "interface used to and reading in blocks into a KISSDeframer.";
+
+// The version of the program.
+constexpr char kVersion[] = "0.0.1";
+
+// Special bytes of the KISS protocol.
+constexpr uint8_t kFEND = 0xc0;
+constexpr uint8_t kFESC = 0xdb;
+constexpr uint8_t kTFEND = 0xdc;
+constexpr uint8_t kTFESC = 0xdd;
+
+// The size of the blocks read by the buffered receiver, which matches the
+// read buffer of KISSConnection.
+constexpr size_t kReadBufferSize = 4096;
+
+// The outcome of receiving the stream with one method.
+struct Result {
+  // The number of frames decoded.
+  size_t frame_count = 0;
+
+  // The number of poll and recv calls made.
+  size_t syscall_count = 0;
+
+  // The time taken to receive the stream.
+  double time_s = 0.0;
+};
+
+// Decodes one byte at a time into a string in the way that the TNC interface
+// did before KISSDeframer. Returns true when a frame has been completed.
+class ByteDeframer {
+ public:
+  // Decodes a byte.
+  bool Push(uint8_t byte) {
+    if (byte == kFEND) {
+      next_byte_is_header_ = true;
+      return !frame_.empty();
+    } else if (next_byte_is_header_) {
+      in_frame_ = (byte & 0x0f) == 0;
+      next_byte_is_header_ = false;
+    } else if (in_escape_) {
+      in_escape_ = false;
+      frame_ += byte == kTFEND ? kFEND : kFESC;
+    } else if (byte == kFESC) {
+      in_escape_ = true;
+    } else if (in_frame_) {
+      frame_ += byte;
+    }
+
+    return false;
+  }
+
+  // Discards the frame that was completed.
+  void Clear() {
+    frame_.clear();
+  }
+
+ private:
+  std::string frame_;
+  bool in_frame_ = false;
+  bool in_escape_ = false;
+  bool next_byte_is_header_ = false;
+};
+
+// Returns a stream of KISS data frames with random contents, which include
+// bytes that must be escaped.
+std::vector<uint8_t> BuildStream(size_t frame_count, size_t frame_size,
+    uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> stream;
+  for (size_t i = 0; i < frame_count; i++) {
+    stream.push_back(kFEND);
+    stream.push_back(0x00);
+    for (size_t j = 0; j < frame_size; j++) {
+      uint8_t byte = rng();
+      if (byte == kFEND) {
+        stream.push_back(kFESC);
+        stream.push_back(kTFEND);
+      } else if (byte == kFESC) {
+        stream.push_back(kFESC);
+        stream.push_back(kTFESC);
+      } else {
+        stream.push_back(byte);
+      }
+    }
+
+    stream.push_back(kFEND);
+  }
+
+  return stream;
+}
+
+// Writes the stream to a socket from another thread and invokes the receiver
+// with the other end of the socket.
+template<typename Receiver>
+Result MeasureSocket(const std::vector<uint8_t>& stream, Receiver receiver) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+    LOGFATAL("failed to create socket pair: %s (%d)", strerror(errno), errno);
+  }
+
+  std::thread writer([&stream, fd = fds[1]]() {
+    size_t offset = 0;
+    while (offset < stream.size()) {
+      ssize_t result = write(fd, stream.data() + offset,
+          std::min(stream.size() - offset, kReadBufferSize));
+      if (result < 0) {
+        LOGFATAL("failed to write stream: %s (%d)", strerror(errno), errno);
+      }
+
+      offset += result;
+    }
+
+    close(fd);
+  });
+
+  Result result;
+  auto start_time = std::chrono::steady_clock::now();
+  receiver(fds[0], &result);
+  result.time_s = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time).count();
+  writer.join();
+  close(fds[0]);
+  return result;
+}
+
+// Waits for the socket to become readable. Returns false if the wait fails.
+bool WaitReadable(int fd, int timeout_ms, Result* result) {
+  struct pollfd poll_fd = {};
+  poll_fd.fd = fd;
+  poll_fd.events = POLLIN;
+  result->syscall_count++;
+  return poll(&poll_fd, 1, timeout_ms) >= 0;
+}
+
+// Logs the outcome of receiving the stream with one method.
+void LogResult(const char* name, const Result& result) {
+  LOGI("%-16s %10.0f frames/s %8.2f syscalls/frame", name,
+      result.frame_count / result.time_s,
+      static_cast<double>(result.syscall_count) / result.frame_count);
+}
+
+int main(int argc, char** argv) {
+  // Command line flags.
+  TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
+  TCLAP::ValueArg<size_t> frame_count_arg("", "frame_count",
+      "The number of frames in the stream.", false, 20000, "count", cmd);
+  TCLAP::ValueArg<size_t> frame_size_arg("", "frame_size",
+      "The size of each frame before escaping, such as an AX.25 frame "
+      "carrying a chunk.", false, 160, "bytes", cmd);
+  TCLAP::ValueArg<uint32_t> seed_arg("", "seed",
+      "The seed of the random frame contents.", false, 1, "seed", cmd);
+  cmd.parse(argc, argv);
+
+  size_t frame_count = frame_count_arg.getValue();
+  auto stream = BuildStream(frame_count, frame_size_arg.getValue(),
+      seed_arg.getValue());
+  LOGI("stream of %zu frames in %zu bytes", frame_count, stream.size());
+
+  // Before: check the socket with a 1ms timeout and read a single byte.
+  Result byte_result = MeasureSocket(stream, [](int fd, Result* result) {
+    ByteDeframer deframer;
+    while (WaitReadable(fd, /*timeout_ms=*/1, result)) {
+      uint8_t byte;
+      result->syscall_count++;
+      ssize_t read_result = recv(fd, &byte, 1, 0);
+      if (read_result <= 0) {
+        break;
+      } else if (deframer.Push(byte)) {
+        deframer.Clear();
+        result->frame_count++;
+      }
+    }
+  });
+
+  // After: wait for the socket and read blocks into a KISSDeframer.
+  Result block_result = MeasureSocket(stream, [](int fd, Result* result) {
+    au::KISSDeframer deframer;
+    uint8_t read_buffer[kReadBufferSize];
+    while (WaitReadable(fd, /*timeout_ms=*/-1, result)) {
+      result->syscall_count++;
+      ssize_t read_result = recv(fd, read_buffer, sizeof(read_buffer), 0);
+      if (read_result <= 0) {
+        break;
+      }
+
+      deframer.Push(read_buffer, read_result);
+      while (deframer.HasFrame()) {
+        deframer.PopFrame();
+        result->frame_count++;
+      }
+    }
+  });
+
+  if (byte_result.frame_count != frame_count
+      || block_result.frame_count != frame_count) {
+    LOGFATAL("decoded %zu and %zu of %zu frames", byte_result.frame_count,
+        block_result.frame_count, frame_count);
+  }
+
+  LogResult("byte reads", byte_result);
+  LogResult("block reads", block_result);
+  return 0;
+}
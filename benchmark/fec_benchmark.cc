@@ -0,0 +1,236 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+
+#include "net/aprs_interface.h"
+#include "net/erasure_code.h"
+#include "util/log.h"
+
+#define LOG_TAG "FECBenchmark"
+
+// A description of the program.
+constexpr char kDescription[] =
+    "Compares the airtime needed to deliver a packet over a lossy channel "
+    "with retransmission and with forward error correction.";
+
+// The version of the program.
+constexpr char kVersion[] = "0.0.1";
+
+// The outcome of sending one packet.
+struct Trial {
+  // Set to true if the receiver recovered the packet.
+  bool complete;
+
+  // The number of payload bytes sent until the receiver recovered the packet,
+  // or by the sender in total if it did not.
+  size_t bytes_sent;
+};
+
+// The outcome of sending many packets with one scheme.
+struct Result {
+  // The number of packets that were recovered.
+  size_t complete_count = 0;
+
+  // The sum of the bytes sent until each recovered packet was complete.
+  size_t complete_bytes_sent = 0;
+
+  // The number of bytes that the sender transmits for each packet.
+  size_t bytes_per_packet = 0;
+
+  // Accumulates the outcome of a trial.
+  void Add(const Trial& trial) {
+    if (trial.complete) {
+      complete_count++;
+      complete_bytes_sent += trial.bytes_sent;
+    }
+  }
+};
+
+// Sends the payload as chunks of up to the maximum packet size, each repeated
+// the retransmit count times, as APRSInterface does without forward error
+// correction.
+Trial SimulateRetransmit(const std::string& payload, size_t max_packet_size,
+    size_t retransmit_count, float loss_rate, std::mt19937* rng) {
+  std::bernoulli_distribution lost(loss_rate);
+  size_t chunk_count = (payload.size() + max_packet_size - 1)
+      / max_packet_size;
+  std::vector<bool> received(chunk_count, false);
+  size_t received_count = 0;
+
+  Trial trial = {};
+  for (size_t i = 0; i < retransmit_count; i++) {
+    for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+      size_t offset = chunk * max_packet_size;
+      trial.bytes_sent += std::min(max_packet_size, payload.size() - offset);
+      if (!lost(*rng) && !received[chunk]) {
+        received[chunk] = true;
+        if (++received_count == chunk_count) {
+          trial.complete = true;
+          return trial;
+        }
+      }
+    }
+  }
+
+  return trial;
+}
+
+// Sends the payload as erasure coded source and repair symbols, as
+// APRSInterface does with forward error correction, and checks that the
+// decoder recovers it.
+Trial SimulateErasureCode(const std::string& payload, size_t max_packet_size,
+    size_t retransmit_count, float fec_redundancy, float loss_rate,
+    std::mt19937* rng) {
+  std::bernoulli_distribution lost(loss_rate);
+  size_t source_count = (payload.size() + max_packet_size - 1)
+      / max_packet_size;
+  size_t repair_count = std::ceil(source_count * fec_redundancy);
+  size_t symbol_size = (payload.size() + source_count - 1) / source_count;
+
+  std::vector<std::string> source(source_count);
+  for (size_t i = 0; i < source_count; i++) {
+    source[i] = payload.substr(i * symbol_size, symbol_size);
+    source[i].resize(symbol_size);
+  }
+
+  std::vector<std::string> symbols(source);
+  symbols.resize(source_count + repair_count);
+  for (size_t i = source_count; i < symbols.size(); i++) {
+    au::ErasureCode::EncodeRepairSymbol(source, i, &symbols[i]);
+  }
+
+  // The last source symbol is sent without its padding.
+  symbols[source_count - 1].resize(
+      payload.size() - (source_count - 1) * symbol_size);
+
+  au::ErasureDecoder decoder(source_count, symbol_size);
+  Trial trial = {};
+  for (size_t i = 0; i < retransmit_count; i++) {
+    for (size_t symbol_id = 0; symbol_id < symbols.size(); symbol_id++) {
+      trial.bytes_sent += symbols[symbol_id].size();
+      if (!lost(*rng) && decoder.AddSymbol(symbol_id, symbols[symbol_id])
+          && decoder.IsComplete()) {
+        std::string decoded;
+        decoder.GetSource(&decoded);
+        decoded.resize(payload.size());
+        if (decoded != payload) {
+          LOGFATAL("decoded payload does not match");
+        }
+
+        trial.complete = true;
+        return trial;
+      }
+    }
+  }
+
+  return trial;
+}
+
+// Logs a row of the results table.
+void LogResult(const char* scheme, float loss_rate, size_t trial_count,
+    const Result& result) {
+  float mean_bytes = result.complete_count == 0 ? 0.0f
+      : static_cast<float>(result.complete_bytes_sent)
+          / result.complete_count;
+  LOGI("%-14s loss=%4.2f complete=%6.2f%% bytes_to_complete=%8.1f "
+      "bytes_per_packet=%zu", scheme, loss_rate,
+      100.0f * result.complete_count / trial_count, mean_bytes,
+      result.bytes_per_packet);
+}
+
+int main(int argc, char** argv) {
+  // Command line flags.
+  TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
+  TCLAP::ValueArg<size_t> payload_size_arg("", "payload_size",
+      "The size of the serialized packet to send.",
+      false, 1000, "bytes", cmd);
+  TCLAP::ValueArg<size_t> max_packet_size_arg("", "aprs_max_packet_size",
+      "The maximum size of an APRS packet to transfer.",
+      false, au::APRSInterface::kDefaultMaxPacketSize, "bytes", cmd);
+  TCLAP::ValueArg<size_t> retransmit_count_arg("", "aprs_retransmit_count",
+      "The number of times to retransmit a packet without forward error "
+      "correction.",
+      false, au::APRSInterface::kDefaultRetransmitCount, "count", cmd);
+  TCLAP::ValueArg<float> fec_redundancy_arg("", "aprs_fec_redundancy",
+      "The fraction of repair chunks to send with forward error correction.",
+      false, 0.5f, "fraction", cmd);
+  TCLAP::ValueArg<size_t> fec_retransmit_count_arg("",
+      "fec_retransmit_count", "The number of times to retransmit a packet "
+      "with forward error correction.", false, 1, "count", cmd);
+  TCLAP::ValueArg<float> max_loss_rate_arg("", "max_loss_rate",
+      "The highest fraction of frames to lose.", false, 0.5f, "fraction", cmd);
+  TCLAP::ValueArg<size_t> trial_count_arg("", "trial_count",
+      "The number of packets to send at each loss rate.",
+      false, 10000, "count", cmd);
+  TCLAP::ValueArg<uint32_t> seed_arg("", "seed",
+      "The seed of the simulated channel.", false, 1, "seed", cmd);
+  cmd.parse(argc, argv);
+
+  size_t payload_size = payload_size_arg.getValue();
+  size_t max_packet_size = max_packet_size_arg.getValue();
+  if (payload_size == 0 || max_packet_size == 0) {
+    LOGFATAL("payload size and max packet size must be non-zero");
+  }
+
+  size_t source_count = (payload_size + max_packet_size - 1) / max_packet_size;
+  size_t repair_count = std::ceil(source_count
+      * fec_redundancy_arg.getValue());
+  if (source_count + repair_count > au::ErasureCode::kMaxSymbolCount) {
+    LOGFATAL("packet of %zu chunks is too large for forward error correction",
+        source_count);
+  }
+
+  std::mt19937 rng(seed_arg.getValue());
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::string payload(payload_size, '\0');
+  for (auto& c : payload) {
+    c = byte(rng);
+  }
+
+  LOGI("payload_size=%zu chunks=%zu repair_chunks=%zu", payload_size,
+      source_count, repair_count);
+  for (float loss_rate = 0.0f; loss_rate <= max_loss_rate_arg.getValue()
+      + 1e-6f; loss_rate += 0.05f) {
+    Result retransmit;
+    Result erasure_code;
+    for (size_t i = 0; i < trial_count_arg.getValue(); i++) {
+      retransmit.Add(SimulateRetransmit(payload, max_packet_size,
+          retransmit_count_arg.getValue(), loss_rate, &rng));
+      erasure_code.Add(SimulateErasureCode(payload, max_packet_size,
+          fec_retransmit_count_arg.getValue(), fec_redundancy_arg.getValue(),
+          loss_rate, &rng));
+    }
+
+    retransmit.bytes_per_packet = SimulateRetransmit(payload, max_packet_size,
+        retransmit_count_arg.getValue(), 1.0f, &rng).bytes_sent;
+    erasure_code.bytes_per_packet = SimulateErasureCode(payload,
+        max_packet_size, fec_retransmit_count_arg.getValue(),
+        fec_redundancy_arg.getValue(), 1.0f, &rng).bytes_sent;
+    LogResult("retransmit", loss_rate, trial_count_arg.getValue(),
+        retransmit);
+    LogResult("erasure_code", loss_rate, trial_count_arg.getValue(),
+        erasure_code);
+  }
+
+  return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+
+#include "net/aprs_interface.h"
+#include "net/compact_chunk_header.h"
+#include "util/base91.h"
+#include "util/log.h"
+
+#define LOG_TAG "FramingBenchmark"
+
+// A description of the program.
+constexpr char kDescription[] =
+    "Reports the bytes that framing adds to a file transfer when chunks are "
+    "sent as serialized PacketChunks and with a compact chunk header.";
+
+// The version of the program.
+constexpr char kVersion[] = "0.0.1";
+
+// The file sizes to report if none are supplied.
+const std::vector<size_t> kDefaultFileSizes = {
+  1024, 2048, 4096, 6144, 8192, 10240,
+};
+
+// A typical payload id sent with protobuf framing, which is derived from the
+// time and so takes a 5 byte varint.
+constexpr uint32_t kProtobufPayloadId = 0xd5a3e1f7;
+
+// A typical short payload id sent with the compact chunk header.
+constexpr uint32_t kCompactPayloadId = 0xe1f7;
+
+// The bytes sent for a file transfer.
+struct Framing {
+  // The number of frames sent.
+  size_t frame_count = 0;
+
+  // The bytes of the serialized packets that carry the file.
+  size_t packet_bytes = 0;
+
+  // The bytes of the frames with protobuf framing and with the compact header.
+  size_t protobuf_bytes = 0;
+  size_t compact_bytes = 0;
+
+  // The characters sent on air with protobuf framing in base64 and with the
+  // compact header in base91.
+  size_t protobuf_base64_chars = 0;
+  size_t compact_base91_chars = 0;
+};
+
+// Returns the packets that a FileSender sends for a file of the supplied size.
+std::vector<au::Packet> BuildFilePackets(size_t file_size,
+    size_t max_chunk_size, std::mt19937* rng) {
+  std::string file_contents(file_size, '\0');
+  for (auto& byte : file_contents) {
+    byte = (*rng)();
+  }
+
+  std::vector<au::Packet> packets(1);
+  auto* header = packets[0].mutable_file_transfer_header();
+  header->set_filename("image.webp");
+  header->set_size(file_size);
+  header->set_id(1);
+
+  uint32_t chunk_id = 1;
+  for (size_t offset = 0; offset < file_size;) {
+    size_t chunk_size = max_chunk_size == 0 ? file_size : max_chunk_size;
+    chunk_size = std::min(file_size - offset, chunk_size);
+    packets.emplace_back();
+    auto* chunk = packets.back().mutable_file_transfer_chunk();
+    chunk->set_id(1);
+    chunk->set_chunk_id(chunk_id++);
+    chunk->set_chunk(file_contents.substr(offset, chunk_size));
+    offset += chunk_size;
+  }
+
+  return packets;
+}
+
+// Splits a packet into chunks as the APRSInterface does and accumulates the
+// bytes sent with each framing.
+void AddPacketFraming(const au::Packet& packet, size_t max_packet_size,
+    Framing* framing) {
+  std::string serialized_packet;
+  if (!packet.SerializeToString(&serialized_packet)) {
+    LOGFATAL("failed to serialize packet");
+  }
+
+  framing->packet_bytes += serialized_packet.size();
+  uint32_t chunk_id = 1;
+  for (size_t offset = 0; offset < serialized_packet.size();) {
+    au::PacketChunk packet_chunk;
+    auto* chunk = packet_chunk.mutable_chunk();
+    chunk->set_payload_id(kProtobufPayloadId);
+    chunk->set_chunk_id(chunk_id++);
+    chunk->set_retransmit_id(1);
+    if (offset == 0) {
+      chunk->set_total_payload_size(serialized_packet.size());
+    }
+
+    size_t chunk_size = std::min(max_packet_size,
+        serialized_packet.size() - offset);
+    chunk->set_payload(serialized_packet.substr(offset, chunk_size));
+    offset += chunk_size;
+
+    size_t protobuf_size = packet_chunk.ByteSizeLong();
+    chunk->set_payload_id(kCompactPayloadId);
+    size_t compact_size = au::CompactChunkHeader::GetEncodedSize(*chunk);
+    framing->frame_count++;
+    framing->protobuf_bytes += protobuf_size;
+    framing->compact_bytes += compact_size;
+    framing->protobuf_base64_chars += 1 + (protobuf_size + 2) / 3 * 4;
+    framing->compact_base91_chars += 2
+        + au::Base91::GetMaxEncodedSize(compact_size);
+  }
+}
+
+int main(int argc, char** argv) {
+  // Command line flags.
+  TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
+  TCLAP::MultiArg<size_t> file_size_arg("", "file_size",
+      "The size of a file to report. May be repeated, and defaults to sizes "
+      "from 1 to 10 kB.", false, "bytes", cmd);
+  TCLAP::ValueArg<size_t> max_file_chunk_size_arg("", "max_file_chunk_size",
+      "The size of a file chunk to transfer, or zero to send the file as one "
+      "packet.", false, 0, "bytes", cmd);
+  TCLAP::ValueArg<size_t> max_packet_size_arg("", "aprs_max_packet_size",
+      "The maximum size of an APRS packet to transfer.",
+      false, au::APRSInterface::kDefaultMaxPacketSize, "bytes", cmd);
+  TCLAP::ValueArg<uint32_t> seed_arg("", "seed",
+      "The seed of the random file contents.", false, 1, "seed", cmd);
+  cmd.parse(argc, argv);
+
+  std::vector<size_t> file_sizes = file_size_arg.getValue();
+  if (file_sizes.empty()) {
+    file_sizes = kDefaultFileSizes;
+  }
+
+  std::mt19937 rng(seed_arg.getValue());
+  for (size_t file_size : file_sizes) {
+    Framing framing;
+    for (const auto& packet : BuildFilePackets(file_size,
+          max_file_chunk_size_arg.getValue(), &rng)) {
+      AddPacketFraming(packet, max_packet_size_arg.getValue(), &framing);
+    }
+
+    // The overhead of the packets that fragment the file is shared by both
+    // framings, and the rest is added by the chunk framing.
+    size_t packet_overhead = framing.packet_bytes - file_size;
+    size_t protobuf_overhead = framing.protobuf_bytes - framing.packet_bytes;
+    size_t compact_overhead = framing.compact_bytes - framing.packet_bytes;
+    LOGI("file=%zu frames=%zu packet_overhead=%zu "
+        "protobuf_overhead=%zu (%.1f/frame) compact_overhead=%zu "
+        "(%.1f/frame) saved=%.1f%%", file_size, framing.frame_count,
+        packet_overhead, protobuf_overhead,
+        static_cast<double>(protobuf_overhead) / framing.frame_count,
+        compact_overhead,
+        static_cast<double>(compact_overhead) / framing.frame_count,
+        100.0 - 100.0 * framing.compact_bytes / framing.protobuf_bytes);
+    LOGI("file=%zu on_air protobuf_base64=%zu compact_base91=%zu "
+        "saved=%.1f%%", file_size, framing.protobuf_base64_chars,
+        framing.compact_base91_chars,
+        100.0 - 100.0 * framing.compact_base91_chars
+            / framing.protobuf_base64_chars);
+  }
+
+  return 0;
+}
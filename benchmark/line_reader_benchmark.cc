@@ -0,0 +1,227 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <tclap/CmdLine.h>
+
+#include "net/line_reader.h"
+#include "net/tcp_socket.h"
+#include "util/file.h"
+#include "util/log.h"
+#include "util/string.h"
+
+#define LOG_TAG "LineReaderBenchmark"
+
+// A description of the program.
+constexpr char kDescription[] =
+    "Measures the throughput of reading an APRS-IS feed from a local server "
+    "one byte at a time as the internet interface used to and in bulk with a "
+    "LineReader.";
+
+// The version of the program.
+constexpr char kVersion[] = "0.0.1";
+
+// The outcome of reading the feed with one method.
+struct Result {
+  // The number of lines read.
+  size_t line_count = 0;
+
+  // The number of bytes in the lines that were read.
+  size_t byte_count = 0;
+
+  // The number of reads from the socket that returned bytes.
+  size_t read_count = 0;
+
+  // The time taken to read the feed.
+  double time_s = 0.0;
+};
+
+// Returns a feed of lines in the style of an APRS-IS full feed, with a
+// keepalive comment every thousand lines.
+std::string BuildFeed(size_t line_count, uint32_t seed) {
+  static const char* const kPaths[] = {
+    "APRS,TCPIP*,qAC,T2TEST",
+    "APDW16,WIDE1-1,WIDE2-1,qAR,N0GATE",
+    "APZ222,WIDE2-2,qAO,N0GATE-10",
+    "APN383,RELAY*,WIDE3-2,qAR,N0GATE-2",
+  };
+
+  std::mt19937 rng(seed);
+  std::string feed;
+  for (size_t i = 0; i < line_count; i++) {
+    if (i % 1000 == 0) {
+      feed += "# aprsc 2.1.10 1 Jan 2020 00:00:00 GMT T2TEST "
+          "1.2.3.4:14580\r\n";
+    }
+
+    char callsign[7] = {};
+    for (size_t j = 0; j < 6; j++) {
+      callsign[j] = j == 2 ? '0' + rng() % 10 : 'A' + rng() % 26;
+    }
+
+    feed += au::StringFormat("%s-%u>%s:!%02u%02u.%02uN/%03u%02u.%02uW-"
+        "PHG%04u position %zu\r\n", callsign, rng() % 16,
+        kPaths[rng() % (sizeof(kPaths) / sizeof(kPaths[0]))],
+        rng() % 90, rng() % 60, rng() % 100, rng() % 180, rng() % 60,
+        rng() % 100, rng() % 10000, i);
+  }
+
+  return feed;
+}
+
+// Serves the feed once from a local port and reads it with the supplied
+// reader, which is passed a socket connected to the server.
+template<typename Reader>
+Result MeasureFeed(const std::string& feed, Reader reader) {
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t address_size = sizeof(address);
+  if (listen_fd < 0
+      || bind(listen_fd, reinterpret_cast<struct sockaddr*>(&address),
+          sizeof(address)) < 0
+      || listen(listen_fd, 1) < 0
+      || getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&address),
+          &address_size) < 0) {
+    LOGFATAL("failed to listen: %s (%d)", strerror(errno), errno);
+  }
+
+  std::thread server([&feed, listen_fd]() {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      LOGFATAL("failed to accept: %s (%d)", strerror(errno), errno);
+    }
+
+    size_t offset = 0;
+    while (offset < feed.size()) {
+      ssize_t result = write(fd, feed.data() + offset, feed.size() - offset);
+      if (result < 0) {
+        LOGFATAL("failed to write feed: %s (%d)", strerror(errno), errno);
+      }
+
+      offset += result;
+    }
+
+    close(fd);
+  });
+
+  au::TCPSocket socket;
+  if (!socket.Connect("127.0.0.1", ntohs(address.sin_port))) {
+    LOGFATAL("failed to connect to the feed");
+  }
+
+  Result result;
+  auto start_time = std::chrono::steady_clock::now();
+  reader(&socket, &result);
+  result.time_s = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time).count();
+  server.join();
+  close(listen_fd);
+  return result;
+}
+
+// Logs the outcome of reading the feed with one method.
+void LogResult(const char* name, const Result& result) {
+  LOGI("%-12s %10.0f lines/s %8.1f MB/s %8.3f reads/line", name,
+      result.line_count / result.time_s, result.byte_count / result.time_s
+      / 1e6, static_cast<double>(result.read_count) / result.line_count);
+}
+
+int main(int argc, char** argv) {
+  // Command line flags.
+  TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
+  TCLAP::ValueArg<std::string> feed_file_arg("", "feed_file",
+      "A recorded APRS-IS feed to serve, such as one captured from port "
+      "10152. A feed in the same style is generated if this is not supplied.",
+      false, "", "path", cmd);
+  TCLAP::ValueArg<size_t> line_count_arg("", "line_count",
+      "The number of lines to generate.", false, 100000, "count", cmd);
+  TCLAP::ValueArg<uint32_t> seed_arg("", "seed",
+      "The seed of the generated feed.", false, 1, "seed", cmd);
+  cmd.parse(argc, argv);
+
+  std::string feed;
+  if (feed_file_arg.getValue().empty()) {
+    feed = BuildFeed(line_count_arg.getValue(), seed_arg.getValue());
+  } else if (!au::ReadFileToString(feed_file_arg.getValue(), &feed)) {
+    LOGFATAL("failed to read feed '%s'", feed_file_arg.getValue().c_str());
+  }
+
+  LOGI("serving a feed of %zu bytes", feed.size());
+
+  // Before: read a byte at a time until the line ends with "\r\n".
+  Result byte_result = MeasureFeed(feed, [](au::TCPSocket* socket,
+      Result* result) {
+    std::string line;
+    while (socket->WaitReadable(/*timeout_ms=*/-1) >= 0) {
+      char byte;
+      ssize_t read_result = socket->Read(&byte, 1);
+      if (read_result < 0) {
+        break;
+      } else if (read_result == 0) {
+        continue;
+      }
+
+      result->read_count++;
+      line.push_back(byte);
+      if (line.size() >= 2 && line[line.size() - 2] == '\r'
+          && line[line.size() - 1] == '\n') {
+        line.resize(line.size() - 2);
+        result->line_count++;
+        result->byte_count += line.size();
+        line.clear();
+      }
+    }
+  });
+
+  // After: read in bulk and split the buffer into views.
+  Result bulk_result = MeasureFeed(feed, [](au::TCPSocket* socket,
+      Result* result) {
+    au::LineReader line_reader;
+    std::string_view line;
+    while (socket->WaitReadable(/*timeout_ms=*/-1) >= 0
+        && line_reader.Read(socket) >= 0) {
+      while (line_reader.GetLine(&line)) {
+        result->line_count++;
+        result->byte_count += line.size();
+      }
+    }
+
+    result->read_count = line_reader.GetStats().read_count;
+  });
+
+  if (byte_result.line_count != bulk_result.line_count
+      || byte_result.byte_count != bulk_result.byte_count) {
+    LOGFATAL("read %zu and %zu lines", byte_result.line_count,
+        bulk_result.line_count);
+  }
+
+  LogResult("byte reads", byte_result);
+  LogResult("line reader", bulk_result);
+  return 0;
+}
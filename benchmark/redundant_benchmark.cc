@@ -0,0 +1,377 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <tclap/CmdLine.h>
+
+#include "net/redundant_aprs_interface.h"
+#include "util/log.h"
+#include "util/string.h"
+
+#define LOG_TAG "RedundantBenchmark"
+
+// A description of the program.
+constexpr char kDescription[] =
+    "Receives through a RedundantAPRSInterface from several fake APRS-IS "
+    "servers on local ports. Each server sends its copy of every line after "
+    "an injected delay or drops it, and the counts of delivered, duplicate, "
+    "overflowed and first arriving frames are checked against the schedule.";
+
+// The version of the program.
+constexpr char kVersion[] = "0.0.1";
+
+// The time to wait for the connections to read the last lines after they
+// have been sent.
+constexpr uint32_t kSettleTimeoutMs = 5000;
+
+// Exposes the frame level methods of the redundant interface.
+class RedundantInterface : public au::RedundantAPRSInterface {
+ public:
+  using au::RedundantAPRSInterface::RedundantAPRSInterface;
+  using au::RedundantAPRSInterface::Receive;
+};
+
+// A line that a server sends at a time after the start.
+struct ScheduledLine {
+  uint64_t time_ms;
+  std::string line;
+};
+
+// The frames that the interface is expected to report for a schedule.
+struct Expectation {
+  // The number of copies sent by all servers.
+  size_t copy_count = 0;
+
+  // The number of frames delivered.
+  size_t frame_count = 0;
+
+  // The number of frames that each server sends first.
+  std::vector<uint64_t> first_arrival_counts;
+
+  // The payloads that remain queued after the queue overflows.
+  std::vector<std::string> queued_payloads;
+};
+
+// Returns an APRS-IS line with the supplied payload.
+std::string BuildLine(const std::string& payload) {
+  return "N0CALL-7>APZ222,WIDE1-1,qAR,T2TEST:" + payload;
+}
+
+// A fake APRS-IS server that accepts one connection on a local port from a
+// thread, performs the login and sends its schedule once started.
+class FakeAPRSISServer {
+ public:
+  // Starts listening. The schedule is sent relative to the start time.
+  FakeAPRSISServer(std::vector<ScheduledLine> schedule,
+      std::shared_future<std::chrono::steady_clock::time_point> start_time)
+      : schedule_(std::move(schedule)),
+        start_time_(start_time) {
+    std::stable_sort(schedule_.begin(), schedule_.end(),
+        [](const ScheduledLine& a, const ScheduledLine& b) {
+          return a.time_ms < b.time_ms;
+        });
+
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_size = sizeof(address);
+    if (listen_fd_ < 0
+        || bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&address),
+            sizeof(address)) < 0
+        || listen(listen_fd_, 1) < 0
+        || getsockname(listen_fd_,
+            reinterpret_cast<struct sockaddr*>(&address), &address_size) < 0) {
+      LOGFATAL("failed to listen: %s (%d)", strerror(errno), errno);
+    }
+
+    port_ = ntohs(address.sin_port);
+    thread_ = std::thread(&FakeAPRSISServer::Serve, this);
+  }
+
+  // Waits for the client to close the connection.
+  ~FakeAPRSISServer() {
+    thread_.join();
+    close(listen_fd_);
+  }
+
+  // Returns the port that the server listens on.
+  uint16_t GetPort() const { return port_; }
+
+ private:
+  std::vector<ScheduledLine> schedule_;
+  std::shared_future<std::chrono::steady_clock::time_point> start_time_;
+  int listen_fd_;
+  uint16_t port_;
+  std::thread thread_;
+
+  // Serves the login and the schedule to a single connection, then waits for
+  // it to be closed.
+  void Serve() {
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      LOGFATAL("failed to accept: %s (%d)", strerror(errno), errno);
+    }
+
+    WriteLine(fd, "# fake-aprsis 0.0.1");
+    std::string login;
+    char byte;
+    while (!au::StringStartsWith(login, "user ")
+        || login.back() != '\n') {
+      if (read(fd, &byte, 1) != 1) {
+        LOGFATAL("connection closed during login");
+      }
+
+      login.push_back(byte);
+    }
+
+    WriteLine(fd, "# logresp N0CALL unverified, server FAKE");
+    auto start_time = start_time_.get();
+    for (const auto& scheduled_line : schedule_) {
+      std::this_thread::sleep_until(
+          start_time + std::chrono::milliseconds(scheduled_line.time_ms));
+      WriteLine(fd, scheduled_line.line);
+    }
+
+    while (read(fd, &byte, 1) > 0) {}
+    close(fd);
+  }
+
+  // Writes a line terminated as APRS-IS does.
+  static void WriteLine(int fd, const std::string& line) {
+    std::string data = line + "\r\n";
+    if (send(fd, data.data(), data.size(), MSG_NOSIGNAL)
+        != static_cast<ssize_t>(data.size())) {
+      LOGFATAL("failed to write line: %s (%d)", strerror(errno), errno);
+    }
+  }
+};
+
+// Builds the schedule of each server and the counts that it should produce.
+//
+// Every copy of a line is sent at a different multiple of the lag after the
+// line starts, in a random order of servers, and each copy is dropped with the
+// drop probability. A line is then repeated within and after the duplicate
+// window, and finally more lines than can be queued are sent at once.
+void BuildSchedules(size_t server_count, size_t line_count, uint32_t lag_ms,
+    uint32_t duplicate_window_ms, float drop_probability, uint32_t seed,
+    std::vector<std::vector<ScheduledLine>>* schedules,
+    Expectation* expectation) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> drop_distribution(0.0f, 1.0f);
+  schedules->assign(server_count, {});
+  expectation->first_arrival_counts.assign(server_count, 0);
+
+  std::vector<size_t> ranks(server_count);
+  for (size_t i = 0; i < line_count; i++) {
+    for (size_t j = 0; j < server_count; j++) {
+      ranks[j] = j;
+    }
+
+    std::shuffle(ranks.begin(), ranks.end(), rng);
+    std::string line = BuildLine(au::StringFormat(">line %zu", i));
+    size_t first_server = server_count;
+    for (size_t j = 0; j < server_count; j++) {
+      if (drop_distribution(rng) < drop_probability) {
+        continue;
+      }
+
+      (*schedules)[j].push_back({(i + ranks[j]) * lag_ms, line});
+      expectation->copy_count++;
+      if (first_server == server_count || ranks[j] < ranks[first_server]) {
+        first_server = j;
+      }
+    }
+
+    if (first_server != server_count) {
+      expectation->frame_count++;
+      expectation->first_arrival_counts[first_server]++;
+    }
+  }
+
+  // The copy from the second server arrives within the window and is dropped,
+  // and the last copy arrives after it has expired and is delivered again.
+  uint64_t window_time_ms = (line_count + server_count + 1) * lag_ms;
+  std::string window_line = BuildLine(">window");
+  (*schedules)[0].push_back({window_time_ms, window_line});
+  (*schedules)[1 % server_count].push_back(
+      {window_time_ms + duplicate_window_ms / 2, window_line});
+  (*schedules)[0].push_back(
+      {window_time_ms + duplicate_window_ms * 3 / 2, window_line});
+  expectation->copy_count += 3;
+  expectation->frame_count += 2;
+  expectation->first_arrival_counts[0] += 2;
+
+  // Nothing is consumed until every line has been received, so these lines
+  // displace everything before them from the queue.
+  uint64_t overflow_time_ms = window_time_ms + duplicate_window_ms * 2;
+  for (size_t i = 0; i < au::RedundantAPRSInterface::kMaxQueuedFrames; i++) {
+    std::string payload = au::StringFormat(">overflow %zu", i);
+    (*schedules)[server_count - 1].push_back(
+        {overflow_time_ms, BuildLine(payload)});
+    expectation->queued_payloads.push_back(payload);
+  }
+
+  expectation->copy_count += au::RedundantAPRSInterface::kMaxQueuedFrames;
+  expectation->frame_count += au::RedundantAPRSInterface::kMaxQueuedFrames;
+  expectation->first_arrival_counts[server_count - 1] +=
+      au::RedundantAPRSInterface::kMaxQueuedFrames;
+}
+
+int main(int argc, char** argv) {
+  // Command line flags.
+  TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
+  TCLAP::ValueArg<size_t> server_count_arg("", "server_count",
+      "The number of servers to receive from.", false, 3, "count", cmd);
+  TCLAP::ValueArg<size_t> line_count_arg("", "line_count",
+      "The number of lines that the servers race to send.", false, 50,
+      "count", cmd);
+  TCLAP::ValueArg<uint32_t> lag_ms_arg("", "lag_ms",
+      "The delay between the copies of a line from successive servers.",
+      false, 100, "ms", cmd);
+  TCLAP::ValueArg<uint32_t> duplicate_window_ms_arg("", "duplicate_window_ms",
+      "The time to drop copies of a frame for.", false, 1000, "ms", cmd);
+  TCLAP::ValueArg<float> drop_probability_arg("", "drop_probability",
+      "The probability that a server drops its copy of a line.", false, 0.2f,
+      "probability", cmd);
+  TCLAP::ValueArg<uint32_t> seed_arg("", "seed",
+      "The seed of the schedule.", false, 1, "seed", cmd);
+  cmd.parse(argc, argv);
+
+  size_t server_count = server_count_arg.getValue();
+  uint32_t duplicate_window_ms = duplicate_window_ms_arg.getValue();
+  if (server_count == 0) {
+    LOGFATAL("at least one server is required");
+  } else if (lag_ms_arg.getValue() * server_count >= duplicate_window_ms) {
+    LOGFATAL("the copies of a line must arrive within the duplicate window");
+  }
+
+  std::vector<std::vector<ScheduledLine>> schedules;
+  Expectation expectation;
+  BuildSchedules(server_count, line_count_arg.getValue(),
+      lag_ms_arg.getValue(), duplicate_window_ms,
+      drop_probability_arg.getValue(), seed_arg.getValue(), &schedules,
+      &expectation);
+
+  std::promise<std::chrono::steady_clock::time_point> start_promise;
+  std::shared_future<std::chrono::steady_clock::time_point> start_time =
+      start_promise.get_future().share();
+  std::vector<std::unique_ptr<FakeAPRSISServer>> servers;
+  for (auto& schedule : schedules) {
+    servers.push_back(std::make_unique<FakeAPRSISServer>(
+        std::move(schedule), start_time));
+  }
+
+  au::APRSInterface::Config config = {};
+  config.max_packet_size = au::APRSInterface::kDefaultMaxPacketSize;
+  au::CallsignConfig callsign;
+  callsign.FromString("N0CALL");
+  std::vector<std::unique_ptr<au::InternetAPRSInterface>> interfaces;
+  for (const auto& server : servers) {
+    interfaces.push_back(std::make_unique<au::InternetAPRSInterface>(config,
+        callsign, "127.0.0.1", server->GetPort(), /*filter=*/""));
+  }
+
+  {
+    RedundantInterface interface(config, std::move(interfaces),
+        duplicate_window_ms);
+    start_promise.set_value(std::chrono::steady_clock::now());
+
+    // Wait for every copy to be read before consuming any frames.
+    auto stats = interface.GetStats();
+    auto settle_time = std::chrono::steady_clock::now();
+    while (stats.frame_count + stats.duplicate_count < expectation.copy_count) {
+      if (stats.frame_count + stats.duplicate_count > 0
+          && std::chrono::steady_clock::now() - settle_time
+              > std::chrono::milliseconds(kSettleTimeoutMs)) {
+        LOGFATAL("received %" PRIu64 " of %zu copies",
+            stats.frame_count + stats.duplicate_count,
+            expectation.copy_count);
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      auto next_stats = interface.GetStats();
+      if (next_stats.frame_count != stats.frame_count
+          || next_stats.duplicate_count != stats.duplicate_count) {
+        settle_time = std::chrono::steady_clock::now();
+      }
+
+      stats = next_stats;
+    }
+
+    size_t expected_dropped_count = expectation.frame_count
+        - au::RedundantAPRSInterface::kMaxQueuedFrames;
+    LOGI("delivered %" PRIu64 " of %zu, %" PRIu64 " duplicates of %zu, "
+        "%" PRIu64 " overflowed of %zu", stats.frame_count,
+        expectation.frame_count, stats.duplicate_count,
+        expectation.copy_count - expectation.frame_count, stats.dropped_count,
+        expected_dropped_count);
+    if (stats.frame_count != expectation.frame_count
+        || stats.duplicate_count
+            != expectation.copy_count - expectation.frame_count
+        || stats.dropped_count != expected_dropped_count) {
+      LOGFATAL("frame counts do not match the schedule");
+    }
+
+    auto first_arrival_counts = interface.GetFirstArrivalCounts();
+    for (size_t i = 0; i < server_count; i++) {
+      LOGI("server %zu sent %" PRIu64 " frames first, expected %" PRIu64, i,
+          first_arrival_counts[i], expectation.first_arrival_counts[i]);
+    }
+
+    if (first_arrival_counts != expectation.first_arrival_counts) {
+      LOGFATAL("first arrivals do not match the schedule");
+    }
+
+    // Only the lines that overflowed the queue remain, in the order sent.
+    au::CallsignConfig source;
+    au::CallsignConfig destination;
+    std::vector<au::CallsignConfig> digipeaters;
+    std::string payload;
+    for (const auto& expected_payload : expectation.queued_payloads) {
+      if (!interface.Receive(&source, &destination, &digipeaters, &payload,
+            /*timeout_ms=*/100)) {
+        LOGFATAL("queue ended before '%s'", expected_payload.c_str());
+      } else if (payload != expected_payload) {
+        LOGFATAL("received '%s', expected '%s'", payload.c_str(),
+            expected_payload.c_str());
+      }
+    }
+
+    if (interface.Receive(&source, &destination, &digipeaters, &payload,
+          /*timeout_ms=*/100)) {
+      LOGFATAL("unexpected frame '%s' after the queue", payload.c_str());
+    }
+  }
+
+  LOGI("all counts match the schedule");
+  return 0;
+}
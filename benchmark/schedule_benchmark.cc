@@ -0,0 +1,148 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <random>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+
+#include "net/aprs_interface.h"
+#include "net/broadcast_schedule.h"
+#include "util/log.h"
+
+#define LOG_TAG "ScheduleBenchmark"
+
+// A description of the program.
+constexpr char kDescription[] =
+    "Compares the chance of completing a broadcast file transfer over a "
+    "channel with bursts of loss when chunks are sent in sequence and when "
+    "they are interleaved.";
+
+// The version of the program.
+constexpr char kVersion[] = "0.0.1";
+
+// A channel with bursts of loss, modelled as a Gilbert-Elliott channel. Frames
+// are lost at a low rate in the good state and always lost in the bad state.
+class BurstChannel {
+ public:
+  // Setup the channel with the chance of a burst starting on each frame, the
+  // mean length of a burst in frames, and the loss rate between bursts.
+  BurstChannel(float burst_rate, float mean_burst_frames, float loss_rate,
+      std::mt19937* rng)
+      : burst_start_(burst_rate),
+        burst_end_(1.0f / mean_burst_frames),
+        lost_(loss_rate),
+        rng_(rng),
+        in_burst_(false) {}
+
+  // Returns true if the next frame is lost.
+  bool IsLost() {
+    in_burst_ = in_burst_ ? !burst_end_(*rng_) : burst_start_(*rng_);
+    return in_burst_ || lost_(*rng_);
+  }
+
+ private:
+  std::bernoulli_distribution burst_start_;
+  std::bernoulli_distribution burst_end_;
+  std::bernoulli_distribution lost_;
+  std::mt19937* rng_;
+  bool in_burst_;
+};
+
+// Returns true if every chunk of every packet is received at least once when
+// the schedule is sent over the channel.
+bool SimulateTransfer(const std::vector<size_t>& chunk_counts,
+    const std::vector<au::BroadcastSchedule::Transmission>& schedule,
+    BurstChannel* channel) {
+  std::vector<std::vector<bool>> received(chunk_counts.size());
+  size_t remaining_count = 0;
+  for (size_t i = 0; i < chunk_counts.size(); i++) {
+    received[i].resize(chunk_counts[i], false);
+    remaining_count += chunk_counts[i];
+  }
+
+  for (const auto& transmission : schedule) {
+    if (!channel->IsLost() && !received[transmission.packet_index]
+          [transmission.chunk_index]) {
+      received[transmission.packet_index][transmission.chunk_index] = true;
+      remaining_count--;
+    }
+  }
+
+  return remaining_count == 0;
+}
+
+int main(int argc, char** argv) {
+  // Command line flags.
+  TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
+  TCLAP::ValueArg<size_t> packet_count_arg("", "packet_count",
+      "The number of packets in the file, including the header.",
+      false, 10, "count", cmd);
+  TCLAP::ValueArg<size_t> chunk_count_arg("", "chunk_count",
+      "The number of chunks that each packet is split into.",
+      false, 3, "count", cmd);
+  TCLAP::ValueArg<size_t> retransmit_count_arg("", "aprs_retransmit_count",
+      "The number of times to retransmit a packet.",
+      false, au::APRSInterface::kDefaultRetransmitCount, "count", cmd);
+  TCLAP::ValueArg<float> burst_rate_arg("", "burst_rate",
+      "The chance of a burst of loss starting on each frame.",
+      false, 0.05f, "fraction", cmd);
+  TCLAP::ValueArg<float> loss_rate_arg("", "loss_rate",
+      "The fraction of frames lost between bursts.",
+      false, 0.05f, "fraction", cmd);
+  TCLAP::ValueArg<size_t> max_burst_frames_arg("", "max_burst_frames",
+      "The longest mean burst length to simulate, in frames.",
+      false, 8, "frames", cmd);
+  TCLAP::ValueArg<size_t> trial_count_arg("", "trial_count",
+      "The number of transfers to simulate for each burst length.",
+      false, 10000, "count", cmd);
+  TCLAP::ValueArg<uint32_t> seed_arg("", "seed",
+      "The seed of the simulated channel.", false, 1, "seed", cmd);
+  cmd.parse(argc, argv);
+
+  std::vector<size_t> chunk_counts(packet_count_arg.getValue(),
+      chunk_count_arg.getValue());
+  auto sequential = au::BroadcastSchedule::Sequential(chunk_counts,
+      retransmit_count_arg.getValue());
+  auto interleaved = au::BroadcastSchedule::Interleave(chunk_counts,
+      retransmit_count_arg.getValue());
+
+  std::mt19937 rng(seed_arg.getValue());
+  LOGI("packets=%zu chunks=%zu frames=%zu", chunk_counts.size(),
+      chunk_count_arg.getValue(), interleaved.size());
+  for (size_t burst_frames = 1; burst_frames <= max_burst_frames_arg.getValue();
+      burst_frames++) {
+    size_t sequential_count = 0;
+    size_t interleaved_count = 0;
+    for (size_t i = 0; i < trial_count_arg.getValue(); i++) {
+      BurstChannel sequential_channel(burst_rate_arg.getValue(), burst_frames,
+          loss_rate_arg.getValue(), &rng);
+      sequential_count += SimulateTransfer(chunk_counts, sequential,
+          &sequential_channel);
+      BurstChannel interleaved_channel(burst_rate_arg.getValue(),
+          burst_frames, loss_rate_arg.getValue(), &rng);
+      interleaved_count += SimulateTransfer(chunk_counts, interleaved,
+          &interleaved_channel);
+    }
+
+    LOGI("burst_frames=%zu sequential_complete=%6.2f%% "
+        "interleaved_complete=%6.2f%%", burst_frames,
+        100.0f * sequential_count / trial_count_arg.getValue(),
+        100.0f * interleaved_count / trial_count_arg.getValue());
+  }
+
+  return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+
+#include "net/tnc2_header_view.h"
+#include "util/file.h"
+#include "util/log.h"
+#include "util/string.h"
+
+#define LOG_TAG "TNC2HeaderBenchmark"
+
+// A description of the program.
+constexpr char kDescription[] =
+    "Parses a corpus of APRS-IS lines and random mutations of them with "
+    "TNC2HeaderView, checking that every view stays within its line, and "
+    "measures the lines per second parsed.";
+
+// The version of the program.
+constexpr char kVersion[] = "0.0.1";
+
+// The bytes that mutations favour, as they delimit the parts of a header.
+constexpr char kDelimiters[] = ">,:*-q";
+
+// Returns true if the view lies within the line.
+bool IsWithin(std::string_view view, std::string_view line) {
+  return view.empty() || (view.data() >= line.data()
+      && view.data() + view.size() <= line.data() + line.size());
+}
+
+// Parses a line and checks the views of the header. Returns true if the line
+// was parsed.
+bool ParseAndCheck(std::string_view line) {
+  au::TNC2HeaderView header;
+  if (!header.Parse(line)) {
+    return false;
+  }
+
+  bool valid = !header.GetSource().GetAddress().empty()
+      && !header.GetDestination().GetAddress().empty()
+      && IsWithin(header.GetSource().GetAddress(), line)
+      && IsWithin(header.GetDestination().GetAddress(), line)
+      && IsWithin(header.GetQConstruct(), line)
+      && IsWithin(header.GetIGate(), line)
+      && IsWithin(header.GetPayload(), line)
+      && header.GetPayload().data() + header.GetPayload().size()
+          == line.data() + line.size()
+      && header.GetDigipeaterCount() <= au::TNC2HeaderView::kMaxPathSize;
+  for (size_t i = 0; valid && i < header.GetDigipeaterCount(); i++) {
+    const auto& digipeater = header.GetDigipeater(i);
+    valid = !digipeater.GetAddress().empty()
+        && IsWithin(digipeater.GetAddress(), line)
+        && !digipeater.IsQConstruct();
+  }
+
+  if (!valid) {
+    LOGFATAL("invalid view of '%s'",
+        au::StringFormatNonPrintables(std::string(line)).c_str());
+  }
+
+  // The frame is converted whenever the source and destination can be
+  // represented, leaving out digipeaters that can not.
+  au::CallsignConfig source;
+  au::CallsignConfig destination;
+  std::vector<au::CallsignConfig> digipeaters;
+  std::string payload;
+  bool converted = header.ToAPRSFrame(&source, &destination, &digipeaters,
+      &payload);
+  if (converted != (header.GetSource().ToCallsignConfig(&source)
+          && header.GetDestination().ToCallsignConfig(&destination))
+      || (converted && (payload != header.GetPayload()
+          || digipeaters.size() > header.GetDigipeaterCount()))) {
+    LOGFATAL("frame does not match the view of '%s'",
+        au::StringFormatNonPrintables(std::string(line)).c_str());
+  }
+
+  return true;
+}
+
+// Applies a random edit to the line, such as replacing, inserting or removing
+// a byte or splicing in the end of another line from the corpus.
+void Mutate(const std::vector<std::string>& corpus, std::mt19937* rng,
+    std::string* line) {
+  size_t offset = line->empty() ? 0 : (*rng)() % line->size();
+  char byte = (*rng)() % 2 == 0
+      ? kDelimiters[(*rng)() % (sizeof(kDelimiters) - 1)]
+      : static_cast<char>((*rng)());
+  switch ((*rng)() % 4) {
+    case 0:
+      if (!line->empty()) {
+        (*line)[offset] = byte;
+      }
+      break;
+    case 1:
+      line->insert(line->begin() + offset, byte);
+      break;
+    case 2:
+      if (!line->empty()) {
+        line->erase(offset, 1);
+      }
+      break;
+    default:
+      const auto& other = corpus[(*rng)() % corpus.size()];
+      line->resize(offset);
+      line->append(other, other.empty() ? 0 : (*rng)() % other.size());
+      break;
+  }
+}
+
+// Logs the throughput of parsing the supplied lines.
+template<typename Function>
+void MeasureLines(const char* name, const std::vector<std::string>& lines,
+    size_t iteration_count, Function function) {
+  auto start_time = std::chrono::steady_clock::now();
+  size_t parsed_count = 0;
+  for (size_t i = 0; i < iteration_count; i++) {
+    for (const auto& line : lines) {
+      parsed_count += function(line);
+    }
+  }
+
+  double time_s = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time).count();
+  size_t line_count = lines.size() * iteration_count;
+  LOGI("%-20s %10.0f lines/s %8.1f ns/line, %zu parsed", name,
+      line_count / time_s, time_s / line_count * 1e9, parsed_count);
+}
+
+int main(int argc, char** argv) {
+  // Command line flags.
+  TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
+  TCLAP::ValueArg<std::string> corpus_arg("", "corpus",
+      "The corpus of lines to parse, one per line.", false,
+      "benchmark/corpus/tnc2_header_view.txt", "path", cmd);
+  TCLAP::ValueArg<size_t> mutation_count_arg("", "mutation_count",
+      "The number of random mutations of the corpus to parse.", false, 100000,
+      "count", cmd);
+  TCLAP::ValueArg<size_t> iteration_count_arg("", "iteration_count",
+      "The number of times to parse the corpus when measuring throughput.",
+      false, 100000, "count", cmd);
+  TCLAP::ValueArg<uint32_t> seed_arg("", "seed",
+      "The seed of the random mutations.", false, 1, "seed", cmd);
+  cmd.parse(argc, argv);
+
+  std::string corpus_contents;
+  if (!au::ReadFileToString(corpus_arg.getValue(), &corpus_contents)) {
+    LOGFATAL("failed to read corpus '%s'", corpus_arg.getValue().c_str());
+  }
+
+  std::vector<std::string> corpus;
+  for (const auto& line : au::StringSplit(corpus_contents, "\n")) {
+    if (!line.empty()) {
+      corpus.push_back(line);
+    }
+  }
+
+  if (corpus.empty()) {
+    LOGFATAL("corpus is empty");
+  }
+
+  // Parse the corpus and mutations of it. Each mutation builds on a random
+  // entry of the corpus with up to four edits.
+  size_t parsed_count = 0;
+  for (const auto& line : corpus) {
+    parsed_count += ParseAndCheck(line);
+  }
+
+  LOGI("parsed %zu of %zu corpus lines", parsed_count, corpus.size());
+  std::mt19937 rng(seed_arg.getValue());
+  size_t mutation_count = mutation_count_arg.getValue();
+  parsed_count = 0;
+  for (size_t i = 0; i < mutation_count; i++) {
+    std::string line = corpus[rng() % corpus.size()];
+    for (size_t edit_count = 1 + rng() % 4; edit_count > 0; edit_count--) {
+      Mutate(corpus, &rng, &line);
+    }
+
+    parsed_count += ParseAndCheck(line);
+  }
+
+  LOGI("parsed %zu of %zu mutated lines", parsed_count, mutation_count);
+
+  // Measure the throughput of the lines of the corpus that parse, which are
+  // the lines that a receiver spends its time on.
+  std::vector<std::string> lines;
+  for (const auto& line : corpus) {
+    au::TNC2HeaderView header;
+    if (header.Parse(line)) {
+      lines.push_back(line);
+    }
+  }
+
+  size_t iteration_count = iteration_count_arg.getValue();
+  MeasureLines("parse", lines, iteration_count, [](const std::string& line) {
+    au::TNC2HeaderView header;
+    return header.Parse(line);
+  });
+
+  au::CallsignConfig source;
+  au::CallsignConfig destination;
+  std::vector<au::CallsignConfig> digipeaters;
+  std::string payload;
+  MeasureLines("parse and convert", lines, iteration_count,
+      [&](const std::string& line) {
+        au::TNC2HeaderView header;
+        return header.Parse(line) && header.ToAPRSFrame(&source,
+            &destination, &digipeaters, &payload);
+      });
+  return 0;
+}
@@ -0,0 +1,447 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/agw_aprs_interface.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+
+#include "util/log.h"
+#include "util/time.h"
+
+#define LOG_TAG "AGWAPRSInterface"
+
+namespace au {
+namespace {
+
+// Offsets of the fields of an AGWPE frame header. Integers are little-endian.
+constexpr size_t kHeaderPortOffset = 0;
+constexpr size_t kHeaderKindOffset = 4;
+constexpr size_t kHeaderDataSizeOffset = 28;
+
+// The kinds of AGWPE frames that are used.
+constexpr char kKindRawFrame = 'K';
+constexpr char kKindToggleRawMonitor = 'k';
+constexpr char kKindOutstandingFrames = 'y';
+
+// The KISS command byte that precedes each raw AX.25 frame.
+constexpr uint8_t kRawFrameCommand = 0x00;
+
+// Reads a little-endian 32-bit integer.
+uint32_t ReadUint32(const uint8_t* data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16)
+      | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+}  // anonymous namespace
+
+AGWAPRSInterface::AGWAPRSInterface(const APRSInterface::Config& config,
+    const std::string& hostname, uint16_t port, uint8_t radio_port)
+    : APRSInterface(config),
+      hostname_(hostname),
+      port_(port),
+      radio_port_(radio_port),
+      rx_queue_(kMaxQueuedFrames),
+      has_outstanding_frame_count_(false),
+      outstanding_frame_count_(0),
+      tx_pending_(false),
+      next_connect_time_us_(0),
+      stopped_(false) {
+  if (!Connect()) {
+    LOGFATAL("failed to connect to AGWPE server");
+  }
+}
+
+AGWAPRSInterface::~AGWAPRSInterface() {
+  const auto& stats = backoff_.GetStats();
+  LOGI("reconnected %" PRIu64 " times after %" PRIu64 " failed attempts, "
+      "%" PRIu64 "ms offline", stats.reconnect_count,
+      stats.failed_attempt_count, stats.downtime_us / 1000);
+}
+
+void AGWAPRSInterface::Stop() {
+  std::lock_guard<std::mutex> lock(stop_mutex_);
+  stopped_ = true;
+  stop_cv_.notify_all();
+}
+
+bool AGWAPRSInterface::GetOutstandingFrameCount(uint32_t* count,
+    uint32_t timeout_ms) {
+  has_outstanding_frame_count_ = false;
+  if (!WriteRequest(kKindOutstandingFrames)) {
+    LOGE("failed to query outstanding frames");
+    Reconnect();
+    return false;
+  }
+
+  // The query is lost with the connection, so stop waiting if it is restored.
+  uint64_t reconnect_count = backoff_.GetStats().reconnect_count;
+  if (!ReadUntil([this, reconnect_count]() {
+        return has_outstanding_frame_count_
+            || backoff_.GetStats().reconnect_count != reconnect_count;
+      }, timeout_ms)) {
+    LOGE("timeout waiting for outstanding frames");
+    return false;
+  } else if (!has_outstanding_frame_count_) {
+    LOGE("lost connection waiting for outstanding frames");
+    return false;
+  }
+
+  *count = outstanding_frame_count_;
+  return true;
+}
+
+bool AGWAPRSInterface::Send(const std::string& payload,
+    const CallsignConfig& source,
+    const CallsignConfig& destination,
+    const std::vector<CallsignConfig>& digipeaters) {
+  if (digipeaters.size() > AX25FrameView::kMaxDigipeaterCount) {
+    LOGFATAL("too many digipeaters specified");
+  }
+
+  BeginFrame(kKindRawFrame);
+  tx_buffer_.push_back(kRawFrameCommand);
+  AppendAX25Callsign(destination, /*last=*/false);
+  AppendAX25Callsign(source, /*last=*/digipeaters.empty());
+  for (size_t i = 0; i < digipeaters.size(); i++) {
+    AppendAX25Callsign(digipeaters[i],
+        /*last=*/(i == (digipeaters.size() - 1)));
+  }
+
+  tx_buffer_.push_back(AX25FrameView::kControlUIFrame);
+  tx_buffer_.push_back(AX25FrameView::kProtocolIdNone);
+  tx_buffer_.insert(tx_buffer_.end(), payload.begin(), payload.end());
+  while (!WriteFrame()) {
+    LOGE("failed to send frame");
+    if (!Reconnect()) {
+      return false;
+    }
+  }
+
+  tx_pending_ = true;
+  return true;
+}
+
+bool AGWAPRSInterface::Receive(CallsignConfig* source,
+    CallsignConfig* destination, std::vector<CallsignConfig>* digipeaters,
+    std::string* payload, uint32_t timeout_ms) {
+  if (!ReadUntil([this]() { return !rx_queue_.IsEmpty(); }, timeout_ms)) {
+    LOGE("timeout reading packet");
+    return false;
+  }
+
+  rx_frame_.data.swap(rx_queue_.GetFront().data);
+  rx_queue_.PopFront();
+
+  AX25FrameView frame;
+  if (!frame.Parse(rx_frame_.data.data(), rx_frame_.data.size())) {
+    return false;
+  }
+
+  return frame.ToAPRSFrame(source, destination, digipeaters, payload);
+}
+
+int AGWAPRSInterface::GetFileDescriptor() const {
+  return socket_.GetFileDescriptor();
+}
+
+bool AGWAPRSInterface::ReceiveAvailable(const FrameCallback& callback) {
+  // A lost connection is restored by one attempt at a time so that the event
+  // loop is not blocked while waiting between attempts. The event loop
+  // services the interface until it has reconnected and then follows the new
+  // file descriptor.
+  if (backoff_.IsDisconnected()) {
+    ServiceReconnect();
+  } else if (!ReadAvailable()) {
+    LOGE("failed to read from AGWPE socket");
+    Disconnect();
+  }
+
+  while (!rx_queue_.IsEmpty()) {
+    rx_frame_.data.swap(rx_queue_.GetFront().data);
+    rx_queue_.PopFront();
+    DispatchFrame(callback);
+  }
+
+  return !backoff_.IsDisconnected() || !IsStopped();
+}
+
+int AGWAPRSInterface::GetServiceTimeoutMs() const {
+  // Frames that were read while polling the transmit queue do not make the
+  // socket readable.
+  if (!rx_queue_.IsEmpty()) {
+    return 0;
+  } else if (backoff_.IsDisconnected()) {
+    return GetReconnectTimeRemainingMs();
+  }
+
+  return -1;
+}
+
+bool AGWAPRSInterface::WaitForTransmitComplete() {
+  if (!tx_pending_.exchange(false)) {
+    return false;
+  }
+
+  // Poll the transmit queue of the TNC until it drains.
+  std::lock_guard<std::mutex> lock(tx_wait_mutex_);
+  uint64_t time_end_us = GetTimeNowUs() + kTxQueueTimeoutMs * 1000;
+  while (GetTimeNowUs() < time_end_us) {
+    uint32_t count;
+    if (!GetOutstandingFrameCount(&count, kTxQueueTimeoutMs)) {
+      return false;
+    } else if (count == 0) {
+      return true;
+    }
+
+    SleepFor(kTxQueuePollIntervalMs * 1000);
+  }
+
+  LOGE("timeout waiting for TNC to transmit frame");
+  return false;
+}
+
+bool AGWAPRSInterface::Connect() {
+  if (!socket_.Connect(hostname_, port_)) {
+    return false;
+  } else if (!WriteRequest(kKindToggleRawMonitor)) {
+    LOGE("failed to enable raw monitoring");
+    socket_.Close();
+    return false;
+  }
+
+  return true;
+}
+
+bool AGWAPRSInterface::Reconnect() {
+  Disconnect();
+  while (!ServiceReconnect()) {
+    if (!WaitForNextAttempt(/*timeout_ms=*/-1)) {
+      LOGI("stopped reconnecting to AGWPE server");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void AGWAPRSInterface::Disconnect() {
+  if (backoff_.IsDisconnected()) {
+    return;
+  }
+
+  LOGE("lost connection to AGWPE server, reconnecting");
+  socket_.Close();
+  rx_buffer_.clear();
+  backoff_.OnDisconnected();
+  next_connect_time_us_ = GetTimeNowUs()
+      + static_cast<uint64_t>(backoff_.GetNextDelayMs()) * 1000;
+}
+
+bool AGWAPRSInterface::ServiceReconnect() {
+  if (!backoff_.IsDisconnected()) {
+    return true;
+  } else if (IsStopped() || GetReconnectTimeRemainingMs() > 0) {
+    return false;
+  } else if (!Connect()) {
+    next_connect_time_us_ = GetTimeNowUs()
+        + static_cast<uint64_t>(backoff_.GetNextDelayMs()) * 1000;
+    return false;
+  }
+
+  uint64_t downtime_us = backoff_.OnConnected();
+  LOGI("reconnected to AGWPE server after %" PRIu64 "ms", downtime_us / 1000);
+  return true;
+}
+
+bool AGWAPRSInterface::WaitForNextAttempt(int timeout_ms) {
+  int delay_ms = GetReconnectTimeRemainingMs();
+  if (timeout_ms >= 0) {
+    delay_ms = std::min(delay_ms, timeout_ms);
+  }
+
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  return !stop_cv_.wait_for(lock, std::chrono::milliseconds(delay_ms),
+      [this]() { return stopped_; });
+}
+
+bool AGWAPRSInterface::IsStopped() {
+  std::lock_guard<std::mutex> lock(stop_mutex_);
+  return stopped_;
+}
+
+int AGWAPRSInterface::GetReconnectTimeRemainingMs() const {
+  uint64_t time_now_us = GetTimeNowUs();
+  if (time_now_us >= next_connect_time_us_) {
+    return 0;
+  }
+
+  return (next_connect_time_us_ - time_now_us + 999) / 1000;
+}
+
+bool AGWAPRSInterface::WriteRequest(char kind) {
+  uint8_t header[kHeaderSize] = {};
+  header[kHeaderPortOffset] = radio_port_;
+  header[kHeaderKindOffset] = kind;
+  return socket_.Write(header, sizeof(header));
+}
+
+void AGWAPRSInterface::BeginFrame(char kind) {
+  tx_buffer_.assign(kHeaderSize, 0);
+  tx_buffer_[kHeaderPortOffset] = radio_port_;
+  tx_buffer_[kHeaderKindOffset] = kind;
+}
+
+bool AGWAPRSInterface::WriteFrame() {
+  uint32_t data_size = tx_buffer_.size() - kHeaderSize;
+  for (size_t i = 0; i < 4; i++) {
+    tx_buffer_[kHeaderDataSizeOffset + i] = (data_size >> (i * 8)) & 0xff;
+  }
+
+  return socket_.Write(tx_buffer_.data(), tx_buffer_.size());
+}
+
+void AGWAPRSInterface::AppendAX25Callsign(const CallsignConfig& config,
+    bool last) {
+  if (config.ssid < 0 || config.ssid > 15) {
+    LOGFATAL("invalid SSID: %d", config.ssid);
+  }
+
+  if (config.callsign.length() > AX25AddressView::kMaxCallsignLength) {
+    LOGFATAL("invalid callsign '%s'", config.callsign.c_str());
+  }
+
+  for (size_t i = 0; i < AX25AddressView::kMaxCallsignLength; i++) {
+    char c = (i < config.callsign.length()) ? config.callsign[i] : ' ';
+    tx_buffer_.push_back(static_cast<uint8_t>(c) << 1);
+  }
+
+  tx_buffer_.push_back(0x60 | (config.ssid << 1) | (last ? 0x01 : 0x00));
+}
+
+bool AGWAPRSInterface::ReadUntil(const std::function<bool()>& done,
+    uint32_t timeout_ms) {
+  uint64_t time_start_us = GetTimeNowUs();
+  while (!done()) {
+    // Wait for the socket to become readable for the remainder of the timeout
+    // or indefinitely if there is no timeout.
+    int wait_ms = -1;
+    if (timeout_ms != 0) {
+      uint64_t elapsed_ms = (GetTimeNowUs() - time_start_us) / 1000;
+      if (elapsed_ms >= timeout_ms) {
+        return false;
+      }
+
+      wait_ms = timeout_ms - elapsed_ms;
+    }
+
+    // Restore a lost connection, waiting between attempts for the remainder
+    // of the timeout.
+    if (backoff_.IsDisconnected()) {
+      if (!ServiceReconnect() && !WaitForNextAttempt(wait_ms)) {
+        return false;
+      }
+
+      continue;
+    }
+
+    // A failure to wait is handled by the read, which disconnects.
+    if (socket_.WaitReadable(wait_ms) != 0 && !ReadAvailable()) {
+      LOGE("failed to read from AGWPE socket");
+      Disconnect();
+    }
+  }
+
+  return true;
+}
+
+bool AGWAPRSInterface::ReadAvailable() {
+  uint8_t read_buffer[kReadBufferSize];
+  ssize_t read_result = socket_.Read(read_buffer, sizeof(read_buffer));
+  if (read_result < 0) {
+    return false;
+  }
+
+  rx_buffer_.insert(rx_buffer_.end(), read_buffer, read_buffer + read_result);
+
+  // Handle each complete frame in the buffer.
+  size_t offset = 0;
+  while (rx_buffer_.size() - offset >= kHeaderSize) {
+    const uint8_t* header = &rx_buffer_[offset];
+    uint32_t data_size = ReadUint32(&header[kHeaderDataSizeOffset]);
+    if (data_size > kMaxDataSize) {
+      LOGE("AGWPE frame too large: %" PRIu32, data_size);
+      return false;
+    } else if (rx_buffer_.size() - offset < kHeaderSize + data_size) {
+      break;
+    }
+
+    HandleFrame(header, header + kHeaderSize, data_size);
+    offset += kHeaderSize + data_size;
+  }
+
+  rx_buffer_.erase(rx_buffer_.begin(), rx_buffer_.begin() + offset);
+  return true;
+}
+
+void AGWAPRSInterface::HandleFrame(const uint8_t* header, const uint8_t* data,
+    size_t data_size) {
+  char kind = header[kHeaderKindOffset];
+  if (header[kHeaderPortOffset] != radio_port_) {
+    LOGV("discarding AGWPE frame for radio port %" PRIu8,
+        header[kHeaderPortOffset]);
+  } else if (kind == kKindRawFrame) {
+    if (data_size < 1) {
+      LOGE("received empty raw frame");
+      return;
+    }
+
+    // Drop the KISS command byte.
+    KISSFrame* frame = rx_queue_.GetBack();
+    frame->port = radio_port_;
+    frame->command = data[0];
+    frame->data.assign(data + 1, data + data_size);
+    rx_queue_.PushBack();
+  } else if (kind == kKindOutstandingFrames) {
+    if (data_size < 4) {
+      LOGE("received malformed outstanding frames reply");
+      return;
+    }
+
+    outstanding_frame_count_ = ReadUint32(data);
+    has_outstanding_frame_count_ = true;
+  } else {
+    LOGV("ignoring AGWPE frame of kind '%c'", kind);
+  }
+}
+
+void AGWAPRSInterface::DispatchFrame(const FrameCallback& callback) {
+  AX25FrameView frame;
+  if (!frame.Parse(rx_frame_.data.data(), rx_frame_.data.size())) {
+    return;
+  }
+
+  CallsignConfig source;
+  CallsignConfig destination;
+  std::vector<CallsignConfig> digipeaters;
+  std::string payload;
+  if (frame.ToAPRSFrame(&source, &destination, &digipeaters, &payload)) {
+    callback(source, destination, digipeaters, payload);
+  }
+}
+
+}  // namespace au
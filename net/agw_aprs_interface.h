@@ -0,0 +1,224 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_AGW_APRS_INTERFACE_H_
+#define APRS_UTILS_NET_AGW_APRS_INTERFACE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "net/aprs_interface.h"
+#include "net/ax25_frame_view.h"
+#include "net/kiss_frame_queue.h"
+#include "net/reconnect_backoff.h"
+#include "net/tcp_socket.h"
+#include "util/non_copyable.h"
+
+namespace au {
+
+// A port of a software TNC that is accessed with the AGWPE TCP protocol, such
+// as Dire Wolf. Frames are exchanged in raw AX.25 form, and the number of
+// frames waiting in the transmit queue of the TNC is used to pace
+// transmissions. The connection is restored with exponential backoff if it is
+// lost. ReceiveAvailable makes one attempt to restore it once the delay has
+// elapsed and returns, so that an event loop services it as given by
+// GetServiceTimeoutMs, while the other methods wait between attempts.
+class AGWAPRSInterface : public APRSInterface,
+                         public NonCopyable {
+ public:
+  // The default TCP port of an AGWPE server.
+  static constexpr uint16_t kDefaultPort = 8000;
+
+  // The size of the header of each AGWPE frame.
+  static constexpr size_t kHeaderSize = 36;
+
+  // The maximum size of the data of an AGWPE frame that is accepted.
+  static constexpr size_t kMaxDataSize = 2048;
+
+  // The maximum number of received frames queued.
+  static constexpr size_t kMaxQueuedFrames = 256;
+
+  // The interval between queries of the transmit queue of the TNC while
+  // waiting for a frame to be transmitted.
+  static constexpr uint32_t kTxQueuePollIntervalMs = 100;
+
+  // The time to wait for the transmit queue of the TNC to drain.
+  static constexpr uint32_t kTxQueueTimeoutMs = 60000;
+
+  // Setup the connection to the AGWPE server and enable raw monitoring of the
+  // supplied radio port.
+  AGWAPRSInterface(const APRSInterface::Config& config,
+      const std::string& hostname, uint16_t port, uint8_t radio_port);
+
+  // Close the connection.
+  ~AGWAPRSInterface() override;
+
+  // Returns statistics about the times the connection has been lost.
+  const ReconnectBackoff::Stats& GetReconnectStats() const {
+    return backoff_.GetStats();
+  }
+
+  // Stops any attempt to restore the connection, which causes sending and
+  // receiving to fail once the connection is lost. This may be called from
+  // any thread.
+  void Stop();
+
+  // Queries the number of frames waiting to be transmitted by the TNC on the
+  // radio port of this interface. Returns false if there is no reply within
+  // the timeout or the connection is lost before the reply.
+  bool GetOutstandingFrameCount(uint32_t* count, uint32_t timeout_ms);
+
+ protected:
+  // APRSInterface implementation.
+  bool Send(const std::string& payload,
+      const CallsignConfig& source,
+      const CallsignConfig& destination,
+      const std::vector<CallsignConfig>& digipeaters) final;
+  bool Receive(CallsignConfig* source, CallsignConfig* destination,
+      std::vector<CallsignConfig>* digipeaters, std::string* payload,
+      uint32_t timeout_ms) final;
+  int GetFileDescriptor() const final;
+  bool ReceiveAvailable(const FrameCallback& callback) final;
+  int GetServiceTimeoutMs() const final;
+  bool WaitForTransmitComplete() final;
+
+ private:
+  // The size of the buffer used to read from the server.
+  static constexpr size_t kReadBufferSize = 4096;
+
+  // The hostname of the AGWPE server.
+  const std::string hostname_;
+
+  // The port of the AGWPE server.
+  const uint16_t port_;
+
+  // The radio port of the TNC that this interface uses.
+  const uint8_t radio_port_;
+
+  // The TCP socket used to communicate with the AGWPE server.
+  TCPSocket socket_;
+
+  // Paces attempts to reconnect when the connection is lost.
+  ReconnectBackoff backoff_;
+
+  // Bytes read from the server that have not been decoded yet.
+  std::vector<uint8_t> rx_buffer_;
+
+  // Raw AX.25 frames received on the radio port.
+  KISSFrameQueue rx_queue_;
+
+  // The most recently received frame. The storage is exchanged with the
+  // receive queue rather than copied.
+  KISSFrame rx_frame_;
+
+  // The buffer that outgoing AGWPE frames are built in.
+  std::vector<uint8_t> tx_buffer_;
+
+  // Set to true when a reply to an outstanding frames query has been received.
+  bool has_outstanding_frame_count_;
+
+  // The outstanding frame count from the most recent reply.
+  uint32_t outstanding_frame_count_;
+
+  // Set to true when a frame has been sent and its transmission has not been
+  // waited for. This is also read by the waiting thread without the send
+  // mutex.
+  std::atomic<bool> tx_pending_;
+
+  // Held while polling the transmit queue of the TNC so that the queries of
+  // concurrent senders do not interleave.
+  std::mutex tx_wait_mutex_;
+
+  // The time at which to make the next attempt to restore a lost connection,
+  // in microseconds.
+  uint64_t next_connect_time_us_;
+
+  // Guards stopped_.
+  std::mutex stop_mutex_;
+
+  // Signalled when the interface is stopped.
+  std::condition_variable stop_cv_;
+
+  // Set to true to stop restoring the connection.
+  bool stopped_;
+
+  // Connects to the server and enables raw monitoring. Returns true if
+  // successful.
+  bool Connect();
+
+  // Closes the connection and reconnects, waiting between attempts until the
+  // connection has been restored. Returns false if the interface is stopped
+  // first.
+  bool Reconnect();
+
+  // Closes the connection once it has been lost and schedules the first
+  // attempt to restore it. Has no effect if it has already been closed.
+  void Disconnect();
+
+  // Makes an attempt to restore a lost connection if the delay since the
+  // last attempt has elapsed. Returns true if connected.
+  bool ServiceReconnect();
+
+  // Waits until the next attempt to restore a lost connection is due or the
+  // timeout has elapsed. A negative timeout waits for the attempt. Returns
+  // false if the interface is stopped.
+  bool WaitForNextAttempt(int timeout_ms);
+
+  // Returns true if the interface has been stopped.
+  bool IsStopped();
+
+  // Returns the time in milliseconds until the next attempt to restore a lost
+  // connection, which is zero once it is due.
+  int GetReconnectTimeRemainingMs() const;
+
+  // Writes an AGWPE frame of the supplied kind with no data to the server.
+  bool WriteRequest(char kind);
+
+  // Starts an AGWPE frame of the supplied kind in tx_buffer_. The data length
+  // is filled in by WriteFrame.
+  void BeginFrame(char kind);
+
+  // Completes the frame in tx_buffer_ and writes it to the server.
+  bool WriteFrame();
+
+  // Appends an AX.25 formatted callsign to tx_buffer_.
+  void AppendAX25Callsign(const CallsignConfig& config, bool last);
+
+  // Reads from the server until the supplied function returns true. A timeout
+  // of zero waits indefinitely. The connection is restored if it is lost.
+  // Returns false if there is a timeout or the interface is stopped.
+  bool ReadUntil(const std::function<bool()>& done, uint32_t timeout_ms);
+
+  // Reads from the server without blocking and handles the complete frames.
+  // Returns false if the connection has failed.
+  bool ReadAvailable();
+
+  // Handles a complete AGWPE frame from the server.
+  void HandleFrame(const uint8_t* header, const uint8_t* data,
+      size_t data_size);
+
+  // Decodes rx_frame_ and invokes the callback if it is valid.
+  void DispatchFrame(const FrameCallback& callback);
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_AGW_APRS_INTERFACE_H_
@@ -16,6 +16,17 @@
 
 #include "net/aprs_interface.h"
 
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+
+#include "net/broadcast_schedule.h"
+#include "net/compact_chunk_header.h"
+#include "net/erasure_code.h"
+#include "net/event_loop.h"
+#include "net/retransmit_timer.h"
+#include "util/base91.h"
 #include "util/callsign.h"
 #include "util/log.h"
 #include "util/string.h"
@@ -28,54 +39,255 @@ namespace {
 
 const CallsignConfig kBroadcastDestination({kBroadcastCallsign, 0});
 
+// Returns the budget of airtime for the supplied config.
+TransmitScheduler::Budget GetTransmitBudget(
+    const APRSInterface::Config& config) {
+  TransmitScheduler::Budget budget;
+  budget.frames_per_minute = config.transmit_interval_s > 0.0f
+      ? 60.0f / config.transmit_interval_s : 0.0f;
+  budget.bytes_per_minute = config.max_bytes_per_minute;
+  return budget;
+}
+
 }  // anonymous namespace
 
 APRSInterface::APRSInterface(const Config& config)
     : config_(config),
+      transmit_scheduler_(std::make_shared<TransmitScheduler>(
+          GetTransmitBudget(config))),
       next_payload_id_(GetTimeNowUs() & 0xffffffff) {}
 
+APRSInterface::~APRSInterface() = default;
+
+void APRSInterface::SetTransmitScheduler(
+    const std::shared_ptr<TransmitScheduler>& transmit_scheduler) {
+  transmit_scheduler_ = transmit_scheduler;
+}
+
 bool APRSInterface::SendBroadcastPacket(const Packet& packet,
     const CallsignConfig& source,
-    const std::vector<CallsignConfig>& digipeaters) {
+    const std::vector<CallsignConfig>& digipeaters,
+    TransmitScheduler::Priority priority, uint32_t weight,
+    uint64_t deadline_us) {
+  return SendBroadcastPackets({packet}, source, digipeaters, priority, weight,
+      deadline_us);
+}
+
+bool APRSInterface::SendBroadcastPackets(const std::vector<Packet>& packets,
+    const CallsignConfig& source,
+    const std::vector<CallsignConfig>& digipeaters,
+    TransmitScheduler::Priority priority, uint32_t weight,
+    uint64_t deadline_us) {
+  // The chunks of each packet, indexed by the packet and then by chunk id - 1.
+  std::vector<std::vector<PacketChunk>> chunks(packets.size());
+  std::vector<size_t> chunk_counts(packets.size());
+  std::vector<size_t> serialized_sizes(packets.size());
+  for (size_t i = 0; i < packets.size(); i++) {
+    std::string serialized_packet;
+    if (!packets[i].SerializeToString(&serialized_packet)) {
+      LOGFATAL("failed to serialize packet");
+    }
+
+    uint32_t payload_id = GetNextPayloadId();
+    LOGI("sending payload_id %" PRIu32, payload_id);
+    if (config_.fec_redundancy <= 0.0f
+        || !BuildErasureCodedChunks(serialized_packet, payload_id,
+            &chunks[i])) {
+      BuildChunks(serialized_packet, payload_id, &chunks[i]);
+    }
+
+    chunk_counts[i] = chunks[i].size();
+    serialized_sizes[i] = serialized_packet.size();
+  }
+
+  // Chunks that have been heard repeated by a digipeater have reached the
+  // wider network and are not retransmitted. This can only happen when the
+  // chunks are sent through digipeaters.
+  bool listen_for_digipeats = config_.skip_digipeated_retransmits
+      && !digipeaters.empty();
+  std::vector<std::vector<bool>> digipeated(packets.size());
+  for (size_t i = 0; i < packets.size(); i++) {
+    digipeated[i].resize(chunks[i].size(), false);
+  }
+
+  auto handle_frame = [&](const CallsignConfig& frame_source,
+      const CallsignConfig& frame_destination,
+      const std::vector<CallsignConfig>& frame_digipeaters,
+      const std::string& payload) {
+    uint32_t payload_id;
+    uint32_t chunk_id;
+    if (!IsDigipeatedChunk(frame_source, frame_destination,
+          frame_digipeaters, payload, source, &payload_id, &chunk_id)) {
+      return;
+    }
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+      if (!chunks[i].empty()
+          && chunks[i].front().chunk().payload_id() == payload_id
+          && chunk_id >= 1 && chunk_id <= chunks[i].size()
+          && !digipeated[i][chunk_id - 1]) {
+        LOGI("heard payload_id=%" PRIu32 ", chunk_id=%" PRIu32
+            " digipeated", payload_id, chunk_id);
+        digipeated[i][chunk_id - 1] = true;
+      }
+    }
+  };
+
+  // Interleave the chunks of all packets so that the copies of each chunk are
+  // spread across the whole transfer.
+  TransmitScheduler::Flow flow(transmit_scheduler_.get(), priority, weight,
+      deadline_us);
+  for (const auto& transmission : BroadcastSchedule::Interleave(
+        chunk_counts, config_.retransmit_count)) {
+    size_t i = transmission.packet_index;
+    auto& packet_chunk = chunks[i][transmission.chunk_index];
+    auto* chunk = packet_chunk.mutable_chunk();
+
+    // Listen for digipeated chunks until the budget allows the next frame.
+    if (listen_for_digipeats && !ReceiveFramesUntil(
+          GetTimeNowUs() + flow.GetWaitTimeUs(
+              GetEncodedSize(packet_chunk, config_.payload_encoding)),
+          handle_frame, [] { return false; })) {
+      LOGE("failed to listen for digipeated chunks");
+      return false;
+    }
+
+    if (digipeated[i][transmission.chunk_index]) {
+      LOGI("skipping digipeated payload_id=%" PRIu32 ", chunk_id=%" PRIu32
+          ", retransmit=%" PRIu32, chunk->payload_id(), chunk->chunk_id(),
+          transmission.retransmit_id);
+      continue;
+    }
+
+    chunk->set_retransmit_id(transmission.retransmit_id);
+    if (!SendPacketChunk(&flow, packet_chunk, config_.payload_encoding,
+          source, kBroadcastDestination, digipeaters)) {
+      LOGE("failed to send packet chunk");
+      return false;
+    }
+
+    LOGI("sent broadcast payload_id=%" PRIu32 ", chunk_id=%" PRIu32
+        ", chunk_size=%zu, total_size=%zu, retransmit=%" PRIu32,
+        chunk->payload_id(), chunk->chunk_id(), chunk->payload().size(),
+        serialized_sizes[i], transmission.retransmit_id);
+  }
+
+  return true;
+}
+
+bool APRSInterface::SendDirectedPacket(const Packet& packet,
+    const CallsignConfig& source, const CallsignConfig& destination,
+    const std::vector<CallsignConfig>& digipeaters,
+    TransmitScheduler::Priority priority, uint32_t weight,
+    uint64_t deadline_us) {
   std::string serialized_packet;
   if (!packet.SerializeToString(&serialized_packet)) {
     LOGFATAL("failed to serialize packet");
   }
 
   uint32_t payload_id = GetNextPayloadId();
-  LOGI("sending payload_id %zu", payload_id);
-
-  uint64_t next_packet_time_us = GetTimeNowUs();
-  for (size_t i = 1; i <= config_.retransmit_count; i++) {
-    uint32_t chunk_id = 1;
-    for (uint32_t offset = 0; offset < serialized_packet.size();) {
-      PacketChunk packet_chunk;
-      auto* chunk = packet_chunk.mutable_chunk();
-      chunk->set_payload_id(payload_id);
-      chunk->set_chunk_id(chunk_id++);
-      chunk->set_retransmit_id(i);
-      if (offset == 0) {
-        chunk->set_total_payload_size(serialized_packet.size());
+  LOGI("sending payload_id %" PRIu32 " to %s", payload_id,
+      destination.ToString().c_str());
+
+  std::vector<PacketChunk> chunks;
+  BuildChunks(serialized_packet, payload_id, &chunks);
+
+  // The acknowledgement state of each chunk, indexed by chunk id - 1.
+  std::vector<bool> acked(chunks.size(), false);
+  std::vector<size_t> transmit_counts(chunks.size(), 0);
+  size_t acked_count = 0;
+  size_t window_size = std::max<size_t>(config_.directed_window_size, 1);
+
+  RetransmitTimer retransmit_timer;
+  size_t stalled_window_count = 0;
+  bool timed_out = false;
+  TransmitScheduler::Flow flow(transmit_scheduler_.get(), priority, weight,
+      deadline_us);
+  while (acked_count < chunks.size()) {
+    // The window is the lowest chunks that have not been acknowledged, which
+    // includes any that the last acknowledgement reported missing. After a
+    // timeout it is not known which chunks arrived, so a single chunk is sent
+    // to probe the receiver rather than repeating the whole window.
+    std::vector<size_t> window;
+    size_t max_window_size = timed_out ? 1 : window_size;
+    for (size_t i = 0; i < chunks.size() && window.size() < max_window_size;
+        i++) {
+      if (!acked[i]) {
+        window.push_back(i);
       }
+    }
 
-      size_t chunk_size = std::min(config_.max_packet_size,
-          serialized_packet.size() - offset);
-      chunk->set_payload(serialized_packet.substr(offset, chunk_size));
+    uint64_t poll_time_us = 0;
+    for (size_t i = 0; i < window.size(); i++) {
+      auto* chunk = chunks[window[i]].mutable_chunk();
+      chunk->set_retransmit_id(++transmit_counts[window[i]]);
+      if (i + 1 == window.size()) {
+        chunk->set_ack_requested(true);
+      } else {
+        chunk->clear_ack_requested();
+      }
 
-      if (!SendPacketChunk(packet_chunk, source, kBroadcastDestination,
-            digipeaters)) {
+      if (!SendPacketChunk(&flow, chunks[window[i]], config_.payload_encoding,
+            source, destination, digipeaters)) {
         LOGE("failed to send packet chunk");
         return false;
       }
 
-      LOGI("sent broadcast chunk_id=%zu, offset=%zu, chunk_size=%zu, "
-          "total_size=%zu, retransmit=%zu",
-          chunk->chunk_id(), offset, chunk_size, serialized_packet.size(), i);
-      offset += chunk_size;
+      LOGI("sent directed chunk_id=%" PRIu32 ", chunk_size=%zu, "
+          "total_size=%zu, retransmit=%" PRIu32, chunk->chunk_id(),
+          chunk->payload().size(), serialized_packet.size(),
+          chunk->retransmit_id());
+      poll_time_us = GetTimeNowUs();
+    }
+
+    PacketChunk::ChunkAck ack;
+    if (!WaitForChunkAck(source, destination, payload_id,
+          retransmit_timer.GetTimeoutUs(), &ack)) {
+      retransmit_timer.OnTimeout();
+      LOGI("timed out waiting for acknowledgement of payload_id %" PRIu32
+          ", timeout=%" PRIu64 "ms", payload_id,
+          retransmit_timer.GetTimeoutUs() / 1000);
+      timed_out = true;
+      if (++stalled_window_count >= kMaxDirectedStalledWindows) {
+        LOGE("peer stopped acknowledging payload_id %" PRIu32, payload_id);
+        return false;
+      }
 
-      // Pause for the next transmission.
-      next_packet_time_us += config_.transmit_interval_s * kUsPerS;
-      SleepUntil(next_packet_time_us);
+      continue;
+    }
+
+    timed_out = false;
+
+    // Only measure the round trip if the poll was sent once, otherwise the
+    // acknowledgement may be for an earlier copy.
+    if (transmit_counts[window.back()] == 1) {
+      retransmit_timer.AddSample(GetTimeNowUs() - poll_time_us);
+    } else {
+      retransmit_timer.ClearBackoff();
+    }
+
+    size_t previous_acked_count = acked_count;
+    const auto& bitmap = ack.received_bitmap();
+    for (size_t i = 0; i < chunks.size(); i++) {
+      uint32_t chunk_id = i + 1;
+      size_t bit = chunk_id - ack.chunk_id() - 2;
+      bool is_acked = ack.complete() || chunk_id <= ack.chunk_id()
+          || (chunk_id > ack.chunk_id() + 1 && bit / 8 < bitmap.size()
+              && (bitmap[bit / 8] & (1 << (bit % 8))) != 0);
+      if (is_acked && !acked[i]) {
+        acked[i] = true;
+        acked_count++;
+      }
+    }
+
+    LOGI("payload_id %" PRIu32 " acknowledged %zu/%zu chunks, rtt=%" PRIu64
+        "ms", payload_id, acked_count, chunks.size(),
+        retransmit_timer.GetSmoothedRttUs() / 1000);
+    if (acked_count > previous_acked_count) {
+      stalled_window_count = 0;
+    } else if (++stalled_window_count >= kMaxDirectedStalledWindows) {
+      LOGE("peer stopped acknowledging payload_id %" PRIu32, payload_id);
+      return false;
     }
   }
 
@@ -94,53 +306,410 @@ bool APRSInterface::ReceiveBroadcastPacket(Packet* packet,
       return false;
     }
 
-    if (destination == kBroadcastDestination) {
-      // Check the header.
-      if (!StringStartsWith(payload, "{")) {
-        LOGE("invalid payload");
-      }
+    if (ReceiveBroadcastFrame(*source, destination, payload, packet)) {
+      return true;
+    }
+  }
+}
 
-      // Trim the header and decode base64.
-      payload = payload.substr(1);
-      std::string serialized_packet = StringBase64Decode(payload);
-
-      // Attempt to deserialize.
-      PacketChunk packet_chunk;
-      if (!packet_chunk.ParseFromString(serialized_packet)) {
-        LOGE("received malformed packet chunk");
-        continue;
-      } else if (!packet_chunk.has_chunk()) {
-        LOGE("received packet chunk with missing chunk");
-        continue;
-      }
+bool APRSInterface::ReceiveBroadcastFrame(const CallsignConfig& source,
+    const CallsignConfig& destination, const std::string& payload,
+    Packet* packet) {
+  if (!(destination == kBroadcastDestination)) {
+    return false;
+  }
 
-      if (chunk_receiver_.PushPacketChunk(packet_chunk.chunk(), packet)) {
+  PacketChunk packet_chunk;
+  if (!DecodePacketChunk(payload, &packet_chunk)) {
+    return false;
+  } else if (!packet_chunk.has_chunk()) {
+    LOGE("received packet chunk with missing chunk");
+    return false;
+  }
+
+  return chunk_receiver_.PushPacketChunk(source, packet_chunk.chunk(),
+      packet);
+}
+
+bool APRSInterface::ReceiveDirectedFrame(const CallsignConfig& source,
+    const CallsignConfig& destination, const CallsignConfig& callsign,
+    const std::string& payload, Packet* packet) {
+  if (!(destination == callsign)) {
+    return false;
+  }
+
+  PacketChunk packet_chunk;
+  PayloadEncoding encoding;
+  if (!DecodePacketChunk(payload, &packet_chunk, &encoding)) {
+    return false;
+  } else if (!packet_chunk.has_chunk()) {
+    // Acknowledgements are only expected while sending.
+    return false;
+  }
+
+  const auto& chunk = packet_chunk.chunk();
+  bool is_complete = chunk_receiver_.PushPacketChunk(source, chunk, packet);
+  PendingChunkAck pending_ack;
+  if (chunk.ack_requested() && chunk_receiver_.GetChunkAck(source,
+        chunk.payload_id(), pending_ack.ack.mutable_chunk_ack())) {
+    // Sending waits for airtime, so the acknowledgement is sent once the
+    // frames that have been received are dispatched. A newer acknowledgement
+    // of the same payload replaces one that has not been sent.
+    pending_ack.encoding = encoding;
+    pending_ack.source = callsign;
+    pending_ack.destination = source;
+    std::lock_guard<std::mutex> lock(ack_mutex_);
+    auto pending_it = std::find_if(pending_chunk_acks_.begin(),
+        pending_chunk_acks_.end(), [&](const PendingChunkAck& pending) {
+          return pending.destination == source
+              && pending.ack.chunk_ack().payload_id() == chunk.payload_id();
+        });
+    if (pending_it != pending_chunk_acks_.end()) {
+      *pending_it = std::move(pending_ack);
+    } else {
+      pending_chunk_acks_.push_back(std::move(pending_ack));
+    }
+  }
+
+  return is_complete;
+}
+
+bool APRSInterface::SendPendingChunkAcks() {
+  TransmitScheduler::Flow flow(transmit_scheduler_.get(),
+      TransmitScheduler::Priority::kControl);
+  while (true) {
+    PendingChunkAck pending_ack;
+    {
+      std::lock_guard<std::mutex> lock(ack_mutex_);
+      if (pending_chunk_acks_.empty()
+          || flow.GetWaitTimeUs(GetEncodedSize(
+              pending_chunk_acks_.front().ack,
+              pending_chunk_acks_.front().encoding)) != 0) {
         return true;
       }
+
+      pending_ack = std::move(pending_chunk_acks_.front());
+      pending_chunk_acks_.erase(pending_chunk_acks_.begin());
+    }
+
+    const auto& ack = pending_ack.ack.chunk_ack();
+    if (!SendPacketChunk(&flow, pending_ack.ack, pending_ack.encoding,
+          pending_ack.source, pending_ack.destination, {},
+          /*wait_for_transmit=*/false)) {
+      LOGE("failed to send chunk ack");
+      return false;
     }
+
+    LOGI("sent chunk ack payload_id=%" PRIu32 ", chunk_id=%" PRIu32
+        ", complete=%d", ack.payload_id(), ack.chunk_id(), ack.complete());
   }
 }
 
-uint32_t APRSInterface::GetNextPayloadId() {
-  uint32_t next_payload_id = next_payload_id_++;
-  if (next_payload_id == 0) {
-    next_payload_id = next_payload_id_++;
+int APRSInterface::GetPendingChunkAckTimeoutMs() {
+  TransmitScheduler::Flow flow(transmit_scheduler_.get(),
+      TransmitScheduler::Priority::kControl);
+  std::lock_guard<std::mutex> lock(ack_mutex_);
+  if (pending_chunk_acks_.empty()) {
+    return -1;
   }
 
+  const auto& pending_ack = pending_chunk_acks_.front();
+  return (flow.GetWaitTimeUs(GetEncodedSize(pending_ack.ack,
+      pending_ack.encoding)) + 999) / 1000;
+}
+
+uint32_t APRSInterface::GetNextPayloadId() {
+  // Compact chunk headers carry short payload ids, which the receiver scopes
+  // to this station.
+  uint32_t max_payload_id = config_.compact_chunk_header
+      ? CompactChunkHeader::kMaxPayloadId : UINT32_MAX;
+  std::lock_guard<std::mutex> lock(send_mutex_);
+  uint32_t next_payload_id;
+  do {
+    next_payload_id = next_payload_id_++ & max_payload_id;
+  } while (next_payload_id == 0);
+
   return next_payload_id;
 }
 
-bool APRSInterface::SendPacketChunk(const PacketChunk& chunk,
-    const CallsignConfig& source, const CallsignConfig& destination,
+bool APRSInterface::SendBinaryPayload(const uint8_t* data, size_t size,
+    PayloadEncoding encoding, const CallsignConfig& source,
+    const CallsignConfig& destination,
     const std::vector<CallsignConfig>& digipeaters) {
-  std::string serialized_chunk;
-  if (!chunk.SerializeToString(&serialized_chunk)) {
-    LOGFATAL("failed to serialize chunk");
+  std::string aprs_packet(1, kBinaryPayloadPrefix);
+  std::string binary_payload(reinterpret_cast<const char*>(data), size);
+  if (encoding == PayloadEncoding::kBase91) {
+    aprs_packet += kBase91PayloadMarker;
+    aprs_packet += Base91::Encode(binary_payload);
+  } else {
+    aprs_packet += StringBase64Encode(binary_payload);
   }
 
-  std::string base64_serialized_chunk = StringBase64Encode(serialized_chunk);
-  std::string aprs_packet = "{" + base64_serialized_chunk;
   return Send(aprs_packet, source, destination, digipeaters);
 }
 
+int APRSInterface::GetServiceTimeoutMs() const {
+  return -1;
+}
+
+bool APRSInterface::WaitForTransmitComplete() {
+  return false;
+}
+
+void APRSInterface::BuildChunks(const std::string& serialized_packet,
+    uint32_t payload_id, std::vector<PacketChunk>* chunks) const {
+  chunks->clear();
+  uint32_t chunk_id = 1;
+  for (uint32_t offset = 0; offset < serialized_packet.size();) {
+    chunks->emplace_back();
+    auto* chunk = chunks->back().mutable_chunk();
+    chunk->set_payload_id(payload_id);
+    chunk->set_chunk_id(chunk_id++);
+    if (offset == 0) {
+      chunk->set_total_payload_size(serialized_packet.size());
+    }
+
+    size_t chunk_size = std::min(config_.max_packet_size,
+        serialized_packet.size() - offset);
+    chunk->set_payload(serialized_packet.substr(offset, chunk_size));
+    offset += chunk_size;
+  }
+}
+
+bool APRSInterface::BuildErasureCodedChunks(
+    const std::string& serialized_packet, uint32_t payload_id,
+    std::vector<PacketChunk>* chunks) const {
+  // Balance the source symbols so that the receiver can derive their size
+  // from the total size and the number of them.
+  size_t total_size = serialized_packet.size();
+  if (total_size == 0) {
+    return false;
+  }
+
+  size_t source_count = (total_size + config_.max_packet_size - 1)
+      / config_.max_packet_size;
+  size_t repair_count = std::ceil(source_count * config_.fec_redundancy);
+  if (source_count + repair_count > ErasureCode::kMaxSymbolCount) {
+    LOGE("packet of %zu chunks is too large for forward error correction",
+        source_count);
+    return false;
+  }
+
+  size_t symbol_size = (total_size + source_count - 1) / source_count;
+  std::vector<std::string> source(source_count);
+  for (size_t i = 0; i < source_count; i++) {
+    source[i] = serialized_packet.substr(i * symbol_size, symbol_size);
+  }
+
+  chunks->clear();
+  std::string padded_symbol;
+  for (size_t i = 0; i < source_count + repair_count; i++) {
+    chunks->emplace_back();
+    auto* chunk = chunks->back().mutable_chunk();
+    chunk->set_payload_id(payload_id);
+    chunk->set_chunk_id(i + 1);
+    chunk->set_total_payload_size(total_size);
+    chunk->set_fec_source_count(source_count);
+    chunk->set_fec_symbol_id(i);
+    if (i < source_count) {
+      chunk->set_payload(source[i]);
+    } else {
+      // Repair symbols are computed over source symbols padded to the same
+      // size.
+      source.back().resize(symbol_size);
+      ErasureCode::EncodeRepairSymbol(source, i, chunk->mutable_payload());
+    }
+  }
+
+  return true;
+}
+
+bool APRSInterface::WaitForChunkAck(const CallsignConfig& source,
+    const CallsignConfig& peer, uint32_t payload_id, uint64_t timeout_us,
+    PacketChunk::ChunkAck* ack) {
+  bool ack_received = false;
+  auto handle_frame = [&](const CallsignConfig& frame_source,
+      const CallsignConfig& frame_destination,
+      const std::vector<CallsignConfig>& /*digipeaters*/,
+      const std::string& payload) {
+    PacketChunk packet_chunk;
+    if (ack_received || !(frame_source == peer)
+        || !(frame_destination == source)
+        || !DecodePacketChunk(payload, &packet_chunk)
+        || !packet_chunk.has_chunk_ack()
+        || packet_chunk.chunk_ack().payload_id() != payload_id) {
+      return;
+    }
+
+    *ack = packet_chunk.chunk_ack();
+    ack_received = true;
+  };
+
+  if (!ReceiveFramesUntil(GetTimeNowUs() + timeout_us, handle_frame,
+        [&] { return ack_received; })) {
+    LOGE("failed to wait for chunk ack");
+    return false;
+  }
+
+  return ack_received;
+}
+
+bool APRSInterface::ReceiveFramesUntil(uint64_t end_time_us,
+    const FrameCallback& callback, const std::function<bool()>& done) {
+  // Reuse the event loop of this interface unless another thread is waiting
+  // on it.
+  std::unique_lock<std::mutex> lock(event_loop_mutex_, std::try_to_lock);
+  std::unique_ptr<EventLoop> temporary_event_loop;
+  EventLoop* event_loop;
+  if (!lock.owns_lock()) {
+    temporary_event_loop = std::make_unique<EventLoop>();
+    temporary_event_loop->AddInterface(this, callback);
+    event_loop = temporary_event_loop.get();
+  } else {
+    // The interface is removed from the loop if it fails, and is added again
+    // for the next wait.
+    if (event_loop_ == nullptr || event_loop_->IsEmpty()) {
+      event_loop_ = std::make_unique<EventLoop>();
+      event_loop_->AddInterface(this, [this](const CallsignConfig& source,
+          const CallsignConfig& destination,
+          const std::vector<CallsignConfig>& digipeaters,
+          const std::string& payload) {
+        event_loop_callback_(source, destination, digipeaters, payload);
+      });
+    }
+
+    event_loop = event_loop_.get();
+    event_loop_callback_ = callback;
+  }
+
+  // Frames that the interface has already read do not make its file
+  // descriptor readable, but the interface asks to be serviced immediately so
+  // that they are dispatched by the next RunOnce.
+  bool success = true;
+  for (uint64_t now_us = GetTimeNowUs(); !done() && now_us < end_time_us;
+      now_us = GetTimeNowUs()) {
+    int timeout_ms = (end_time_us - now_us + 999) / 1000;
+    if (!event_loop->RunOnce(timeout_ms)) {
+      success = false;
+      break;
+    }
+  }
+
+  if (lock.owns_lock()) {
+    event_loop_callback_ = nullptr;
+  }
+
+  return success;
+}
+
+bool APRSInterface::IsDigipeatedChunk(const CallsignConfig& frame_source,
+    const CallsignConfig& frame_destination,
+    const std::vector<CallsignConfig>& frame_digipeaters,
+    const std::string& payload, const CallsignConfig& source,
+    uint32_t* payload_id, uint32_t* chunk_id) {
+  if (!(frame_source == source)
+      || !(frame_destination == kBroadcastDestination)
+      || std::none_of(frame_digipeaters.begin(), frame_digipeaters.end(),
+          [](const CallsignConfig& digipeater) {
+            return digipeater.repeated;
+          })) {
+    return false;
+  }
+
+  PacketChunk packet_chunk;
+  if (!DecodePacketChunk(payload, &packet_chunk)
+      || !packet_chunk.has_chunk()) {
+    return false;
+  }
+
+  *payload_id = packet_chunk.chunk().payload_id();
+  *chunk_id = packet_chunk.chunk().chunk_id();
+  return true;
+}
+
+bool APRSInterface::DecodePacketChunk(const std::string& payload,
+    PacketChunk* packet_chunk, PayloadEncoding* encoding) {
+  // Check the header.
+  if (payload.empty() || payload[0] != kBinaryPayloadPrefix) {
+    LOGE("invalid payload");
+    return false;
+  }
+
+  // Trim the header and decode base91 or base64.
+  std::string serialized_packet;
+  bool is_base91 = payload.size() > 1 && payload[1] == kBase91PayloadMarker;
+  if (!is_base91) {
+    serialized_packet = StringBase64Decode(payload.substr(1));
+  } else if (!Base91::Decode(payload.data() + 2, payload.size() - 2,
+        &serialized_packet)) {
+    LOGE("invalid base91 payload");
+    return false;
+  }
+
+  if (encoding != nullptr) {
+    *encoding = is_base91 ? PayloadEncoding::kBase91 : PayloadEncoding::kBase64;
+  }
+
+  // Attempt to deserialize.
+  if (CompactChunkHeader::IsCompact(serialized_packet)) {
+    packet_chunk->Clear();
+    if (!CompactChunkHeader::Decode(serialized_packet,
+          packet_chunk->mutable_chunk())) {
+      return false;
+    }
+  } else if (!packet_chunk->ParseFromString(serialized_packet)) {
+    LOGE("received malformed packet chunk");
+    return false;
+  }
+
+  return true;
+}
+
+size_t APRSInterface::GetEncodedSize(const PacketChunk& chunk,
+    PayloadEncoding encoding) const {
+  size_t size = config_.compact_chunk_header && chunk.has_chunk()
+      && CompactChunkHeader::CanEncode(chunk.chunk())
+      ? CompactChunkHeader::GetEncodedSize(chunk.chunk())
+      : chunk.ByteSizeLong();
+  if (encoding == PayloadEncoding::kBase91) {
+    return 2 + Base91::GetMaxEncodedSize(size);
+  }
+
+  return 1 + (size + 2) / 3 * 4;
+}
+
+bool APRSInterface::SendPacketChunk(TransmitScheduler::Flow* flow,
+    const PacketChunk& chunk, PayloadEncoding encoding,
+    const CallsignConfig& source, const CallsignConfig& destination,
+    const std::vector<CallsignConfig>& digipeaters, bool wait_for_transmit) {
+  if (!flow->Acquire(GetEncodedSize(chunk, encoding))) {
+    LOGI("sending chunk after the deadline");
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    bool is_compact = config_.compact_chunk_header && chunk.has_chunk()
+        && CompactChunkHeader::Encode(chunk.chunk(), &serialized_chunk_);
+    if (!is_compact && !chunk.SerializeToString(&serialized_chunk_)) {
+      LOGFATAL("failed to serialize chunk");
+    }
+
+    if (!SendBinaryPayload(
+          reinterpret_cast<const uint8_t*>(serialized_chunk_.data()),
+          serialized_chunk_.size(), encoding, source, destination,
+          digipeaters)) {
+      return false;
+    }
+  }
+
+  // Pace the next frame from when this one left the radio if the interface
+  // can report it. This waits without the send mutex so that other senders,
+  // such as acknowledgements, are not held up behind the radio.
+  if (wait_for_transmit && WaitForTransmitComplete()) {
+    flow->GetScheduler()->OnTransmitComplete();
+  }
+
+  return true;
+}
+
 }  // namesapce au
@@ -17,23 +17,73 @@
 #ifndef APRS_UTILS_NET_APRS_INTERFACE_H_
 #define APRS_UTILS_NET_APRS_INTERFACE_H_
 
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "net/packet_chunk_receiver.h"
+#include "net/transmit_scheduler.h"
 #include "proto/packet.pb.h"
 #include "util/callsign.h"
 
 namespace au {
 
+class EventLoop;
+
 // An interface to use for sending/receiving packets from a APRS.
 class APRSInterface {
  public:
+  // A callback that is invoked with each frame received by ReceiveAvailable.
+  typedef std::function<void(const CallsignConfig& source,
+      const CallsignConfig& destination,
+      const std::vector<CallsignConfig>& digipeaters,
+      const std::string& payload)> FrameCallback;
+
+  // The text encodings of binary payloads.
+  enum class PayloadEncoding {
+    // Base64, which every receiver decodes.
+    kBase64,
+
+    // Base91, which carries about 8% more data per frame but is only decoded
+    // by receivers that support it.
+    kBase91,
+  };
+
   // The configuration for this APRSInterface.
   struct Config {
     float transmit_interval_s;
     size_t retransmit_count;
     size_t max_packet_size;
+
+    // The number of erasure coded repair chunks to send for each packet, as a
+    // fraction of the number of chunks that the packet is split into. Zero
+    // disables forward error correction.
+    float fec_redundancy;
+
+    // The number of chunks that a directed transfer sends before asking the
+    // receiver for an acknowledgement.
+    size_t directed_window_size;
+
+    // Set to true to skip the retransmissions of broadcast chunks that have
+    // been heard repeated by a digipeater.
+    bool skip_digipeated_retransmits;
+
+    // The number of bytes of encoded frames that may be sent per minute, in
+    // addition to the limit of one frame per transmit interval. Zero disables
+    // the limit.
+    uint32_t max_bytes_per_minute;
+
+    // The encoding of the chunks that this station sends. Chunks are received
+    // in either encoding, and acknowledgements are sent in the encoding of the
+    // chunk that requested them.
+    PayloadEncoding payload_encoding;
+
+    // Set to true to send chunks with a CompactChunkHeader and short payload
+    // ids rather than as serialized PacketChunks. Chunks are received in
+    // either form.
+    bool compact_chunk_header;
   };
 
   // The interval in seconds between transmissions.
@@ -45,20 +95,119 @@ class APRSInterface {
   // The maximum number of bytes that can be sent at a time.
   static constexpr size_t kDefaultMaxPacketSize = 100;
 
-  // Setup the APRSInterface.
+  // The default fraction of repair chunks to send with forward error
+  // correction.
+  static constexpr float kDefaultFECRedundancy = 0.0f;
+
+  // The default number of chunks sent per acknowledgement in directed mode.
+  static constexpr size_t kDefaultDirectedWindowSize = 8;
+
+  // The number of consecutive windows of a directed transfer that may pass
+  // without any chunk being acknowledged before the transfer is abandoned.
+  static constexpr size_t kMaxDirectedStalledWindows = 8;
+
+  // The default number of bytes that may be sent per minute, which is
+  // unlimited.
+  static constexpr uint32_t kDefaultMaxBytesPerMinute = 0;
+
+  // The default encoding of binary payloads.
+  static constexpr PayloadEncoding kDefaultPayloadEncoding =
+      PayloadEncoding::kBase64;
+
+  // The prefix of the text encoding of binary payloads, followed by base64.
+  static constexpr char kBinaryPayloadPrefix = '{';
+
+  // The character that follows the binary payload prefix when the payload is
+  // encoded with base91. This is not part of the base64 alphabet.
+  static constexpr char kBase91PayloadMarker = '#';
+
+  // Setup the APRSInterface with its own TransmitScheduler that paces frames
+  // according to the config.
   APRSInterface(const Config& config);
 
-  virtual ~APRSInterface() = default;
+  virtual ~APRSInterface();
 
-  // Sends a packet in ACKless mode.
+  // Replaces the scheduler that paces the frames sent by this interface. Every
+  // interface that transmits on the same radio should share one scheduler, so
+  // that the station as a whole stays within its budget of airtime.
+  void SetTransmitScheduler(
+      const std::shared_ptr<TransmitScheduler>& transmit_scheduler);
+
+  // Returns the scheduler that paces the frames sent by this interface.
+  const std::shared_ptr<TransmitScheduler>& GetTransmitScheduler() const {
+    return transmit_scheduler_;
+  }
+
+  // Sends a packet in ACKless mode. If the packet is sent through digipeaters,
+  // frames are received between transmissions and chunks that are heard
+  // repeated by a digipeater are not retransmitted.
   bool SendBroadcastPacket(const Packet& packet,
       const CallsignConfig& source,
-      const std::vector<CallsignConfig>& digipeaters);
+      const std::vector<CallsignConfig>& digipeaters,
+      TransmitScheduler::Priority priority =
+          TransmitScheduler::Priority::kBulk,
+      uint32_t weight = 1, uint64_t deadline_us = 0);
+
+  // Sends many packets in ACKless mode. The chunks of all of the packets and
+  // their retransmissions are interleaved with a BroadcastSchedule, so that a
+  // burst of interference does not destroy every copy of a chunk.
+  //
+  // Each transfer is a flow of the TransmitScheduler with the supplied
+  // priority, weight and optional absolute deadline, so transfers may run
+  // concurrently from many threads and a higher priority transfer preempts
+  // the others between frames. Frames received while waiting go to whichever
+  // thread is listening, so transfers that listen for frames should each use
+  // their own interface and share a scheduler.
+  bool SendBroadcastPackets(const std::vector<Packet>& packets,
+      const CallsignConfig& source,
+      const std::vector<CallsignConfig>& digipeaters,
+      TransmitScheduler::Priority priority =
+          TransmitScheduler::Priority::kBulk,
+      uint32_t weight = 1, uint64_t deadline_us = 0);
+
+  // Sends a packet to a single peer with selective acknowledgements. Chunks
+  // are sent in windows, the last of which requests a ChunkAck, and only the
+  // chunks that the peer reports missing are sent again. The time to wait for
+  // an acknowledgement adapts to the measured round trip time. Returns false
+  // if the peer stops acknowledging chunks.
+  bool SendDirectedPacket(const Packet& packet,
+      const CallsignConfig& source, const CallsignConfig& destination,
+      const std::vector<CallsignConfig>& digipeaters,
+      TransmitScheduler::Priority priority =
+          TransmitScheduler::Priority::kBulk,
+      uint32_t weight = 1, uint64_t deadline_us = 0);
 
   // Receives a packet in ACKless mode.
   bool ReceiveBroadcastPacket(Packet* packet,
       CallsignConfig* source, std::vector<CallsignConfig>* digipeaters);
 
+  // Handles a frame that was received with ReceiveAvailable as part of a
+  // broadcast packet. Returns true if a complete packet has been received and
+  // populates the supplied packet.
+  bool ReceiveBroadcastFrame(const CallsignConfig& source,
+      const CallsignConfig& destination, const std::string& payload,
+      Packet* packet);
+
+  // Handles a frame that was received with ReceiveAvailable as part of a
+  // directed packet sent to the supplied callsign, and queues an
+  // acknowledgement of the chunks received so far when the sender requests
+  // it. Returns true if a complete packet has been received and populates the
+  // supplied packet.
+  bool ReceiveDirectedFrame(const CallsignConfig& source,
+      const CallsignConfig& destination, const CallsignConfig& callsign,
+      const std::string& payload, Packet* packet);
+
+  // Sends the acknowledgements queued by ReceiveDirectedFrame that the
+  // TransmitScheduler allows to be sent now. Acknowledgements are sent with
+  // control priority, ahead of any transfer from this station, and this does
+  // not wait for airtime or for the transmissions to complete. An EventLoop
+  // invokes this after dispatching frames. Returns false if sending fails.
+  bool SendPendingChunkAcks();
+
+  // Returns the time in milliseconds until the next queued acknowledgement
+  // may be sent, or -1 if none are queued.
+  int GetPendingChunkAckTimeoutMs();
+
   // Sends a frame over APRS. This is a lower-level interface that is not
   // typically used.
   virtual bool Send(const std::string& payload,
@@ -72,24 +221,149 @@ class APRSInterface {
       std::vector<CallsignConfig>* digipeaters, std::string* payload,
       uint32_t timeout_ms) = 0;
 
+  // Sends a binary payload as a text encoded frame over APRS. The default
+  // implementation encodes the payload and calls Send, and may be overridden
+  // to encode directly into the outgoing frame.
+  virtual bool SendBinaryPayload(const uint8_t* data, size_t size,
+      PayloadEncoding encoding, const CallsignConfig& source,
+      const CallsignConfig& destination,
+      const std::vector<CallsignConfig>& digipeaters);
+
+  // Returns the file descriptor that becomes readable when frames may be
+  // available. This is used to wait on many interfaces with an EventLoop.
+  // Returns -1 while a lost connection is being restored.
+  virtual int GetFileDescriptor() const = 0;
+
+  // Reads whatever is available from the connection without blocking and
+  // invokes the callback for each complete frame. Returns false if the
+  // connection has failed.
+  virtual bool ReceiveAvailable(const FrameCallback& callback) = 0;
+
+  // Returns the time in milliseconds until ReceiveAvailable must be invoked
+  // even if the file descriptor has not become readable, such as to detect a
+  // stalled connection, or -1 if it is only invoked when readable. The default
+  // implementation returns -1.
+  virtual int GetServiceTimeoutMs() const;
+
+ protected:
+  // Waits for the most recently sent frame to be transmitted. Returns true if
+  // the transmission was confirmed, or false if the interface is unable to
+  // tell, in which case frames are paced from when they were sent. This may
+  // be called while another thread sends a frame. The default implementation
+  // returns false.
+  virtual bool WaitForTransmitComplete();
+
  private:
   // The config to use for this APRSInterface.
   const Config config_;
 
+  // Paces the frames sent by this interface.
+  std::shared_ptr<TransmitScheduler> transmit_scheduler_;
+
+  // An acknowledgement that is waiting to be sent.
+  struct PendingChunkAck {
+    // The acknowledgement to send.
+    PacketChunk ack;
+
+    // The encoding of the chunk that requested the acknowledgement.
+    PayloadEncoding encoding;
+
+    // The callsign that the acknowledged chunks were sent to.
+    CallsignConfig source;
+
+    // The peer that sent the acknowledged chunks.
+    CallsignConfig destination;
+  };
+
+  // Guards the payload ids and the serialized chunk buffer, which are shared
+  // by concurrent senders.
+  std::mutex send_mutex_;
+
   // The id of the next payload from this station.
   uint32_t next_payload_id_;
 
   // Handles receiving chunks until completed packets are received.
   PacketChunkReceiver chunk_receiver_;
 
+  // Guards the pending acknowledgements, which are queued by the receiving
+  // thread and taken by whichever thread sends them. This is separate from the
+  // send mutex so that queueing does not wait for a frame to be sent.
+  std::mutex ack_mutex_;
+
+  // The acknowledgements that have been requested but not sent, in the order
+  // they were requested.
+  std::vector<PendingChunkAck> pending_chunk_acks_;
+
+  // Held by the thread that is waiting on the event loop below.
+  std::mutex event_loop_mutex_;
+
+  // The event loop that ReceiveFramesUntil waits on, which is created on first
+  // use and reused so that each wait does not create an epoll instance.
+  std::unique_ptr<EventLoop> event_loop_;
+
+  // The callback that frames received by the event loop are passed to.
+  FrameCallback event_loop_callback_;
+
+  // The buffer that chunks are serialized into before sending. This is reused
+  // to avoid allocating for each chunk.
+  std::string serialized_chunk_;
+
   // Returns the ID of the next payload to send.
   uint32_t GetNextPayloadId();
 
-  // Sends a packet chunk by serializing to base64 and forming a valid APRS
-  // frame.
-  bool SendPacketChunk(const PacketChunk& chunk, const CallsignConfig& source,
+  // Splits a serialized packet into chunks of up to the maximum packet size.
+  void BuildChunks(const std::string& serialized_packet, uint32_t payload_id,
+      std::vector<PacketChunk>* chunks) const;
+
+  // Splits a serialized packet into erasure coded source chunks of equal size
+  // and appends repair chunks according to the FEC redundancy. Returns false
+  // if the packet is empty or requires too many symbols to be erasure coded.
+  bool BuildErasureCodedChunks(const std::string& serialized_packet,
+      uint32_t payload_id, std::vector<PacketChunk>* chunks) const;
+
+  // Waits for a ChunkAck of the supplied payload sent by the peer to the
+  // source until the timeout expires, receiving and discarding other frames.
+  // Returns true and populates the acknowledgement if one is received.
+  bool WaitForChunkAck(const CallsignConfig& source,
+      const CallsignConfig& peer, uint32_t payload_id, uint64_t timeout_us,
+      PacketChunk::ChunkAck* ack);
+
+  // Receives frames from this interface and passes them to the callback until
+  // the end time or until the predicate returns true. Frames that the
+  // interface has already read are passed to the callback without waiting.
+  // Returns false if waiting for frames fails.
+  bool ReceiveFramesUntil(uint64_t end_time_us, const FrameCallback& callback,
+      const std::function<bool()>& done);
+
+  // Returns true if a received frame is a broadcast chunk sent by the source
+  // that a digipeater has repeated, and populates the ids of the payload and
+  // the chunk.
+  static bool IsDigipeatedChunk(const CallsignConfig& frame_source,
+      const CallsignConfig& frame_destination,
+      const std::vector<CallsignConfig>& frame_digipeaters,
+      const std::string& payload, const CallsignConfig& source,
+      uint32_t* payload_id, uint32_t* chunk_id);
+
+  // Decodes the binary payload of a frame into a packet chunk in either
+  // encoding, and optionally populates the encoding. Returns false if the
+  // payload is not a valid packet chunk.
+  static bool DecodePacketChunk(const std::string& payload,
+      PacketChunk* packet_chunk, PayloadEncoding* encoding = nullptr);
+
+  // Returns the size of the text encoded frame payload of a packet chunk,
+  // which is charged to the budget of the TransmitScheduler.
+  size_t GetEncodedSize(const PacketChunk& chunk,
+      PayloadEncoding encoding) const;
+
+  // Waits for the flow to be granted airtime and sends a packet chunk by
+  // serializing it, with a CompactChunkHeader if configured, and sending it as
+  // a binary payload in the supplied encoding. If requested, this then waits
+  // for the transmission to complete so that the next frame is paced from it.
+  bool SendPacketChunk(TransmitScheduler::Flow* flow, const PacketChunk& chunk,
+      PayloadEncoding encoding, const CallsignConfig& source,
       const CallsignConfig& destination,
-      const std::vector<CallsignConfig>& digipeaters);
+      const std::vector<CallsignConfig>& digipeaters,
+      bool wait_for_transmit = true);
 };
 
 }  // namespace au
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/aprs_is_filter.h"
+
+#include "util/string.h"
+
+namespace au {
+namespace {
+
+// Appends a filter of the supplied type with its arguments separated by
+// slashes.
+void AppendFilter(const char* type, const std::vector<std::string>& arguments,
+    std::string* filter) {
+  if (arguments.empty()) {
+    return;
+  }
+
+  if (!filter->empty()) {
+    filter->push_back(' ');
+  }
+
+  filter->append(type);
+  for (const auto& argument : arguments) {
+    filter->push_back('/');
+    filter->append(argument);
+  }
+}
+
+}  // anonymous namespace
+
+void APRSISFilter::AddDestination(const std::string& callsign) {
+  destinations_.push_back(callsign);
+}
+
+void APRSISFilter::AddBuddy(const CallsignConfig& callsign) {
+  buddies_.push_back(callsign.ToString());
+}
+
+void APRSISFilter::AddRange(double latitude, double longitude,
+    double distance_km) {
+  filters_.push_back(StringFormat("r/%.4f/%.4f/%.0f",
+      latitude, longitude, distance_km));
+}
+
+void APRSISFilter::AddRaw(const std::string& filter) {
+  if (!filter.empty()) {
+    filters_.push_back(filter);
+  }
+}
+
+bool APRSISFilter::IsEmpty() const {
+  return destinations_.empty() && buddies_.empty() && filters_.empty();
+}
+
+std::string APRSISFilter::ToString() const {
+  std::string filter;
+  AppendFilter("u", destinations_, &filter);
+  AppendFilter("b", buddies_, &filter);
+  for (const auto& other_filter : filters_) {
+    if (!filter.empty()) {
+      filter.push_back(' ');
+    }
+
+    filter.append(other_filter);
+  }
+
+  return filter;
+}
+
+}  // namespace au
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_APRS_IS_FILTER_H_
+#define APRS_UTILS_NET_APRS_IS_FILTER_H_
+
+#include <string>
+#include <vector>
+
+#include "util/callsign.h"
+
+namespace au {
+
+// Builds a server-side filter for an APRS-IS connection. The server only
+// forwards the packets that match any part of the filter, which avoids
+// downloading and parsing traffic that is of no use to the receiver.
+class APRSISFilter {
+ public:
+  // Adds a destination callsign, matching packets whose unproto destination
+  // address is it (u/). This is not the digipeater filter (d/).
+  void AddDestination(const std::string& callsign);
+
+  // Adds a station to the buddy list, matching packets sent by it (b/).
+  void AddBuddy(const CallsignConfig& callsign);
+
+  // Adds a range, matching packets from stations within the supplied distance
+  // of a position (r/).
+  void AddRange(double latitude, double longitude, double distance_km);
+
+  // Adds a filter that is written in the APRS-IS filter syntax.
+  void AddRaw(const std::string& filter);
+
+  // Returns true if no filters have been added.
+  bool IsEmpty() const;
+
+  // Formats the filter in the APRS-IS filter syntax.
+  std::string ToString() const;
+
+ private:
+  // The destination callsigns.
+  std::vector<std::string> destinations_;
+
+  // The buddy list callsigns.
+  std::vector<std::string> buddies_;
+
+  // The other filters that have been added, already formatted.
+  std::vector<std::string> filters_;
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_APRS_IS_FILTER_H_
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/aprs_is_line_filter.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace au {
+
+APRSISLineFilter::APRSISLineFilter(const std::string& destination,
+    char payload_prefix)
+    : destination_(destination),
+      payload_prefix_(payload_prefix),
+      stats_() {}
+
+bool APRSISLineFilter::Accept(std::string_view line) {
+  stats_.scanned_count++;
+
+  size_t source_end;
+  size_t header_end;
+  FindHeaderDelimiters(line.data(), line.size(), &source_end, &header_end);
+
+  // The destination follows the source and ends the header or is followed by
+  // the path.
+  size_t destination_start = source_end + 1;
+  size_t destination_end = destination_start + destination_.size();
+  if (header_end >= line.size() || destination_end > header_end
+      || memcmp(&line[destination_start], destination_.data(),
+          destination_.size()) != 0
+      || (line[destination_end] != ',' && line[destination_end] != ':')) {
+    return false;
+  }
+
+  if (header_end + 1 >= line.size()
+      || line[header_end + 1] != payload_prefix_) {
+    return false;
+  }
+
+  stats_.accepted_count++;
+  return true;
+}
+
+void APRSISLineFilter::FindHeaderDelimiters(const char* line, size_t size,
+    size_t* source_end, size_t* header_end) {
+  *source_end = size;
+  *header_end = size;
+
+  size_t i = 0;
+#if defined(__SSE2__)
+  // Compare 16 bytes at a time against both delimiters.
+  const __m128i source_delimiter = _mm_set1_epi8('>');
+  const __m128i header_delimiter = _mm_set1_epi8(':');
+  for (; i + 16 <= size; i += 16) {
+    __m128i block = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(line + i));
+    int source_mask = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(block, source_delimiter));
+    int header_mask = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(block, header_delimiter));
+    if (source_mask != 0 && *source_end == size) {
+      *source_end = i + __builtin_ctz(source_mask);
+    }
+
+    if (header_mask != 0) {
+      *header_end = i + __builtin_ctz(header_mask);
+      return;
+    }
+  }
+#endif
+
+  for (; i < size; i++) {
+    if (line[i] == '>' && *source_end == size) {
+      *source_end = i;
+    } else if (line[i] == ':') {
+      *header_end = i;
+      return;
+    }
+  }
+}
+
+}  // namespace au
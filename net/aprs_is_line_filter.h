@@ -0,0 +1,72 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_APRS_IS_LINE_FILTER_H_
+#define APRS_UTILS_NET_APRS_IS_LINE_FILTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace au {
+
+// Rejects lines from an APRS-IS server that cannot carry a frame of interest
+// before they are parsed. A line is accepted if it is addressed to the
+// destination and its payload starts with the prefix. The header delimiters
+// are located with SIMD where it is available, so lines in a full feed are
+// dropped without copying or allocating.
+class APRSISLineFilter {
+ public:
+  // Statistics about the lines checked by this filter.
+  struct Stats {
+    // The number of lines checked.
+    uint64_t scanned_count;
+
+    // The number of lines accepted.
+    uint64_t accepted_count;
+  };
+
+  // Setup the filter to accept lines for the supplied destination and payload
+  // prefix.
+  APRSISLineFilter(const std::string& destination, char payload_prefix);
+
+  // Returns true if the line may carry a frame of interest.
+  bool Accept(std::string_view line);
+
+  // Returns the statistics of this filter.
+  const Stats& GetStats() const { return stats_; }
+
+  // Finds the end of the source callsign (the first '>') and the end of the
+  // header (the first ':') of a line. Offsets that are not found are set to
+  // the size of the line, and the search stops at the end of the header.
+  static void FindHeaderDelimiters(const char* line, size_t size,
+      size_t* source_end, size_t* header_end);
+
+ private:
+  // The destination to accept.
+  const std::string destination_;
+
+  // The first character of the payloads to accept.
+  const char payload_prefix_;
+
+  // The statistics of this filter.
+  Stats stats_;
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_APRS_IS_LINE_FILTER_H_
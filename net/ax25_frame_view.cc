@@ -0,0 +1,138 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/ax25_frame_view.h"
+
+#include "util/log.h"
+
+#define LOG_TAG "AX25FrameView"
+
+namespace au {
+
+size_t AX25AddressView::GetCallsignLength() const {
+  size_t length = 0;
+  while (length < kMaxCallsignLength && GetCallsignChar(length) != ' ') {
+    length++;
+  }
+
+  return length;
+}
+
+bool AX25AddressView::Matches(const CallsignConfig& config) const {
+  size_t length = GetCallsignLength();
+  if (config.callsign.size() != length || config.ssid != GetSSID()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < length; i++) {
+    if (config.callsign[i] != GetCallsignChar(i)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void AX25AddressView::ToCallsignConfig(CallsignConfig* config) const {
+  size_t length = GetCallsignLength();
+  config->callsign.resize(length);
+  for (size_t i = 0; i < length; i++) {
+    config->callsign[i] = GetCallsignChar(i);
+  }
+
+  config->ssid = GetSSID();
+  config->repeated = false;
+}
+
+bool AX25FrameView::Parse(const uint8_t* data, size_t size) {
+  const uint8_t* end = data + size;
+  AX25AddressView* addresses[2] = { &destination_, &source_ };
+  for (auto* address : addresses) {
+    if (end - data < static_cast<ptrdiff_t>(AX25AddressView::kSize)) {
+      LOGE("unable to decode callsign with short frame");
+      return false;
+    } else if ((data[6] & 0x60) != 0x60) {
+      LOGE("unable to decode callsign with SSID mask");
+      return false;
+    }
+
+    address->Init(data);
+    data += AX25AddressView::kSize;
+  }
+
+  digipeater_count_ = 0;
+  bool last = source_.IsLast();
+  while (!last) {
+    if (digipeater_count_ == kMaxDigipeaterCount) {
+      LOGE("too many digipeaters");
+      return false;
+    } else if (end - data < static_cast<ptrdiff_t>(AX25AddressView::kSize)) {
+      LOGE("unable to decode digipeater with short frame");
+      return false;
+    }
+
+    auto& digipeater = digipeaters_[digipeater_count_++];
+    digipeater.Init(data);
+    last = digipeater.IsLast();
+    data += AX25AddressView::kSize;
+  }
+
+  if (data == end) {
+    LOGE("frame missing control field");
+    return false;
+  }
+
+  // Information and UI frames carry a protocol id, other frames do not.
+  control_ = *data++;
+  protocol_id_ = 0;
+  if ((control_ & 0x01) == 0 || (control_ & 0xef) == kControlUIFrame) {
+    if (data == end) {
+      LOGE("frame missing protocol id");
+      return false;
+    }
+
+    protocol_id_ = *data++;
+  }
+
+  info_ = data;
+  info_size_ = end - data;
+  return true;
+}
+
+bool AX25FrameView::ToAPRSFrame(CallsignConfig* source,
+    CallsignConfig* destination, std::vector<CallsignConfig>* digipeaters,
+    std::string* payload) const {
+  if (control_ != kControlUIFrame) {
+    LOGE("invalid frame type: 0x%02x", control_);
+    return false;
+  } else if (protocol_id_ != kProtocolIdNone) {
+    LOGE("invalid layer 3 protocol: 0x%02x", protocol_id_);
+    return false;
+  }
+
+  destination_.ToCallsignConfig(destination);
+  source_.ToCallsignConfig(source);
+  digipeaters->resize(digipeater_count_);
+  for (size_t i = 0; i < digipeater_count_; i++) {
+    digipeaters_[i].ToCallsignConfig(&(*digipeaters)[i]);
+    (*digipeaters)[i].repeated = digipeaters_[i].HasBeenRepeated();
+  }
+
+  payload->assign(reinterpret_cast<const char*>(info_), info_size_);
+  return true;
+}
+
+}  // namespace au
@@ -0,0 +1,152 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_AX25_FRAME_VIEW_H_
+#define APRS_UTILS_NET_AX25_FRAME_VIEW_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "util/callsign.h"
+
+namespace au {
+
+// A non-owning view of an address within an AX.25 frame.
+class AX25AddressView {
+ public:
+  // The size of an encoded AX.25 address.
+  static constexpr size_t kSize = 7;
+
+  // The maximum length of a callsign in an AX.25 address.
+  static constexpr size_t kMaxCallsignLength = 6;
+
+  // Setup the view over an encoded address of kSize bytes.
+  void Init(const uint8_t* address) { address_ = address; }
+
+  // Returns the length of the callsign, excluding padding.
+  size_t GetCallsignLength() const;
+
+  // Returns a character of the callsign.
+  char GetCallsignChar(size_t index) const {
+    return static_cast<char>(address_[index] >> 1);
+  }
+
+  // Returns the SSID of the address.
+  int GetSSID() const { return (address_[6] >> 1) & 0x0f; }
+
+  // Returns true if this is the last address in the frame.
+  bool IsLast() const { return (address_[6] & 0x01) != 0; }
+
+  // Returns true if the has-been-repeated bit is set. This is only meaningful
+  // for digipeater addresses.
+  bool HasBeenRepeated() const { return (address_[6] & 0x80) != 0; }
+
+  // Returns true if this address matches the supplied callsign and SSID.
+  bool Matches(const CallsignConfig& config) const;
+
+  // Populates the supplied config with this address.
+  void ToCallsignConfig(CallsignConfig* config) const;
+
+ private:
+  // The encoded address.
+  const uint8_t* address_;
+};
+
+// A non-owning view of an AX.25 frame. The frame is parsed in place and no
+// memory is allocated, so the view is only valid for as long as the buffer
+// that it was parsed from.
+class AX25FrameView {
+ public:
+  // The maximum number of digipeaters in an AX.25 frame.
+  static constexpr size_t kMaxDigipeaterCount = 8;
+
+  // The control field of an unnumbered information (UI) frame.
+  static constexpr uint8_t kControlUIFrame = 0x03;
+
+  // The protocol id for frames with no layer 3 protocol.
+  static constexpr uint8_t kProtocolIdNone = 0xf0;
+
+  // Parses the supplied frame. Returns true if the frame is well formed.
+  bool Parse(const uint8_t* data, size_t size);
+
+  // Returns the destination address.
+  const AX25AddressView& GetDestination() const { return destination_; }
+
+  // Returns the source address.
+  const AX25AddressView& GetSource() const { return source_; }
+
+  // Returns the number of digipeater addresses.
+  size_t GetDigipeaterCount() const { return digipeater_count_; }
+
+  // Returns a digipeater address.
+  const AX25AddressView& GetDigipeater(size_t index) const {
+    return digipeaters_[index];
+  }
+
+  // Returns the control field.
+  uint8_t GetControl() const { return control_; }
+
+  // Returns the protocol id, or zero for frames that do not carry one.
+  uint8_t GetProtocolId() const { return protocol_id_; }
+
+  // Returns true if this is a UI frame with no layer 3 protocol, as used by
+  // APRS.
+  bool IsAPRSFrame() const {
+    return control_ == kControlUIFrame && protocol_id_ == kProtocolIdNone;
+  }
+
+  // Returns the information field.
+  const uint8_t* GetInfo() const { return info_; }
+
+  // Returns the size of the information field.
+  size_t GetInfoSize() const { return info_size_; }
+
+  // Populates the addresses and payload of an APRS frame. Returns false if
+  // this is not an APRS frame.
+  bool ToAPRSFrame(CallsignConfig* source, CallsignConfig* destination,
+      std::vector<CallsignConfig>* digipeaters, std::string* payload) const;
+
+ private:
+  // The destination address.
+  AX25AddressView destination_;
+
+  // The source address.
+  AX25AddressView source_;
+
+  // The digipeater addresses.
+  AX25AddressView digipeaters_[kMaxDigipeaterCount];
+
+  // The number of valid entries in digipeaters_.
+  size_t digipeater_count_;
+
+  // The control field.
+  uint8_t control_;
+
+  // The protocol id.
+  uint8_t protocol_id_;
+
+  // The information field.
+  const uint8_t* info_;
+
+  // The size of the information field.
+  size_t info_size_;
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_AX25_FRAME_VIEW_H_
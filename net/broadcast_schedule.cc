@@ -0,0 +1,58 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/broadcast_schedule.h"
+
+#include <algorithm>
+
+namespace au {
+
+std::vector<BroadcastSchedule::Transmission> BroadcastSchedule::Interleave(
+    const std::vector<size_t>& chunk_counts, size_t retransmit_count) {
+  size_t max_chunk_count = 0;
+  for (size_t chunk_count : chunk_counts) {
+    max_chunk_count = std::max(max_chunk_count, chunk_count);
+  }
+
+  std::vector<Transmission> schedule;
+  for (size_t i = 1; i <= retransmit_count; i++) {
+    for (size_t chunk = 0; chunk < max_chunk_count; chunk++) {
+      for (size_t packet = 0; packet < chunk_counts.size(); packet++) {
+        if (chunk < chunk_counts[packet]) {
+          schedule.push_back({packet, chunk, static_cast<uint32_t>(i)});
+        }
+      }
+    }
+  }
+
+  return schedule;
+}
+
+std::vector<BroadcastSchedule::Transmission> BroadcastSchedule::Sequential(
+    const std::vector<size_t>& chunk_counts, size_t retransmit_count) {
+  std::vector<Transmission> schedule;
+  for (size_t packet = 0; packet < chunk_counts.size(); packet++) {
+    for (size_t i = 1; i <= retransmit_count; i++) {
+      for (size_t chunk = 0; chunk < chunk_counts[packet]; chunk++) {
+        schedule.push_back({packet, chunk, static_cast<uint32_t>(i)});
+      }
+    }
+  }
+
+  return schedule;
+}
+
+}  // namespace au
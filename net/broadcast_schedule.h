@@ -0,0 +1,60 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_BROADCAST_SCHEDULE_H_
+#define APRS_UTILS_NET_BROADCAST_SCHEDULE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace au {
+
+// Orders the transmissions of the chunks of many broadcast packets so that a
+// burst of interference does not destroy every copy of a chunk. Each round
+// sends every chunk of every packet once, taking one chunk from each packet in
+// turn, and the rounds repeat in the same order. The copies of a chunk are
+// then as far apart as the whole transfer allows, and neighboring frames
+// belong to different packets.
+class BroadcastSchedule {
+ public:
+  // A single transmission of a chunk.
+  struct Transmission {
+    // The index of the packet that the chunk belongs to.
+    size_t packet_index;
+
+    // The index of the chunk within its packet.
+    size_t chunk_index;
+
+    // The index of the copy of the chunk, starting from 1.
+    uint32_t retransmit_id;
+  };
+
+  // Returns the interleaved transmissions of packets with the supplied number
+  // of chunks each, with every chunk sent the retransmit count times.
+  static std::vector<Transmission> Interleave(
+      const std::vector<size_t>& chunk_counts, size_t retransmit_count);
+
+  // Returns the transmissions in the order that packets were sent before
+  // interleaving, where all copies of one packet are sent before the next.
+  // This is used to compare against the interleaved order.
+  static std::vector<Transmission> Sequential(
+      const std::vector<size_t>& chunk_counts, size_t retransmit_count);
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_BROADCAST_SCHEDULE_H_
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/compact_chunk_header.h"
+
+#include <algorithm>
+
+#include "util/log.h"
+
+#define LOG_TAG "CompactChunkHeader"
+
+namespace au {
+namespace {
+
+// The flags of the header.
+constexpr uint8_t kFlagAckRequested = 1 << 0;
+constexpr uint8_t kFlagSingleFrame = 1 << 1;
+constexpr uint8_t kFlagTotalPayloadSize = 1 << 2;
+constexpr uint8_t kFlagErasureCoded = 1 << 3;
+
+// The largest retransmit id that is encoded.
+constexpr uint32_t kMaxRetransmitId = 15;
+
+// The size of the marker, flags and payload id.
+constexpr size_t kFixedHeaderSize = 4;
+
+// Returns true if the chunk is a whole payload that fits in a single frame.
+bool IsSingleFrame(const PacketChunk::Chunk& chunk) {
+  return chunk.chunk_id() == 1 && !chunk.has_fec_source_count()
+      && chunk.total_payload_size() == chunk.payload().size();
+}
+
+// Returns the size of a value encoded as a varint.
+size_t GetVarintSize(uint32_t value) {
+  size_t size = 1;
+  for (; value >= 0x80; value >>= 7) {
+    size++;
+  }
+
+  return size;
+}
+
+// Appends a value encoded as a varint.
+void AppendVarint(uint32_t value, std::string* output) {
+  for (; value >= 0x80; value >>= 7) {
+    output->push_back(static_cast<char>((value & 0x7f) | 0x80));
+  }
+
+  output->push_back(static_cast<char>(value));
+}
+
+// Reads a varint at the offset and advances it. Returns false if the data is
+// truncated or the value does not fit in 32 bits.
+bool ReadVarint(const std::string& data, size_t* offset, uint32_t* value) {
+  *value = 0;
+  for (uint32_t shift = 0; shift < 32; shift += 7) {
+    if (*offset >= data.size()) {
+      return false;
+    }
+
+    uint8_t byte = data[(*offset)++];
+    *value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+}  // anonymous namespace
+
+bool CompactChunkHeader::IsCompact(const std::string& data) {
+  return !data.empty() && (static_cast<uint8_t>(data[0]) & 0xf0) == kMarker;
+}
+
+bool CompactChunkHeader::CanEncode(const PacketChunk::Chunk& chunk) {
+  // Erasure coded chunks must carry their symbol id as the chunk id minus one
+  // and the total size, which is how they are built.
+  return chunk.has_payload_id() && chunk.payload_id() <= kMaxPayloadId
+      && chunk.has_chunk_id() && chunk.has_payload()
+      && (!chunk.has_fec_source_count()
+          || (chunk.has_total_payload_size() && chunk.has_fec_symbol_id()
+              && chunk.fec_symbol_id() + 1 == chunk.chunk_id()));
+}
+
+size_t CompactChunkHeader::GetEncodedSize(const PacketChunk::Chunk& chunk) {
+  size_t size = kFixedHeaderSize + chunk.payload().size();
+  if (IsSingleFrame(chunk)) {
+    return size;
+  }
+
+  size += GetVarintSize(chunk.chunk_id());
+  if (chunk.has_total_payload_size()) {
+    size += GetVarintSize(chunk.total_payload_size());
+  }
+
+  if (chunk.has_fec_source_count()) {
+    size += GetVarintSize(chunk.fec_source_count());
+  }
+
+  return size;
+}
+
+bool CompactChunkHeader::Encode(const PacketChunk::Chunk& chunk,
+    std::string* output) {
+  if (!CanEncode(chunk)) {
+    return false;
+  }
+
+  uint8_t flags = 0;
+  if (chunk.ack_requested()) {
+    flags |= kFlagAckRequested;
+  }
+
+  bool single_frame = IsSingleFrame(chunk);
+  if (single_frame) {
+    flags |= kFlagSingleFrame;
+  } else if (chunk.has_total_payload_size()) {
+    flags |= kFlagTotalPayloadSize;
+  }
+
+  if (chunk.has_fec_source_count()) {
+    flags |= kFlagErasureCoded;
+  }
+
+  uint32_t retransmit_id = std::min(chunk.retransmit_id(), kMaxRetransmitId);
+  output->clear();
+  output->push_back(static_cast<char>(kMarker | kVersion));
+  output->push_back(static_cast<char>(flags | (retransmit_id << 4)));
+  output->push_back(static_cast<char>(chunk.payload_id() >> 8));
+  output->push_back(static_cast<char>(chunk.payload_id() & 0xff));
+  if (!single_frame) {
+    AppendVarint(chunk.chunk_id(), output);
+    if (chunk.has_total_payload_size()) {
+      AppendVarint(chunk.total_payload_size(), output);
+    }
+
+    if (chunk.has_fec_source_count()) {
+      AppendVarint(chunk.fec_source_count(), output);
+    }
+  }
+
+  output->append(chunk.payload());
+  return true;
+}
+
+bool CompactChunkHeader::Decode(const std::string& data,
+    PacketChunk::Chunk* chunk) {
+  if (data.size() < kFixedHeaderSize || !IsCompact(data)) {
+    LOGE("received truncated compact chunk");
+    return false;
+  }
+
+  uint8_t version = data[0] & 0x0f;
+  if (version != kVersion) {
+    LOGE("received compact chunk of unsupported version %u", version);
+    return false;
+  }
+
+  uint8_t flags = data[1] & 0x0f;
+  chunk->Clear();
+  chunk->set_payload_id((static_cast<uint8_t>(data[2]) << 8)
+      | static_cast<uint8_t>(data[3]));
+  chunk->set_retransmit_id(static_cast<uint8_t>(data[1]) >> 4);
+  if ((flags & kFlagAckRequested) != 0) {
+    chunk->set_ack_requested(true);
+  }
+
+  size_t offset = kFixedHeaderSize;
+  uint32_t value;
+  if ((flags & kFlagSingleFrame) != 0) {
+    chunk->set_chunk_id(1);
+    chunk->set_total_payload_size(data.size() - offset);
+  } else {
+    if (!ReadVarint(data, &offset, &value)) {
+      LOGE("received compact chunk with truncated chunk id");
+      return false;
+    }
+
+    chunk->set_chunk_id(value);
+    if ((flags & kFlagTotalPayloadSize) != 0) {
+      if (!ReadVarint(data, &offset, &value)) {
+        LOGE("received compact chunk with truncated total size");
+        return false;
+      }
+
+      chunk->set_total_payload_size(value);
+    }
+  }
+
+  if ((flags & kFlagErasureCoded) != 0) {
+    if (!ReadVarint(data, &offset, &value) || chunk->chunk_id() == 0) {
+      LOGE("received compact chunk with invalid erasure code");
+      return false;
+    }
+
+    chunk->set_fec_source_count(value);
+    chunk->set_fec_symbol_id(chunk->chunk_id() - 1);
+  }
+
+  chunk->set_payload(data.substr(offset));
+  return true;
+}
+
+}  // namespace au
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_COMPACT_CHUNK_HEADER_H_
+#define APRS_UTILS_NET_COMPACT_CHUNK_HEADER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "proto/packet.pb.h"
+
+namespace au {
+
+// A compact binary encoding of a PacketChunk::Chunk that replaces the tags and
+// length prefixes of the protobuf encoding with a bit-packed header. The
+// encoding is versioned and laid out as:
+//
+//   byte 0      The marker in the upper four bits and the version in the
+//               lower four bits. The marker is never the first byte of a
+//               serialized PacketChunk, so both encodings may share a channel.
+//   byte 1      The flags in the lower four bits and the retransmit id,
+//               saturated at 15, in the upper four bits.
+//   bytes 2-3   The payload id, big endian. Payload ids are 16 bits and are
+//               scoped to the source callsign by the receiver.
+//   varint      The chunk id, unless the payload fits in a single frame.
+//   varint      The total payload size, if the flags say it is present.
+//   varint      The FEC source count for erasure coded chunks. The symbol id
+//               is the chunk id minus one.
+//   remainder   The payload.
+//
+// A payload that fits in a single frame omits the chunk id and the total
+// size, which are one and the size of the payload.
+class CompactChunkHeader {
+ public:
+  // The version of the encoding that is written.
+  static constexpr uint8_t kVersion = 1;
+
+  // The marker in the upper bits of the first byte.
+  static constexpr uint8_t kMarker = 0xc0;
+
+  // The largest payload id that may be encoded.
+  static constexpr uint32_t kMaxPayloadId = 0xffff;
+
+  // Returns true if the serialized data is in the compact encoding of any
+  // version, rather than a serialized PacketChunk.
+  static bool IsCompact(const std::string& data);
+
+  // Returns true if the chunk can be represented in the compact encoding.
+  static bool CanEncode(const PacketChunk::Chunk& chunk);
+
+  // Returns the size of the compact encoding of a chunk that can be encoded.
+  static size_t GetEncodedSize(const PacketChunk::Chunk& chunk);
+
+  // Encodes the chunk into the output, replacing its contents. Returns false
+  // if the chunk cannot be represented in the compact encoding.
+  static bool Encode(const PacketChunk::Chunk& chunk, std::string* output);
+
+  // Decodes the compact encoding of a chunk. Returns false if the data is
+  // truncated or of an unsupported version.
+  static bool Decode(const std::string& data, PacketChunk::Chunk* chunk);
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_COMPACT_CHUNK_HEADER_H_
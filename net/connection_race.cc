@@ -0,0 +1,153 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/connection_race.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <poll.h>
+
+#include "util/log.h"
+#include "util/time.h"
+
+#define LOG_TAG "ConnectionRace"
+
+namespace au {
+
+ConnectionRace::ConnectionRace(const LineHandler& line_handler,
+    uint32_t attempt_delay_ms, uint32_t timeout_ms)
+    : line_handler_(line_handler),
+      attempt_delay_ms_(attempt_delay_ms),
+      timeout_ms_(timeout_ms) {}
+
+bool ConnectionRace::Connect(const std::string& hostname, uint16_t port,
+    TCPSocket* socket, LineReader* line_reader) {
+  std::vector<TCPSocket::Address> addresses;
+  if (!TCPSocket::Resolve(hostname, port, &addresses)) {
+    return false;
+  }
+
+  std::vector<std::unique_ptr<Attempt>> attempts;
+  std::vector<struct pollfd> poll_fds;
+  size_t next_address = 0;
+  uint64_t time_now_us = GetTimeNowUs();
+  uint64_t next_attempt_time_us = time_now_us;
+  uint64_t deadline_us = time_now_us
+      + static_cast<uint64_t>(timeout_ms_) * 1000;
+  while (true) {
+    time_now_us = GetTimeNowUs();
+    if (next_address < addresses.size()
+        && time_now_us >= next_attempt_time_us) {
+      auto attempt = std::make_unique<Attempt>();
+      attempt->address = addresses[next_address++];
+      attempt->connected = false;
+      attempt->line_count = 0;
+      LOGV("connecting to %s", attempt->address.ToString().c_str());
+      if (attempt->socket.StartConnect(attempt->address)) {
+        attempts.push_back(std::move(attempt));
+        next_attempt_time_us = time_now_us
+            + static_cast<uint64_t>(attempt_delay_ms_) * 1000;
+      }
+
+      continue;
+    } else if (attempts.empty() && next_address == addresses.size()) {
+      LOGE("all %zu connection attempts to %s failed", addresses.size(),
+          hostname.c_str());
+      return false;
+    } else if (time_now_us >= deadline_us) {
+      LOGE("timeout connecting to %s", hostname.c_str());
+      return false;
+    }
+
+    // Wait until an attempt is ready or it is time to start the next one.
+    uint64_t wake_time_us = deadline_us;
+    if (next_address < addresses.size()) {
+      wake_time_us = std::min(wake_time_us, next_attempt_time_us);
+    }
+
+    poll_fds.resize(attempts.size());
+    for (size_t i = 0; i < attempts.size(); i++) {
+      poll_fds[i].fd = attempts[i]->socket.GetFileDescriptor();
+      poll_fds[i].events = attempts[i]->connected ? POLLIN : POLLOUT;
+      poll_fds[i].revents = 0;
+    }
+
+    int wait_ms = (wake_time_us - time_now_us + 999) / 1000;
+    if (poll(poll_fds.data(), poll_fds.size(), wait_ms) < 0
+        && errno != EINTR) {
+      LOGE("failed to poll sockets: %s (%d)", strerror(errno), errno);
+      return false;
+    }
+
+    // Handle the ready attempts, removing those that have failed.
+    size_t attempt_count = 0;
+    for (size_t i = 0; i < attempts.size(); i++) {
+      int result = 0;
+      if (poll_fds[i].revents != 0) {
+        result = HandleReady(attempts[i].get());
+      }
+
+      if (result > 0) {
+        LOGI("connected to %s", attempts[i]->address.ToString().c_str());
+        socket->Swap(&attempts[i]->socket);
+        line_reader->Swap(&attempts[i]->line_reader);
+        return true;
+      } else if (result == 0) {
+        attempts[attempt_count++] = std::move(attempts[i]);
+      } else {
+        // Start the next attempt rather than waiting out the delay.
+        next_attempt_time_us = time_now_us;
+      }
+    }
+
+    attempts.resize(attempt_count);
+  }
+}
+
+int ConnectionRace::HandleReady(Attempt* attempt) {
+  if (!attempt->connected) {
+    if (!attempt->socket.FinishConnect()) {
+      LOGE("failed to connect to %s", attempt->address.ToString().c_str());
+      return -1;
+    }
+
+    attempt->connected = true;
+    return 0;
+  }
+
+  if (attempt->line_reader.Read(&attempt->socket) < 0) {
+    LOGE("connection to %s failed during setup",
+        attempt->address.ToString().c_str());
+    return -1;
+  }
+
+  std::string_view line;
+  while (attempt->line_reader.GetLine(&line)) {
+    int result = line_handler_(&attempt->socket, attempt->line_count++, line);
+    if (result != 0) {
+      return result;
+    }
+  }
+
+  return 0;
+}
+
+}  // namespace au
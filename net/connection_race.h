@@ -0,0 +1,102 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_CONNECTION_RACE_H_
+#define APRS_UTILS_NET_CONNECTION_RACE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "net/line_reader.h"
+#include "net/tcp_socket.h"
+#include "util/non_copyable.h"
+
+namespace au {
+
+// Races connections to all of the addresses of a host in the style of Happy
+// Eyeballs (RFC 8305). Attempts are started in the order returned by
+// TCPSocket::Resolve, each after a short delay or as soon as the previous one
+// fails, and run concurrently. Each connection then performs a line based
+// setup, such as reading a banner and logging in, and the first one to
+// complete it wins. A dead or slow address only delays the connection by the
+// attempt delay.
+class ConnectionRace : public NonCopyable {
+ public:
+  // Handles a line received by an attempt during setup. This is invoked with
+  // the index of the line within the attempt so that the handler does not
+  // need to track the state of each attempt, and may write to the socket.
+  // Returns 1 if setup is complete, 0 to wait for more lines and -1 if the
+  // attempt has failed.
+  typedef std::function<int(TCPSocket* socket, size_t line_index,
+      std::string_view line)> LineHandler;
+
+  // The default time in milliseconds to wait before starting the next
+  // attempt, as recommended by RFC 8305.
+  static constexpr uint32_t kDefaultAttemptDelayMs = 250;
+
+  // The default time in milliseconds to wait for any attempt to complete.
+  static constexpr uint32_t kDefaultTimeoutMs = 10000;
+
+  // Setup the race with the handler that performs setup on each connection.
+  ConnectionRace(const LineHandler& line_handler,
+      uint32_t attempt_delay_ms = kDefaultAttemptDelayMs,
+      uint32_t timeout_ms = kDefaultTimeoutMs);
+
+  // Races connections to the supplied host and port. Returns true if an
+  // attempt completed setup, and populates the socket with its connection and
+  // the line reader with any bytes that were received after setup.
+  bool Connect(const std::string& hostname, uint16_t port, TCPSocket* socket,
+      LineReader* line_reader);
+
+ private:
+  // A connection attempt to one address.
+  struct Attempt {
+    // The address being connected to.
+    TCPSocket::Address address;
+
+    // The connection to the address.
+    TCPSocket socket;
+
+    // Splits the bytes received during setup into lines.
+    LineReader line_reader;
+
+    // Set to true once the connection has been established.
+    bool connected;
+
+    // The number of lines handled during setup.
+    size_t line_count;
+  };
+
+  // Performs setup on each connection.
+  const LineHandler line_handler_;
+
+  // The time in milliseconds to wait before starting the next attempt.
+  const uint32_t attempt_delay_ms_;
+
+  // The time in milliseconds to wait for any attempt to complete.
+  const uint32_t timeout_ms_;
+
+  // Handles an attempt whose socket has become ready. Returns 1 if setup is
+  // complete, 0 if the attempt is still in progress and -1 if it has failed.
+  int HandleReady(Attempt* attempt);
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_CONNECTION_RACE_H_
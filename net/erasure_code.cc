@@ -0,0 +1,204 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/erasure_code.h"
+
+#include <array>
+#include <utility>
+
+#include "util/log.h"
+
+#define LOG_TAG "ErasureCode"
+
+namespace au {
+namespace {
+
+// The primitive polynomial used to generate the field.
+constexpr uint16_t kPrimitivePolynomial = 0x11d;
+
+// Logarithm and exponent tables of the field. The exponent table is doubled to
+// avoid reducing the sum of two logarithms.
+struct FieldTables {
+  std::array<uint8_t, 256> log;
+  std::array<uint8_t, 512> exp;
+
+  FieldTables() : log(), exp() {
+    uint16_t value = 1;
+    for (size_t i = 0; i < 255; i++) {
+      exp[i] = value;
+      exp[i + 255] = value;
+      log[value] = i;
+      value <<= 1;
+      if (value & 0x100) {
+        value ^= kPrimitivePolynomial;
+      }
+    }
+  }
+};
+
+const FieldTables& GetFieldTables() {
+  static const FieldTables tables;
+  return tables;
+}
+
+}  // anonymous namespace
+
+uint8_t ErasureCode::GetCoefficient(size_t source_count, size_t symbol_id,
+    size_t source_index) {
+  if (symbol_id < source_count) {
+    return symbol_id == source_index ? 1 : 0;
+  }
+
+  // The Cauchy matrix entry 1 / (x + y), where the x of each repair symbol is
+  // its id and the y of each source symbol is its index. These never
+  // coincide, so the sum is never zero.
+  return Inverse(symbol_id ^ source_index);
+}
+
+void ErasureCode::EncodeRepairSymbol(const std::vector<std::string>& source,
+    size_t symbol_id, std::string* repair) {
+  size_t symbol_size = source.empty() ? 0 : source.front().size();
+  repair->assign(symbol_size, '\0');
+  auto* repair_bytes = reinterpret_cast<uint8_t*>(&(*repair)[0]);
+  for (size_t i = 0; i < source.size(); i++) {
+    MultiplyAdd(GetCoefficient(source.size(), symbol_id, i),
+        reinterpret_cast<const uint8_t*>(source[i].data()), repair_bytes,
+        symbol_size);
+  }
+}
+
+uint8_t ErasureCode::Multiply(uint8_t a, uint8_t b) {
+  if (a == 0 || b == 0) {
+    return 0;
+  }
+
+  const auto& tables = GetFieldTables();
+  return tables.exp[tables.log[a] + tables.log[b]];
+}
+
+uint8_t ErasureCode::Inverse(uint8_t a) {
+  const auto& tables = GetFieldTables();
+  return tables.exp[255 - tables.log[a]];
+}
+
+void ErasureCode::MultiplyAdd(uint8_t coefficient, const uint8_t* source,
+    uint8_t* destination, size_t size) {
+  if (coefficient == 0) {
+    return;
+  } else if (coefficient == 1) {
+    for (size_t i = 0; i < size; i++) {
+      destination[i] ^= source[i];
+    }
+
+    return;
+  }
+
+  // Multiplying by a constant is a lookup in the exponent table offset by its
+  // logarithm.
+  const auto& tables = GetFieldTables();
+  const uint8_t* exp = &tables.exp[tables.log[coefficient]];
+  for (size_t i = 0; i < size; i++) {
+    if (source[i] != 0) {
+      destination[i] ^= exp[tables.log[source[i]]];
+    }
+  }
+}
+
+ErasureDecoder::ErasureDecoder(size_t source_count, size_t symbol_size)
+    : source_count_(source_count),
+      symbol_size_(symbol_size),
+      rows_(source_count),
+      rank_(0) {}
+
+bool ErasureDecoder::AddSymbol(size_t symbol_id, const std::string& data) {
+  if (symbol_id >= ErasureCode::kMaxSymbolCount) {
+    LOGE("invalid symbol id %zu", symbol_id);
+    return false;
+  } else if (data.size() > symbol_size_) {
+    LOGE("symbol of %zu bytes exceeds symbol size %zu", data.size(),
+        symbol_size_);
+    return false;
+  } else if (IsComplete()) {
+    return false;
+  }
+
+  Row row;
+  row.coefficients.resize(source_count_);
+  for (size_t i = 0; i < source_count_; i++) {
+    row.coefficients[i] = ErasureCode::GetCoefficient(source_count_,
+        symbol_id, i);
+  }
+
+  row.data.assign(data.begin(), data.end());
+  row.data.resize(symbol_size_);
+
+  // Eliminate the leading symbols of the rows that have been received. These
+  // are fully reduced, so eliminating one does not disturb the others.
+  for (size_t i = 0; i < source_count_; i++) {
+    uint8_t coefficient = row.coefficients[i];
+    if (coefficient != 0 && !rows_[i].coefficients.empty()) {
+      ErasureCode::MultiplyAdd(coefficient, rows_[i].coefficients.data(),
+          row.coefficients.data(), source_count_);
+      ErasureCode::MultiplyAdd(coefficient, rows_[i].data.data(),
+          row.data.data(), symbol_size_);
+    }
+  }
+
+  size_t pivot = 0;
+  while (pivot < source_count_ && row.coefficients[pivot] == 0) {
+    pivot++;
+  }
+
+  if (pivot == source_count_) {
+    return false;
+  }
+
+  // Normalize the row so that it leads with one, then eliminate its leading
+  // symbol from the other rows to keep them fully reduced.
+  uint8_t scale = ErasureCode::Inverse(row.coefficients[pivot]);
+  for (auto& coefficient : row.coefficients) {
+    coefficient = ErasureCode::Multiply(coefficient, scale);
+  }
+
+  for (auto& byte : row.data) {
+    byte = ErasureCode::Multiply(byte, scale);
+  }
+
+  for (auto& other : rows_) {
+    uint8_t coefficient = other.coefficients.empty()
+        ? 0 : other.coefficients[pivot];
+    if (coefficient != 0) {
+      ErasureCode::MultiplyAdd(coefficient, row.coefficients.data(),
+          other.coefficients.data(), source_count_);
+      ErasureCode::MultiplyAdd(coefficient, row.data.data(),
+          other.data.data(), symbol_size_);
+    }
+  }
+
+  rows_[pivot] = std::move(row);
+  rank_++;
+  return true;
+}
+
+void ErasureDecoder::GetSource(std::string* payload) const {
+  payload->clear();
+  payload->reserve(source_count_ * symbol_size_);
+  for (const auto& row : rows_) {
+    payload->append(row.data.begin(), row.data.end());
+  }
+}
+
+}  // namespace au
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_ERASURE_CODE_H_
+#define APRS_UTILS_NET_ERASURE_CODE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "util/non_copyable.h"
+
+namespace au {
+
+// A systematic Reed-Solomon erasure code over GF(2^8). A payload is split into
+// source symbols of equal size that are sent as they are, followed by any
+// number of repair symbols that are combinations of all of the source symbols.
+// The repair symbols are the rows of a Cauchy matrix, so any source_count of
+// the symbols are enough to recover the payload.
+class ErasureCode {
+ public:
+  // The maximum number of source and repair symbols for one payload.
+  static constexpr size_t kMaxSymbolCount = 255;
+
+  // Returns the coefficient of a source symbol in the supplied symbol. This is
+  // one for the source symbol itself and zero for the others if the symbol is
+  // a source symbol.
+  static uint8_t GetCoefficient(size_t source_count, size_t symbol_id,
+      size_t source_index);
+
+  // Computes a repair symbol from the source symbols, which must all be the
+  // same size. The symbol id must be at least the number of source symbols.
+  static void EncodeRepairSymbol(const std::vector<std::string>& source,
+      size_t symbol_id, std::string* repair);
+
+  // Returns the product of two elements.
+  static uint8_t Multiply(uint8_t a, uint8_t b);
+
+  // Returns the multiplicative inverse of a non-zero element.
+  static uint8_t Inverse(uint8_t a);
+
+  // Adds the product of a coefficient and the source bytes to the destination
+  // bytes.
+  static void MultiplyAdd(uint8_t coefficient, const uint8_t* source,
+      uint8_t* destination, size_t size);
+};
+
+// Recovers the source symbols of an erasure coded payload from any symbols as
+// they are received. Each symbol is eliminated against those received before
+// it, so the payload is available as soon as enough symbols have arrived.
+class ErasureDecoder : public NonCopyable {
+ public:
+  // Setup the decoder for the supplied number of source symbols and size of
+  // each symbol.
+  ErasureDecoder(size_t source_count, size_t symbol_size);
+
+  // Returns the number of source symbols.
+  size_t GetSourceCount() const { return source_count_; }
+
+  // Returns the size of each symbol.
+  size_t GetSymbolSize() const { return symbol_size_; }
+
+  // Adds a symbol, which is padded with zeros if it is shorter than the symbol
+  // size. Returns false if the symbol is invalid or does not add any
+  // information.
+  bool AddSymbol(size_t symbol_id, const std::string& data);
+
+  // Returns the number of symbols that have added information so far.
+  size_t GetRank() const { return rank_; }
+
+  // Returns true once the source symbols can be recovered.
+  bool IsComplete() const { return rank_ == source_count_; }
+
+  // Populates the concatenated source symbols, including any padding. The
+  // decoder must be complete.
+  void GetSource(std::string* payload) const;
+
+ private:
+  // A symbol that has been reduced against the others.
+  struct Row {
+    // The coefficients of the source symbols in this row.
+    std::vector<uint8_t> coefficients;
+
+    // The combination of source symbols described by the coefficients.
+    std::vector<uint8_t> data;
+  };
+
+  // The number of source symbols.
+  const size_t source_count_;
+
+  // The size of each symbol.
+  const size_t symbol_size_;
+
+  // The reduced rows, indexed by the source symbol that they lead with, or
+  // empty if no row leads with that symbol yet.
+  std::vector<Row> rows_;
+
+  // The number of rows that have been populated.
+  size_t rank_;
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_ERASURE_CODE_H_
@@ -0,0 +1,258 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/event_loop.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "util/log.h"
+
+#define LOG_TAG "EventLoop"
+
+namespace au {
+
+EventLoop::EventLoop()
+    : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+      running_(false) {
+  if (epoll_fd_ < 0) {
+    LOGFATAL("failed to create epoll instance: %s (%d)",
+        strerror(errno), errno);
+  }
+}
+
+EventLoop::~EventLoop() {
+  close(epoll_fd_);
+}
+
+void EventLoop::AddFileDescriptor(int fd, Handler handler) {
+  AddRegistration(fd, {handler, /*aprs_interface=*/nullptr});
+}
+
+void EventLoop::RemoveFileDescriptor(int fd) {
+  if (handlers_.erase(fd) > 0 && fd >= 0) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  }
+}
+
+void EventLoop::RemoveInterface(int fd, APRSInterface* aprs_interface) {
+  auto handlers_it = handlers_.find(fd);
+  if (handlers_it == handlers_.end()) {
+    return;
+  }
+
+  auto& registrations = handlers_it->second;
+  for (auto it = registrations.begin(); it != registrations.end();) {
+    if (it->aprs_interface == aprs_interface) {
+      it = registrations.erase(it);
+    } else {
+      it++;
+    }
+  }
+
+  if (registrations.empty()) {
+    RemoveFileDescriptor(fd);
+  }
+}
+
+void EventLoop::AddInterface(APRSInterface* aprs_interface,
+    APRSInterface::FrameCallback callback) {
+  AddRegistration(aprs_interface->GetFileDescriptor(), {
+      [aprs_interface, callback]() {
+        return aprs_interface->ReceiveAvailable(callback);
+      }, aprs_interface});
+}
+
+void EventLoop::AddRegistration(int fd, const Registration& registration) {
+  auto handlers_it = handlers_.find(fd);
+  if (handlers_it != handlers_.end()) {
+    handlers_it->second.push_back(registration);
+    return;
+  }
+
+  WatchFileDescriptor(fd);
+  handlers_[fd].push_back(registration);
+}
+
+void EventLoop::WatchFileDescriptor(int fd) {
+  if (fd < 0) {
+    // An interface that is restoring its connection is only dispatched once
+    // it needs to be serviced.
+    return;
+  }
+
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0 && errno != EEXIST) {
+    LOGFATAL("failed to add fd %d: %s (%d)", fd, strerror(errno), errno);
+  }
+}
+
+void EventLoop::FollowInterfaces(int fd) {
+  auto handlers_it = handlers_.find(fd);
+  if (handlers_it == handlers_.end()) {
+    return;
+  }
+
+  std::vector<Registration> moved;
+  bool has_interface = false;
+  auto& registrations = handlers_it->second;
+  for (auto it = registrations.begin(); it != registrations.end();) {
+    if (it->aprs_interface == nullptr) {
+      it++;
+    } else if (it->aprs_interface->GetFileDescriptor() != fd) {
+      moved.push_back(*it);
+      it = registrations.erase(it);
+    } else {
+      has_interface = true;
+      it++;
+    }
+  }
+
+  if (registrations.empty()) {
+    RemoveFileDescriptor(fd);
+  } else if (has_interface) {
+    // A connection that was replaced may have reused the same descriptor, in
+    // which case epoll dropped it when the old connection was closed.
+    WatchFileDescriptor(fd);
+  }
+
+  for (const auto& registration : moved) {
+    int new_fd = registration.aprs_interface->GetFileDescriptor();
+    LOGI("following interface from fd %d to fd %d", fd, new_fd);
+    AddRegistration(new_fd, registration);
+  }
+}
+
+void EventLoop::Dispatch(int fd) {
+  auto handlers_it = handlers_.find(fd);
+  if (handlers_it == handlers_.end()) {
+    // Removed by an earlier handler in this dispatch.
+    return;
+  }
+
+  // The handlers are copied as they may remove themselves from the loop.
+  std::vector<Registration> registrations = handlers_it->second;
+  for (const auto& registration : registrations) {
+    if (registration.handler()) {
+      continue;
+    } else if (fd < 0) {
+      // Interfaces without a connection share no file descriptor, so only
+      // the interface that failed is removed.
+      LOGE("removing failed interface without a connection");
+      RemoveInterface(fd, registration.aprs_interface);
+      continue;
+    }
+
+    LOGE("removing failed fd %d", fd);
+    RemoveFileDescriptor(fd);
+    return;
+  }
+
+  FollowInterfaces(fd);
+}
+
+int EventLoop::GetServiceTimeoutMs(int timeout_ms) const {
+  for (const auto& [fd, registrations] : handlers_) {
+    for (const auto& registration : registrations) {
+      if (registration.aprs_interface == nullptr) {
+        continue;
+      }
+
+      for (int service_timeout_ms : {
+            registration.aprs_interface->GetServiceTimeoutMs(),
+            registration.aprs_interface->GetPendingChunkAckTimeoutMs()}) {
+        if (service_timeout_ms >= 0
+            && (timeout_ms < 0 || service_timeout_ms < timeout_ms)) {
+          timeout_ms = service_timeout_ms;
+        }
+      }
+    }
+  }
+
+  return timeout_ms;
+}
+
+void EventLoop::ServiceInterfaces() {
+  std::vector<int> fds;
+  for (const auto& [fd, registrations] : handlers_) {
+    for (const auto& registration : registrations) {
+      if (registration.aprs_interface != nullptr
+          && registration.aprs_interface->GetServiceTimeoutMs() == 0) {
+        fds.push_back(fd);
+        break;
+      }
+    }
+  }
+
+  for (int fd : fds) {
+    Dispatch(fd);
+  }
+}
+
+void EventLoop::SendPendingChunkAcks() {
+  for (const auto& [fd, registrations] : handlers_) {
+    for (const auto& registration : registrations) {
+      if (registration.aprs_interface != nullptr
+          && !registration.aprs_interface->SendPendingChunkAcks()) {
+        LOGE("failed to send chunk acks on fd %d", fd);
+      }
+    }
+  }
+}
+
+bool EventLoop::RunOnce(int timeout_ms) {
+  struct epoll_event events[kMaxEvents];
+  int event_count = epoll_wait(epoll_fd_, events, kMaxEvents,
+      GetServiceTimeoutMs(timeout_ms));
+  if (event_count < 0) {
+    if (errno == EINTR) {
+      return true;
+    }
+
+    LOGE("failed to wait for events: %s (%d)", strerror(errno), errno);
+    return false;
+  }
+
+  for (int i = 0; i < event_count; i++) {
+    Dispatch(events[i].data.fd);
+  }
+
+  ServiceInterfaces();
+  SendPendingChunkAcks();
+  return true;
+}
+
+bool EventLoop::Run() {
+  running_ = true;
+  while (running_ && !handlers_.empty()) {
+    if (!RunOnce(/*timeout_ms=*/-1)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void EventLoop::Stop() {
+  running_ = false;
+}
+
+}  // namespace au
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_EVENT_LOOP_H_
+#define APRS_UTILS_NET_EVENT_LOOP_H_
+
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "net/aprs_interface.h"
+#include "util/non_copyable.h"
+
+namespace au {
+
+// Waits on any number of connections from a single thread with epoll and
+// dispatches to handlers as they become readable.
+class EventLoop : public NonCopyable {
+ public:
+  // A handler that is invoked when a file descriptor is readable. Returns false
+  // if the file descriptor has failed and should be removed from the loop.
+  typedef std::function<bool()> Handler;
+
+  // Setup the event loop.
+  EventLoop();
+
+  // Release the epoll instance.
+  ~EventLoop();
+
+  // Adds a file descriptor to the loop, invoking the handler whenever it is
+  // readable. A file descriptor may be added more than once when it is shared,
+  // such as by the ports of one TNC, and each handler is invoked in turn.
+  void AddFileDescriptor(int fd, Handler handler);
+
+  // Removes a file descriptor from the loop.
+  void RemoveFileDescriptor(int fd);
+
+  // Adds an APRSInterface to the loop. The callback is invoked for every frame
+  // that the interface receives. If the interface replaces its connection, the
+  // loop follows the new file descriptor. An interface without a connection,
+  // which has a file descriptor of -1, is dispatched as given by
+  // APRSInterface::GetServiceTimeoutMs until it has reconnected.
+  void AddInterface(APRSInterface* aprs_interface,
+      APRSInterface::FrameCallback callback);
+
+  // Waits for file descriptors to become readable and dispatches them. A
+  // negative timeout waits indefinitely. The wait ends early when an interface
+  // needs to be serviced, as given by APRSInterface::GetServiceTimeoutMs, and
+  // the interface is then dispatched whether or not it is readable. Once
+  // dispatching is done, the interfaces send the acknowledgements that were
+  // queued while handling frames, and the wait also ends early when one of
+  // them may be sent. Returns false if waiting fails.
+  bool RunOnce(int timeout_ms);
+
+  // Dispatches events until Stop is called or there are no file descriptors
+  // left. Returns false if waiting fails.
+  bool Run();
+
+  // Stops the loop after the current dispatch completes.
+  void Stop();
+
+  // Returns true if there are no file descriptors in the loop, such as when
+  // they have all failed.
+  bool IsEmpty() const { return handlers_.empty(); }
+
+ private:
+  // The maximum number of events to dispatch per wait.
+  static constexpr int kMaxEvents = 32;
+
+  // A handler that has been added to the loop.
+  struct Registration {
+    // The handler to invoke.
+    Handler handler;
+
+    // The interface that the handler reads from, or nullptr if the handler was
+    // added for a plain file descriptor.
+    APRSInterface* aprs_interface;
+  };
+
+  // The epoll instance.
+  int epoll_fd_;
+
+  // The handlers for each file descriptor in the loop.
+  std::map<int, std::vector<Registration>> handlers_;
+
+  // Set to false to exit Run.
+  bool running_;
+
+  // Adds a registration for a file descriptor to the loop.
+  void AddRegistration(int fd, const Registration& registration);
+
+  // Removes the registrations of an interface from a file descriptor, and the
+  // file descriptor from the loop if no registrations are left.
+  void RemoveInterface(int fd, APRSInterface* aprs_interface);
+
+  // Adds a file descriptor to the epoll instance if it is not already added and
+  // is valid.
+  void WatchFileDescriptor(int fd);
+
+  // Invokes the handlers of a file descriptor, removing it from the loop if
+  // one fails.
+  void Dispatch(int fd);
+
+  // Returns the shortest time in milliseconds until an interface needs to be
+  // serviced, bounded by the supplied timeout. Negative values wait
+  // indefinitely.
+  int GetServiceTimeoutMs(int timeout_ms) const;
+
+  // Dispatches the file descriptors of interfaces that need to be serviced.
+  void ServiceInterfaces();
+
+  // Sends the acknowledgements queued by the interfaces in the loop.
+  void SendPendingChunkAcks();
+
+  // Moves the registrations of interfaces that have replaced their connection
+  // from the supplied file descriptor to the new one.
+  void FollowInterfaces(int fd);
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_EVENT_LOOP_H_
@@ -16,6 +16,11 @@
 
 #include "net/internet_aprs_interface.h"
 
+#include <chrono>
+#include <cinttypes>
+
+#include "net/connection_race.h"
+#include "net/tnc2_header_view.h"
 #include "util/log.h"
 #include "util/string.h"
 #include "util/time.h"
@@ -27,54 +32,65 @@ namespace au {
 InternetAPRSInterface::InternetAPRSInterface(
     const APRSInterface::Config& config,
     const CallsignConfig& callsign,
-    const std::string& hostname, uint16_t port)
-    : APRSInterface(config) {
-  IPaddress ip;
-  if (SDLNet_ResolveHost(&ip, hostname.c_str(), port) < 0) {
-    LOGFATAL("failed to resolve host: %s",
-        SDLNet_GetError());
+    const std::string& hostname, uint16_t port,
+    const std::string& filter)
+    : APRSInterface(config),
+      callsign_(callsign),
+      hostname_(hostname),
+      port_(port),
+      filter_(filter),
+      idle_timeout_ms_(kDefaultIdleTimeoutMs),
+      last_line_time_us_(0),
+      last_keepalive_time_us_(0),
+      next_connect_time_us_(0),
+      stopped_(false) {
+  if (!Connect()) {
+    LOGFATAL("failed to connect to server");
   }
+}
 
-  LOGI("connecting to %s:%" PRIu16, hostname.c_str(), port);
-  socket_ = SDLNet_TCP_Open(&ip);
-  if (!socket_) {
-    LOGFATAL("failed to open socket: %s",
-        SDLNet_GetError());
+InternetAPRSInterface::~InternetAPRSInterface() {
+  const auto& line_stats = line_reader_.GetStats();
+  LOGI("read %" PRIu64 " lines from %" PRIu64 " bytes in %" PRIu64
+      " reads, discarded %" PRIu64 " lines", line_stats.line_count,
+      line_stats.byte_count, line_stats.read_count,
+      line_stats.discarded_count);
+
+  if (line_filter_ != nullptr) {
+    const auto& filter_stats = line_filter_->GetStats();
+    LOGI("accepted %" PRIu64 " of %" PRIu64 " lines scanned",
+        filter_stats.accepted_count, filter_stats.scanned_count);
   }
 
-  // Setup the SocketSet.
-  socket_set_ = SDLNet_AllocSocketSet(1);
-  if (socket_set_ == nullptr) {
-    LOGFATAL("failed to init SocketSet: %s",
-        SDLNet_GetError());
-  }
+  const auto& stats = backoff_.GetStats();
+  LOGI("reconnected %" PRIu64 " times after %" PRIu64 " failed attempts, "
+      "%" PRIu64 "ms offline", stats.reconnect_count,
+      stats.failed_attempt_count, stats.downtime_us / 1000);
+}
 
-  if (SDLNet_TCP_AddSocket(socket_set_, socket_) < 0) {
-    LOGFATAL("failed to add socket: %s",
-        SDLNet_GetError());
-  }
+uint64_t InternetAPRSInterface::GetTimeSinceLastLineMs() const {
+  return (GetTimeNowUs() - last_line_time_us_) / 1000;
+}
 
-  LOGI("reading server version");
-  std::string server_version;
-  if (!ReadServerVersion(&server_version)) {
-    LOGFATAL("failed to read the server version");
-  }
+uint64_t InternetAPRSInterface::GetTimeSinceLastKeepaliveMs() const {
+  return (GetTimeNowUs() - last_keepalive_time_us_) / 1000;
+}
 
-  LOGI("Received server version: %s", StringFormatNonPrintables(
-        server_version).c_str());
-  if (!Authenticate(callsign)) {
-    LOGFATAL("failed to authenticate with the server");
-  }
+void InternetAPRSInterface::Stop() {
+  std::lock_guard<std::mutex> lock(stop_mutex_);
+  stopped_ = true;
+  stop_cv_.notify_all();
 }
 
-InternetAPRSInterface::~InternetAPRSInterface() {
-  SDLNet_FreeSocketSet(socket_set_);
-  SDLNet_TCP_Close(socket_);
+void InternetAPRSInterface::SetLineFilter(const std::string& destination,
+    char payload_prefix) {
+  line_filter_ = std::make_unique<APRSISLineFilter>(destination,
+      payload_prefix);
 }
 
-bool InternetAPRSInterface::Send(const std::string& payload,
-    const CallsignConfig& source, const CallsignConfig& destination,
-    const std::vector<CallsignConfig>& digipeaters) {
+bool InternetAPRSInterface::Send(const std::string& /*payload*/,
+    const CallsignConfig& /*source*/, const CallsignConfig& /*destination*/,
+    const std::vector<CallsignConfig>& /*digipeaters*/) {
   LOGE("sending via the internet is not supported");
   return false;
 }
@@ -83,138 +99,296 @@ bool InternetAPRSInterface::Receive(
     CallsignConfig* source, CallsignConfig* destination,
     std::vector<CallsignConfig>* digipeaters, std::string* payload,
     uint32_t timeout_ms) {
-  std::string packet;
+  std::string_view packet;
   while (packet.empty()) {
     if (!ReadLine(&packet, timeout_ms)) {
-      LOGE("failed to receive line");
+      if (!socket_.IsOpen()) {
+        if (!Reconnect()) {
+          return false;
+        }
+
+        continue;
+      }
+
+      LOGV("timeout receiving line");
       return false;
-    } else if (StringStartsWith(packet, "#")) {
-      LOGV("server sent informational packet: '%s", packet.c_str());
-      packet.clear();
+    } else if (!packet.empty() && packet[0] == '#') {
+      HandleComment(packet);
+      packet = std::string_view();
+    } else if (line_filter_ != nullptr && !line_filter_->Accept(packet)) {
+      packet = std::string_view();
     }
   }
 
-  auto separator_pos = packet.find('>');
-  if (separator_pos == std::string::npos) {
-    LOGE("packet missing source/destination separator: '%s'",
-        StringFormatNonPrintables(packet).c_str());
-    return false;
+  return ParseLine(packet, source, destination, digipeaters, payload);
+}
+
+int InternetAPRSInterface::GetFileDescriptor() const {
+  return socket_.GetFileDescriptor();
+}
+
+bool InternetAPRSInterface::ReceiveAvailable(const FrameCallback& callback) {
+  // A lost connection is restored by one attempt at a time so that the event
+  // loop is not blocked while waiting between attempts. Lines that arrived
+  // with the login are already buffered and would not wake the event loop, so
+  // they are read once connected.
+  if (!socket_.IsOpen()) {
+    Disconnect();
+    if (!ServiceReconnect()) {
+      return !IsStopped();
+    }
   }
 
-  if (!source->FromString(packet.substr(0, separator_pos))) {
-    LOGE("failed to parse source callsign: '%s'",
-        StringFormatNonPrintables(packet).c_str());
-    return false;
+  // The frame is reused between lines to avoid allocating for each of them.
+  std::string_view packet;
+  CallsignConfig source;
+  CallsignConfig destination;
+  std::vector<CallsignConfig> digipeaters;
+  std::string payload;
+  while (true) {
+    int read_result = ReadAvailableLine(&packet);
+    if (read_result == 0 && GetIdleTimeRemainingMs() == 0) {
+      LOGE("no lines received from server for %" PRIu64 "ms",
+          GetTimeSinceLastLineMs());
+      read_result = -1;
+    }
+
+    if (read_result < 0) {
+      // The event loop services the interface until it has reconnected and
+      // then follows the new file descriptor.
+      Disconnect();
+      return !IsStopped();
+    } else if (read_result == 0) {
+      return true;
+    } else if (packet.empty()) {
+      continue;
+    } else if (packet[0] == '#') {
+      HandleComment(packet);
+      continue;
+    } else if (line_filter_ != nullptr && !line_filter_->Accept(packet)) {
+      continue;
+    }
+
+    if (ParseLine(packet, &source, &destination, &digipeaters, &payload)) {
+      callback(source, destination, digipeaters, payload);
+    }
   }
+}
 
-  auto comma_pos = packet.find(',', separator_pos);
-  if (comma_pos == std::string::npos) {
-    LOGE("packet missing destination separator: '%s'",
-        StringFormatNonPrintables(packet).c_str());
-    return false;
+int InternetAPRSInterface::GetServiceTimeoutMs() const {
+  if (backoff_.IsDisconnected()) {
+    return GetReconnectTimeRemainingMs();
   }
 
-  separator_pos++;
-  if (!destination->FromString(
-        packet.substr(separator_pos, comma_pos - separator_pos))) {
-    LOGE("failed to parse destination callsign: '%s'",
-        StringFormatNonPrintables(packet).c_str());
+  return GetIdleTimeRemainingMs();
+}
+
+bool InternetAPRSInterface::ParseLine(std::string_view packet,
+    CallsignConfig* source, CallsignConfig* destination,
+    std::vector<CallsignConfig>* digipeaters, std::string* payload) {
+  TNC2HeaderView header;
+  if (!header.Parse(packet)) {
+    LOGE("failed to parse packet: '%s'",
+        StringFormatNonPrintables(std::string(packet)).c_str());
     return false;
   }
 
-  // TODO(aarossig): parse digipeaters.
+  return header.ToAPRSFrame(source, destination, digipeaters, payload);
+}
 
-  auto payload_pos = packet.find(':');
-  if (payload_pos == std::string::npos) {
-    LOGE("packet missing payload");
+bool InternetAPRSInterface::Connect() {
+  LOGI("connecting to %s:%" PRIu16, hostname_.c_str(), port_);
+  line_reader_.Clear();
+  ConnectionRace race([this](TCPSocket* socket, size_t line_index,
+        std::string_view line) {
+    return HandleLoginLine(socket, line_index, line);
+  });
+  if (!race.Connect(hostname_, port_, &socket_, &line_reader_)) {
+    LOGE("failed to connect to server");
     return false;
   }
 
-  *payload = packet.substr(payload_pos + 1);
+  // The stream is considered fresh from when the connection is established.
+  last_line_time_us_ = GetTimeNowUs();
+  last_keepalive_time_us_ = last_line_time_us_.load();
   return true;
 }
 
-bool InternetAPRSInterface::ReadServerVersion(std::string* server_version) {
-  const std::string kVersionPrefix = "# ";
+bool InternetAPRSInterface::Reconnect() {
+  Disconnect();
+  while (!ServiceReconnect()) {
+    std::unique_lock<std::mutex> lock(stop_mutex_);
+    auto delay = std::chrono::milliseconds(GetReconnectTimeRemainingMs());
+    if (stop_cv_.wait_for(lock, delay, [this]() { return stopped_; })) {
+      LOGI("stopped reconnecting to server");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void InternetAPRSInterface::Disconnect() {
+  if (backoff_.IsDisconnected()) {
+    return;
+  }
+
+  LOGE("lost connection to server, reconnecting");
+  socket_.Close();
+  line_reader_.Clear();
+  backoff_.OnDisconnected();
+  next_connect_time_us_ = GetTimeNowUs()
+      + static_cast<uint64_t>(backoff_.GetNextDelayMs()) * 1000;
+}
 
-  if (!ReadLine(server_version, /*timeout_ms=*/100)) {
-    LOGE("Failed to read server version");
-  } else if (!StringStartsWith(*server_version, kVersionPrefix)) {
-    LOGE("Received malformed server version '%s'",
-        StringFormatNonPrintables(*server_version).c_str());
-  } else {
-    *server_version = server_version->substr(kVersionPrefix.size(),
-        server_version->size()).c_str();
+bool InternetAPRSInterface::ServiceReconnect() {
+  if (!backoff_.IsDisconnected()) {
     return true;
+  } else if (IsStopped() || GetReconnectTimeRemainingMs() > 0) {
+    return false;
+  } else if (!Connect()) {
+    next_connect_time_us_ = GetTimeNowUs()
+        + static_cast<uint64_t>(backoff_.GetNextDelayMs()) * 1000;
+    return false;
   }
 
-  return false;
+  uint64_t downtime_us = backoff_.OnConnected();
+  LOGI("reconnected to server after %" PRIu64 "ms", downtime_us / 1000);
+  return true;
+}
+
+bool InternetAPRSInterface::IsStopped() {
+  std::lock_guard<std::mutex> lock(stop_mutex_);
+  return stopped_;
 }
 
-bool InternetAPRSInterface::Authenticate(
-    const CallsignConfig& callsign) {
-  const std::string auth_line = "user " + callsign.callsign + " "
+int InternetAPRSInterface::GetReconnectTimeRemainingMs() const {
+  uint64_t time_now_us = GetTimeNowUs();
+  if (time_now_us >= next_connect_time_us_) {
+    return 0;
+  }
+
+  return (next_connect_time_us_ - time_now_us + 999) / 1000;
+}
+
+int InternetAPRSInterface::HandleLoginLine(TCPSocket* socket,
+    size_t line_index, std::string_view line) {
+  const std::string_view kVersionPrefix = "# ";
+
+  if (line_index == 0) {
+    if (line.substr(0, kVersionPrefix.size()) != kVersionPrefix) {
+      LOGE("Received malformed server version '%s'",
+          StringFormatNonPrintables(std::string(line)).c_str());
+      return -1;
+    }
+
+    LOGI("Received server version: %s", StringFormatNonPrintables(
+          std::string(line.substr(kVersionPrefix.size()))).c_str());
+    if (!Authenticate(socket)) {
+      LOGE("failed to authenticate with the server");
+      return -1;
+    }
+
+    return 0;
+  }
+
+  LOGI("server responded to auth with '%s'",
+      StringFormatNonPrintables(std::string(line)).c_str());
+  return 1;
+}
+
+bool InternetAPRSInterface::Authenticate(TCPSocket* socket) {
+  std::string auth_line = "user " + callsign_.callsign + " "
     + "pass -1 "  // Authenticate with -1 as we don't send packets currently.
     + "vers watch 0.0.1";
-  if (!WriteLine(auth_line)) {
-    LOGE("failed to send auth line");
-    return false;
+  if (!filter_.empty()) {
+    auth_line += " filter " + filter_;
   }
 
-  std::string auth_response_line;
-  if (!ReadLine(&auth_response_line, /*timeout_ms=*/100)) {
-    LOGE("failed to read auth response line");
+  auth_line += "\r\n";
+  if (!socket->Write(auth_line.data(), auth_line.size())) {
+    LOGE("failed to send auth line");
     return false;
   }
 
-  LOGI("server responded to auth with '%s'",
-      StringFormatNonPrintables(auth_response_line).c_str());
   return true;
 }
 
-bool InternetAPRSInterface::ReadLine(std::string* line, uint32_t timeout_ms) {
-  constexpr size_t kMaxLineLength = 1024;
+int InternetAPRSInterface::GetIdleTimeRemainingMs() const {
+  if (idle_timeout_ms_ == 0) {
+    return -1;
+  }
+
+  uint64_t idle_ms = GetTimeSinceLastLineMs();
+  return idle_ms >= idle_timeout_ms_ ? 0 : idle_timeout_ms_ - idle_ms;
+}
 
+void InternetAPRSInterface::HandleComment(std::string_view line) {
+  LOGV("server sent informational packet: '%.*s'",
+      static_cast<int>(line.size()), line.data());
+  last_keepalive_time_us_ = last_line_time_us_.load();
+}
+
+bool InternetAPRSInterface::ReadLine(std::string_view* line,
+    uint32_t timeout_ms) {
   uint64_t time_start_us = GetTimeNowUs();
   while (true) {
-    if (timeout_ms > 0
-        && (GetTimeNowUs() - time_start_us) > (timeout_ms * 1000)) {
-      LOGE("timeout reading socket");
+    int read_result = ReadAvailableLine(line);
+    if (read_result < 0) {
+      LOGE("failed to read from socket");
+      socket_.Close();
       return false;
+    } else if (read_result > 0) {
+      return true;
     }
 
-    int check_result = SDLNet_CheckSockets(socket_set_, /*timeout_ms=*/1);
-    if (check_result < 0) {
-      LOGFATAL("failed to check sockets: %s", SDLNet_GetError());
-    } else if (check_result >= 1) {
-      char byte;
-      int read_result = SDLNet_TCP_Recv(socket_, &byte, 1);
-      if (read_result <= 0) {
-        LOGFATAL("failed to read from socket: %s", SDLNet_GetError());
-      }
+    int wait_ms = GetIdleTimeRemainingMs();
+    if (wait_ms == 0) {
+      LOGE("no lines received from server for %" PRIu64 "ms",
+          GetTimeSinceLastLineMs());
+      socket_.Close();
+      return false;
+    }
 
-      line->push_back(byte);
-      if (line->size() > kMaxLineLength) {
-        LOGE("server sent line that is too long");
+    if (timeout_ms > 0) {
+      uint64_t elapsed_ms = (GetTimeNowUs() - time_start_us) / 1000;
+      if (elapsed_ms >= timeout_ms) {
+        LOGV("timeout reading socket");
         return false;
       }
 
-      if (line->size() >= 2
-          && line->at(line->size() - 2) == '\r'
-          && line->at(line->size() - 1) == '\n') {
-        line->resize(line->size() - 2);
-        return true;
+      uint64_t remaining_ms = timeout_ms - elapsed_ms;
+      if (wait_ms < 0 || remaining_ms < static_cast<uint64_t>(wait_ms)) {
+        wait_ms = remaining_ms;
       }
     }
+
+    if (socket_.WaitReadable(wait_ms) < 0) {
+      LOGE("failed to check socket");
+      socket_.Close();
+      return false;
+    }
+  }
+}
+
+int InternetAPRSInterface::ReadAvailableLine(std::string_view* line) {
+  while (!line_reader_.GetLine(line)) {
+    ssize_t read_result = line_reader_.Read(&socket_);
+    if (read_result <= 0) {
+      return read_result;
+    }
   }
+
+  last_line_time_us_ = GetTimeNowUs();
+  return 1;
 }
 
 bool InternetAPRSInterface::WriteLine(const std::string& line) {
   std::string send_line = line + "\r\n";
-  int write_result = SDLNet_TCP_Send(socket_,
-      send_line.data(), send_line.size());
-  if (write_result < line.size()) {
-    LOGFATAL("failed to write to socket: %s", SDLNet_GetError());
+  if (!socket_.Write(send_line.data(), send_line.size())) {
+    LOGE("failed to write to socket");
+    socket_.Close();
+    return false;
   }
 
   return true;
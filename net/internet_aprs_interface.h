@@ -17,9 +17,17 @@
 #ifndef APRS_UTILS_NET_INTERNET_APRS_INTERFACE_H_
 #define APRS_UTILS_NET_INTERNET_APRS_INTERFACE_H_
 
-#include <SDL_net.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string_view>
 
 #include "net/aprs_interface.h"
+#include "net/aprs_is_line_filter.h"
+#include "net/line_reader.h"
+#include "net/reconnect_backoff.h"
+#include "net/tcp_socket.h"
 #include "util/non_copyable.h"
 
 namespace au {
@@ -27,14 +35,65 @@ namespace au {
 class InternetAPRSInterface : public APRSInterface,
                               public NonCopyable {
  public:
-  // Setup the internet interface with hostname and port to connect to.
+  // The port of APRS-IS servers that applies the filter sent at login.
+  static constexpr uint16_t kDefaultPort = 14580;
+
+  // The port of APRS-IS servers that sends the unfiltered full feed.
+  static constexpr uint16_t kFullFeedPort = 10152;
+
+  // The default time in milliseconds without any line from the server after
+  // which the connection is considered stalled. Servers send a keepalive
+  // comment about every 20 seconds, so this allows for three to be missed.
+  static constexpr uint32_t kDefaultIdleTimeoutMs = 60000;
+
+  // Setup the internet interface with hostname and port to connect to. The
+  // filter is sent at login in the APRS-IS filter syntax and may be empty.
   InternetAPRSInterface(const APRSInterface::Config& config,
       const CallsignConfig& callsign,
-      const std::string& hostname, uint16_t port);
+      const std::string& hostname, uint16_t port,
+      const std::string& filter);
 
   // Close the connection.
   ~InternetAPRSInterface() override;
 
+  // Drops received lines that are not addressed to the destination with a
+  // payload starting with the prefix before they are parsed. This is useful
+  // when connected to the full feed.
+  void SetLineFilter(const std::string& destination, char payload_prefix);
+
+  // Returns the line filter, or nullptr if lines are not filtered.
+  const APRSISLineFilter* GetLineFilter() const { return line_filter_.get(); }
+
+  // Sets the time in milliseconds without any line from the server after
+  // which the connection is restored, or zero to wait indefinitely.
+  void SetIdleTimeout(uint32_t idle_timeout_ms) {
+    idle_timeout_ms_ = idle_timeout_ms;
+  }
+
+  // Returns the time in milliseconds since the last line was received, or
+  // since the connection was established if there has not been one. This may
+  // be called from any thread.
+  uint64_t GetTimeSinceLastLineMs() const;
+
+  // Returns the time in milliseconds since the last keepalive comment was
+  // received, or since the connection was established if there has not been
+  // one. This may be called from any thread.
+  uint64_t GetTimeSinceLastKeepaliveMs() const;
+
+  // Stops any attempt to restore the connection, which causes Receive and
+  // ReceiveAvailable to fail once the connection is lost. This may be called
+  // from any thread.
+  //
+  // Receive waits between attempts to restore a lost connection, while
+  // ReceiveAvailable makes one attempt once the delay has elapsed and returns,
+  // so that an event loop services it as given by GetServiceTimeoutMs.
+  void Stop();
+
+  // Returns statistics about the times the connection has been lost.
+  const ReconnectBackoff::Stats& GetReconnectStats() const {
+    return backoff_.GetStats();
+  }
+
  protected:
   // APRSInterface implementation.
   bool Send(const std::string& payload,
@@ -43,25 +102,118 @@ class InternetAPRSInterface : public APRSInterface,
   bool Receive(CallsignConfig* source, CallsignConfig* destination,
       std::vector<CallsignConfig>* digipeaters, std::string* payload,
       uint32_t timeout_ms) final;
+  int GetFileDescriptor() const final;
+  bool ReceiveAvailable(const FrameCallback& callback) final;
+  int GetServiceTimeoutMs() const final;
 
  private:
+  // The callsign to authenticate with.
+  const CallsignConfig callsign_;
+
+  // The hostname of the server.
+  const std::string hostname_;
+
+  // The port of the server.
+  const uint16_t port_;
+
+  // The server-side filter, or empty for no filter.
+  const std::string filter_;
+
   // The socket used to interact with the server.
-  TCPsocket socket_;
+  TCPSocket socket_;
+
+  // Paces attempts to reconnect when the connection is lost.
+  ReconnectBackoff backoff_;
+
+  // Splits the bytes read from the server into lines.
+  LineReader line_reader_;
+
+  // Rejects lines before they are parsed, or nullptr to parse all lines.
+  std::unique_ptr<APRSISLineFilter> line_filter_;
 
-  // The SocketSet used to implement timeouts for receive.
-  SDLNet_SocketSet socket_set_;
+  // The time in milliseconds without any line after which the connection is
+  // restored, or zero to wait indefinitely.
+  uint32_t idle_timeout_ms_;
 
-  // Reads the server version. This is expected to be sent on startup.
-  bool ReadServerVersion(std::string* server_version);
+  // The time that the last line was received, in microseconds.
+  std::atomic<uint64_t> last_line_time_us_;
 
-  // Sends the authentication command.
-  bool Authenticate(const CallsignConfig& callsign);
+  // The time that the last keepalive comment was received, in microseconds.
+  std::atomic<uint64_t> last_keepalive_time_us_;
+
+  // The time at which to make the next attempt to restore a lost connection,
+  // in microseconds.
+  uint64_t next_connect_time_us_;
+
+  // Guards stopped_.
+  std::mutex stop_mutex_;
+
+  // Signalled when the interface is stopped.
+  std::condition_variable stop_cv_;
+
+  // Set to true to stop restoring the connection.
+  bool stopped_;
+
+  // Connects and authenticates with the server, racing the addresses of the
+  // hostname. Returns true if successful.
+  bool Connect();
+
+  // Closes the connection and reconnects, waiting between attempts until the
+  // connection has been restored. Returns false if the interface is stopped
+  // first.
+  bool Reconnect();
+
+  // Closes the connection once it has been lost and schedules the first
+  // attempt to restore it. Has no effect if it has already been closed.
+  void Disconnect();
+
+  // Makes an attempt to restore a lost connection if the delay since the
+  // last attempt has elapsed. Returns true if connected.
+  bool ServiceReconnect();
+
+  // Returns true if the interface has been stopped.
+  bool IsStopped();
+
+  // Returns the time in milliseconds until the next attempt to restore a lost
+  // connection, which is zero once it is due.
+  int GetReconnectTimeRemainingMs() const;
+
+  // Handles a line received while logging in to a server, which starts with
+  // the server version followed by the response to authentication. This is
+  // used as the ConnectionRace::LineHandler.
+  int HandleLoginLine(TCPSocket* socket, size_t line_index,
+      std::string_view line);
+
+  // Sends the authentication command, including the filter.
+  bool Authenticate(TCPSocket* socket);
+
+  // Returns the time in milliseconds until the connection is considered
+  // stalled, which is zero once it has. Returns -1 if there is no idle
+  // timeout.
+  int GetIdleTimeRemainingMs() const;
+
+  // Handles a comment line from the server, which are sent as keepalives.
+  void HandleComment(std::string_view line);
 
   // Reads a line from the APRS-IS server. Returns true if successful and
-  // populates the line.
-  bool ReadLine(std::string* line, uint32_t timeout_ms);
+  // populates the line, which remains valid until the next read. The socket is
+  // closed if the connection fails or is stalled.
+  bool ReadLine(std::string_view* line, uint32_t timeout_ms);
+
+  // Reads the bytes available from the server without blocking. Returns 1 and
+  // populates the line if a complete line has been read, 0 if no complete line
+  // is available yet and -1 if there is an error. The line remains valid until
+  // the next read.
+  int ReadAvailableLine(std::string_view* line);
+
+  // Parses a line from the APRS-IS server into a frame. Returns true if
+  // successful.
+  bool ParseLine(std::string_view packet, CallsignConfig* source,
+      CallsignConfig* destination, std::vector<CallsignConfig>* digipeaters,
+      std::string* payload);
 
-  // Writes a line to the server. Returns true if successful.
+  // Writes a line to the server. Returns true if successful. The socket is
+  // closed if the connection fails.
   bool WriteLine(const std::string& line);
 };
 
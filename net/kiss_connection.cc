@@ -0,0 +1,601 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/kiss_connection.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "util/log.h"
+#include "util/time.h"
+
+#define LOG_TAG "KISSConnection"
+
+namespace au {
+
+KISSConnection::Port::Port(size_t max_queued_tx_frames)
+    : rx_queue(kMaxQueuedFrames),
+      tx_queue(max_queued_tx_frames) {}
+
+KISSConnection::KISSConnection(const Config& config,
+    const std::string& hostname, uint16_t port)
+    : config_(config),
+      hostname_(hostname),
+      port_(port),
+      next_tx_port_(0),
+      tx_stats_(),
+      tx_failed_(false),
+      reconnecting_(false),
+      connecting_(false),
+      next_connect_time_us_(0),
+      connect_deadline_us_(0),
+      connect_address_index_(0),
+      reading_(false),
+      stopping_(false) {
+  if (config_.max_queued_tx_frames == 0) {
+    LOGFATAL("transmit queue must hold at least one frame");
+  }
+
+  rx_event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (rx_event_fd_ < 0) {
+    LOGFATAL("failed to create eventfd: %s (%d)", strerror(errno), errno);
+  }
+
+  if (!socket_.Connect(hostname_, port_)) {
+    LOGFATAL("failed to connect to TNC");
+  }
+
+  writer_thread_ = std::thread(&KISSConnection::WriterLoop, this);
+}
+
+KISSConnection::~KISSConnection() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+
+  tx_queued_cv_.notify_all();
+  reconnect_cv_.notify_all();
+  writer_thread_.join();
+  close(rx_event_fd_);
+
+  const auto& stats = deframer_.GetStats();
+  LOGI("decoded %" PRIu64 " frames from %" PRIu64 " bytes in %" PRIu64
+      " reads with %" PRIu64 " errors", stats.frame_count, stats.byte_count,
+      stats.push_count, stats.error_count);
+  LOGI("sent %" PRIu64 " frames with %" PRIu64 " bytes in %" PRIu64
+      " writes, dropped %" PRIu64 " frames, %" PRIu64 " acknowledged",
+      tx_stats_.sent_frames, tx_stats_.sent_bytes, tx_stats_.write_count,
+      tx_stats_.dropped_frames, tx_stats_.acked_frames);
+
+  const auto& reconnect_stats = backoff_.GetStats();
+  LOGI("reconnected %" PRIu64 " times after %" PRIu64 " failed attempts, "
+      "%" PRIu64 "ms offline", reconnect_stats.reconnect_count,
+      reconnect_stats.failed_attempt_count,
+      reconnect_stats.downtime_us / 1000);
+}
+
+int KISSConnection::GetFileDescriptor() const {
+  return socket_.GetFileDescriptor();
+}
+
+int KISSConnection::GetServiceTimeoutMs() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return GetServiceTimeoutMsLocked();
+}
+
+void KISSConnection::OpenPort(uint8_t port) {
+  if (port >= kPortCount) {
+    LOGFATAL("invalid KISS port %" PRIu8, port);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (ports_[port] == nullptr) {
+    ports_[port] = std::make_unique<Port>(config_.max_queued_tx_frames);
+  }
+}
+
+void KISSConnection::ClosePort(uint8_t port) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto& tnc_port = ports_[port % kPortCount];
+  if (tnc_port == nullptr) {
+    return;
+  }
+
+  // Allow the writer to take the frames that are waiting to be sent.
+  tx_space_cv_.wait(lock, [this, &tnc_port]() {
+    return tx_failed_ || tnc_port->tx_queue.IsEmpty();
+  });
+
+  tx_stats_.queued_frames -= tnc_port->tx_queue.GetSize();
+  while (!tnc_port->tx_queue.IsEmpty()) {
+    tx_stats_.queued_bytes -= tnc_port->tx_queue.GetFront().data.size();
+    tnc_port->tx_queue.PopFront();
+  }
+
+  tnc_port.reset();
+}
+
+KISSConnection::SendResult KISSConnection::SendFrame(uint8_t port,
+    const uint8_t* kiss_frame, size_t size) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    auto& tnc_port = ports_[port % kPortCount];
+    if (tnc_port == nullptr) {
+      LOGE("unable to send on closed KISS port %" PRIu8, port);
+      return SendResult::kFailed;
+    } else if (tx_failed_) {
+      LOGE("unable to send on failed connection");
+      return SendResult::kFailed;
+    } else if (tnc_port->tx_queue.GetSize() < config_.max_queued_tx_frames) {
+      KISSFrame* frame = tnc_port->tx_queue.GetBack();
+      frame->port = port;
+      frame->command = kCommandData;
+      frame->data.assign(kiss_frame, kiss_frame + size);
+      tnc_port->tx_queue.PushBack();
+      tx_stats_.queued_frames++;
+      tx_stats_.queued_bytes += size;
+      tx_queued_cv_.notify_one();
+      return SendResult::kQueued;
+    } else if (config_.tx_overflow_policy == OverflowPolicy::kDrop) {
+      LOGE("dropping frame for full transmit queue on KISS port %" PRIu8,
+          port);
+      tx_stats_.dropped_frames++;
+      return SendResult::kDropped;
+    }
+
+    tx_space_cv_.wait(lock);
+  }
+}
+
+size_t KISSConnection::GetTxQueueSize(uint8_t port) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto& tnc_port = ports_[port % kPortCount];
+  return tnc_port == nullptr ? 0 : tnc_port->tx_queue.GetSize();
+}
+
+KISSConnection::TxStats KISSConnection::GetTxStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return tx_stats_;
+}
+
+ReconnectBackoff::Stats KISSConnection::GetReconnectStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return backoff_.GetStats();
+}
+
+bool KISSConnection::ReceiveFrame(uint8_t port, KISSFrame* frame,
+    uint32_t timeout_ms) {
+  if (!ReadUntil([this, port, frame]() {
+        return PopFrameLocked(port, frame);
+      }, timeout_ms)) {
+    LOGE("timeout reading packet");
+    return false;
+  }
+
+  return true;
+}
+
+bool KISSConnection::WaitForAck(uint8_t port, uint16_t sequence,
+    uint32_t timeout_ms) {
+  return ReadUntil([this, port, sequence]() {
+    auto& tnc_port = ports_[port % kPortCount];
+    if (tnc_port == nullptr) {
+      return false;
+    }
+
+    auto& acked_sequences = tnc_port->acked_sequences;
+    auto ack_it = std::find(acked_sequences.begin(), acked_sequences.end(),
+        sequence);
+    if (ack_it == acked_sequences.end()) {
+      return false;
+    }
+
+    acked_sequences.erase(acked_sequences.begin(), ack_it + 1);
+    return true;
+  }, timeout_ms);
+}
+
+bool KISSConnection::PopFrame(uint8_t port, KISSFrame* frame) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return PopFrameLocked(port, frame);
+}
+
+bool KISSConnection::HasFrame(uint8_t port) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto& tnc_port = ports_[port % kPortCount];
+  return tnc_port != nullptr && !tnc_port->rx_queue.IsEmpty();
+}
+
+bool KISSConnection::ReadAvailable() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (reconnecting_) {
+    ServiceReconnectLocked(&lock);
+  } else if (!ReadAvailableLocked()) {
+    DisconnectLocked(&lock);
+  }
+
+  return !stopping_;
+}
+
+bool KISSConnection::ReadUntil(const std::function<bool()>& done,
+    uint32_t timeout_ms) {
+  uint64_t time_start_us = GetTimeNowUs();
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!done()) {
+    // Wait for the remainder of the timeout or indefinitely if there is no
+    // timeout.
+    int wait_ms = -1;
+    if (timeout_ms != 0) {
+      uint64_t elapsed_ms = (GetTimeNowUs() - time_start_us) / 1000;
+      if (elapsed_ms >= timeout_ms) {
+        return false;
+      }
+
+      wait_ms = timeout_ms - elapsed_ms;
+    }
+
+    // Restore a lost connection, waiting between steps for the next attempt
+    // or for another thread to restore it.
+    if (reconnecting_) {
+      if (!ServiceReconnectLocked(&lock)) {
+        if (stopping_) {
+          return false;
+        }
+
+        int reconnect_ms = GetServiceTimeoutMsLocked();
+        if (wait_ms >= 0) {
+          reconnect_ms = std::min(reconnect_ms, wait_ms);
+        }
+
+        reconnect_cv_.wait_for(lock, std::chrono::milliseconds(reconnect_ms));
+      }
+
+      continue;
+    }
+
+    // Another thread is waiting on the socket, so wait for it to queue frames
+    // for this port or to stop waiting.
+    if (reading_) {
+      if (wait_ms < 0) {
+        rx_cv_.wait(lock);
+      } else {
+        rx_cv_.wait_for(lock, std::chrono::milliseconds(wait_ms));
+      }
+
+      continue;
+    }
+
+    // Wait for the socket with the mutex released so that other ports can
+    // send and receive. Frames queued by another thread, such as an event loop
+    // calling ReadAvailable, wake this thread through the eventfd. The socket
+    // is not closed or replaced until this thread has finished waiting.
+    reading_ = true;
+    int fd = socket_.GetFileDescriptor();
+    lock.unlock();
+    int wait_result = WaitReadableOrWoken(fd, wait_ms);
+    lock.lock();
+    reading_ = false;
+    rx_cv_.notify_all();
+
+    // A failure to wait is handled by the read, which disconnects.
+    if (wait_result != 0 && !ReadAvailableLocked()) {
+      DisconnectLocked(&lock);
+    }
+  }
+
+  return true;
+}
+
+int KISSConnection::WaitReadableOrWoken(int fd, int timeout_ms) {
+  struct pollfd poll_fds[2] = {};
+  poll_fds[0].fd = fd;
+  poll_fds[0].events = POLLIN;
+  poll_fds[1].fd = rx_event_fd_;
+  poll_fds[1].events = POLLIN;
+  int result = poll(poll_fds, 2, timeout_ms);
+  if (result < 0) {
+    if (errno == EINTR) {
+      return 0;
+    }
+
+    LOGE("failed to poll socket: %s (%d)", strerror(errno), errno);
+    return -1;
+  }
+
+  if (poll_fds[1].revents != 0) {
+    uint64_t count;
+    if (read(rx_event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+      LOGE("failed to read eventfd: %s (%d)", strerror(errno), errno);
+    }
+  }
+
+  return result > 0 ? 1 : 0;
+}
+
+void KISSConnection::DisconnectLocked(std::unique_lock<std::mutex>* lock) {
+  if (reconnecting_) {
+    return;
+  }
+
+  // Wait for the writer and the reading thread to finish with the socket
+  // before closing it. Shutting down the socket wakes both of them, and
+  // neither uses the socket again while reconnecting.
+  reconnecting_ = true;
+  socket_.Shutdown();
+  tx_space_cv_.wait(*lock, [this]() {
+    return tx_stats_.in_flight_bytes == 0;
+  });
+  rx_cv_.wait(*lock, [this]() { return !reading_; });
+
+  LOGE("lost connection to TNC, reconnecting");
+  socket_.Close();
+  deframer_.Reset();
+  backoff_.OnDisconnected();
+  next_connect_time_us_ = GetTimeNowUs()
+      + static_cast<uint64_t>(backoff_.GetNextDelayMs()) * 1000;
+  reconnect_cv_.notify_all();
+}
+
+bool KISSConnection::ServiceReconnectLocked(
+    std::unique_lock<std::mutex>* lock) {
+  if (!reconnecting_) {
+    return true;
+  } else if (connecting_ || stopping_ || socket_.IsOpen()) {
+    // Another thread is starting an attempt or closing the socket.
+    return false;
+  }
+
+  if (!connect_socket_.IsOpen()) {
+    if (GetTimeNowUs() < next_connect_time_us_) {
+      return false;
+    }
+
+    // Resolving the TNC may block, so the attempt is started with the mutex
+    // released. No other thread uses the attempt socket until it is started.
+    connecting_ = true;
+    lock->unlock();
+    std::vector<TCPSocket::Address> addresses;
+    bool started = TCPSocket::Resolve(hostname_, port_, &addresses)
+        && connect_socket_.StartConnect(
+            addresses[connect_address_index_ % addresses.size()]);
+    lock->lock();
+    connecting_ = false;
+    if (!started) {
+      OnConnectFailedLocked();
+      return false;
+    }
+
+    connect_deadline_us_ = GetTimeNowUs()
+        + static_cast<uint64_t>(kConnectTimeoutMs) * 1000;
+  }
+
+  // The socket becomes writable once the attempt completes.
+  struct pollfd poll_fd = {};
+  poll_fd.fd = connect_socket_.GetFileDescriptor();
+  poll_fd.events = POLLOUT;
+  if (poll(&poll_fd, 1, /*timeout=*/0) == 0) {
+    if (GetTimeNowUs() < connect_deadline_us_) {
+      return false;
+    }
+
+    LOGE("timeout reconnecting to TNC");
+    connect_socket_.Close();
+    OnConnectFailedLocked();
+    return false;
+  } else if (!connect_socket_.FinishConnect()) {
+    OnConnectFailedLocked();
+    return false;
+  }
+
+  socket_.Swap(&connect_socket_);
+  reconnecting_ = false;
+  uint64_t downtime_us = backoff_.OnConnected();
+  LOGI("reconnected to TNC after %" PRIu64 "ms", downtime_us / 1000);
+  reconnect_cv_.notify_all();
+  return true;
+}
+
+void KISSConnection::OnConnectFailedLocked() {
+  connect_address_index_++;
+  next_connect_time_us_ = GetTimeNowUs()
+      + static_cast<uint64_t>(backoff_.GetNextDelayMs()) * 1000;
+}
+
+int KISSConnection::GetServiceTimeoutMsLocked() const {
+  if (!reconnecting_) {
+    return -1;
+  } else if (connecting_ || socket_.IsOpen() || connect_socket_.IsOpen()) {
+    return kConnectPollIntervalMs;
+  }
+
+  uint64_t time_now_us = GetTimeNowUs();
+  if (time_now_us >= next_connect_time_us_) {
+    return 0;
+  }
+
+  return (next_connect_time_us_ - time_now_us + 999) / 1000;
+}
+
+bool KISSConnection::ReadAvailableLocked() {
+  ssize_t read_result = socket_.Read(read_buffer_, sizeof(read_buffer_));
+  if (read_result < 0) {
+    return false;
+  }
+
+  bool queued = false;
+  deframer_.Push(read_buffer_, read_result);
+  while (deframer_.HasFrame()) {
+    KISSFrame& frame = deframer_.GetFrame();
+    auto& tnc_port = ports_[frame.port];
+    if (frame.command == kCommandAckMode && frame.data.size() == 2) {
+      if (tnc_port != nullptr) {
+        auto& acked_sequences = tnc_port->acked_sequences;
+        if (acked_sequences.size() >= kMaxQueuedAcks) {
+          acked_sequences.erase(acked_sequences.begin());
+        }
+
+        acked_sequences.push_back((frame.data[0] << 8) | frame.data[1]);
+        tx_stats_.acked_frames++;
+        queued = true;
+      }
+    } else if (frame.command != kCommandData) {
+      LOGE("invalid KISS command: %02x", frame.command);
+    } else if (tnc_port == nullptr) {
+      LOGV("discarding frame for closed KISS port %" PRIu8, frame.port);
+    } else {
+      // Swap the storage into the port queue rather than copying the frame.
+      KISSFrame* port_frame = tnc_port->rx_queue.GetBack();
+      port_frame->port = frame.port;
+      port_frame->command = frame.command;
+      port_frame->data.swap(frame.data);
+      tnc_port->rx_queue.PushBack();
+      queued = true;
+    }
+
+    deframer_.PopFrame();
+  }
+
+  // Wake the threads waiting for frames, including one waiting on the socket
+  // which would otherwise not see that the frames were read by this thread.
+  if (queued) {
+    rx_cv_.notify_all();
+    uint64_t increment = 1;
+    if (reading_ && write(rx_event_fd_, &increment, sizeof(increment)) < 0) {
+      LOGE("failed to write eventfd: %s (%d)", strerror(errno), errno);
+    }
+  }
+
+  return true;
+}
+
+bool KISSConnection::PopFrameLocked(uint8_t port, KISSFrame* frame) {
+  auto& tnc_port = ports_[port % kPortCount];
+  if (tnc_port == nullptr || tnc_port->rx_queue.IsEmpty()) {
+    return false;
+  }
+
+  KISSFrame& port_frame = tnc_port->rx_queue.GetFront();
+  frame->port = port_frame.port;
+  frame->command = port_frame.command;
+  frame->data.swap(port_frame.data);
+  tnc_port->rx_queue.PopFront();
+  return true;
+}
+
+void KISSConnection::WriterLoop() {
+  std::vector<KISSFrame> batch(kMaxTxBatchFrames);
+  struct iovec iov[kMaxTxBatchFrames];
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    tx_queued_cv_.wait(lock, [this]() {
+      return stopping_ || tx_stats_.queued_frames > 0;
+    });
+
+    size_t batch_size = TakeTxBatchLocked(&batch);
+    if (batch_size == 0) {
+      // Stopping with nothing left to write.
+      return;
+    }
+
+    size_t batch_bytes = 0;
+    for (size_t i = 0; i < batch_size; i++) {
+      batch_bytes += batch[i].data.size();
+    }
+
+    tx_stats_.queued_frames -= batch_size;
+    tx_stats_.queued_bytes -= batch_bytes;
+    tx_space_cv_.notify_all();
+
+    // Write the batch, writing it again from the start if the connection is
+    // replaced part way through.
+    bool success = false;
+    while (!success && !tx_failed_) {
+      if (reconnecting_ && !ServiceReconnectLocked(&lock)) {
+        if (stopping_) {
+          tx_failed_ = true;
+        } else {
+          reconnect_cv_.wait_for(lock, std::chrono::milliseconds(
+              GetServiceTimeoutMsLocked()));
+        }
+
+        continue;
+      }
+
+      for (size_t i = 0; i < batch_size; i++) {
+        iov[i].iov_base = batch[i].data.data();
+        iov[i].iov_len = batch[i].data.size();
+      }
+
+      tx_stats_.in_flight_bytes = batch_bytes;
+      lock.unlock();
+      success = socket_.WriteVector(iov, batch_size);
+      lock.lock();
+      tx_stats_.in_flight_bytes = 0;
+      tx_space_cv_.notify_all();
+
+      if (!success) {
+        LOGE("failed to write frames to TNC");
+        DisconnectLocked(&lock);
+      }
+    }
+
+    if (success) {
+      tx_stats_.sent_frames += batch_size;
+      tx_stats_.sent_bytes += batch_bytes;
+      tx_stats_.write_count++;
+    } else {
+      tx_space_cv_.notify_all();
+    }
+  }
+}
+
+size_t KISSConnection::TakeTxBatchLocked(std::vector<KISSFrame>* batch) {
+  size_t batch_size = 0;
+  while (batch_size < batch->size()) {
+    Port* tnc_port = nullptr;
+    for (size_t i = 0; i < kPortCount && tnc_port == nullptr; i++) {
+      size_t port = (next_tx_port_ + i) % kPortCount;
+      if (ports_[port] != nullptr && !ports_[port]->tx_queue.IsEmpty()) {
+        tnc_port = ports_[port].get();
+        next_tx_port_ = port + 1;
+      }
+    }
+
+    if (tnc_port == nullptr) {
+      break;
+    }
+
+    // Swap the storage out of the queue rather than copying the frame.
+    KISSFrame& frame = tnc_port->tx_queue.GetFront();
+    KISSFrame& batch_frame = (*batch)[batch_size++];
+    batch_frame.port = frame.port;
+    batch_frame.command = frame.command;
+    batch_frame.data.swap(frame.data);
+    tnc_port->tx_queue.PopFront();
+  }
+
+  return batch_size;
+}
+
+}  // namespace au
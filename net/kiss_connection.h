@@ -0,0 +1,368 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_KISS_CONNECTION_H_
+#define APRS_UTILS_NET_KISS_CONNECTION_H_
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "net/kiss_deframer.h"
+#include "net/kiss_frame_queue.h"
+#include "net/reconnect_backoff.h"
+#include "net/tcp_socket.h"
+#include "util/non_copyable.h"
+
+namespace au {
+
+// A connection to a KISS TNC. The connection is shared by the logical
+// interfaces of each TNC port, and each port has its own receive and transmit
+// queues. This is safe to use from the threads of several ports at once.
+//
+// Frames are transmitted asynchronously. Senders enqueue frames without
+// waiting on the socket and a writer thread drains the queues of all ports
+// with gathered writes.
+//
+// If the connection to the TNC is lost, it is restored with exponential
+// backoff. Queued frames are retained and any batch that was being written
+// is written again once reconnected. Attempts to reconnect do not block, so
+// an event loop restores the connection by calling ReadAvailable once
+// GetServiceTimeoutMs has elapsed.
+class KISSConnection : public NonCopyable {
+ public:
+  // The behaviour of SendFrame when the transmit queue of a port is full.
+  enum class OverflowPolicy {
+    // Wait for the writer to make room in the queue.
+    kBlock,
+
+    // Drop the frame that is being sent.
+    kDrop,
+  };
+
+  // The outcome of SendFrame.
+  enum class SendResult {
+    // The frame has been queued for transmission.
+    kQueued,
+
+    // The frame was dropped because the transmit queue was full.
+    kDropped,
+
+    // The port is closed or the connection has failed.
+    kFailed,
+  };
+
+  // The configuration for this KISSConnection.
+  struct Config {
+    // The maximum number of frames to queue for transmission per port.
+    size_t max_queued_tx_frames;
+
+    // The behaviour when a transmit queue is full.
+    OverflowPolicy tx_overflow_policy;
+  };
+
+  // Statistics about the frames transmitted by this connection.
+  struct TxStats {
+    // The number of frames waiting in the transmit queues of all ports.
+    size_t queued_frames;
+
+    // The number of bytes waiting in the transmit queues of all ports.
+    size_t queued_bytes;
+
+    // The number of bytes handed to the socket by the writer that have not
+    // completed yet.
+    size_t in_flight_bytes;
+
+    // The number of frames written to the TNC.
+    uint64_t sent_frames;
+
+    // The number of bytes written to the TNC.
+    uint64_t sent_bytes;
+
+    // The number of gathered writes used to write frames to the TNC.
+    uint64_t write_count;
+
+    // The number of frames dropped due to full transmit queues.
+    uint64_t dropped_frames;
+
+    // The number of transmissions acknowledged by the TNC in ACKMODE.
+    uint64_t acked_frames;
+  };
+
+  // The number of ports addressable by the KISS protocol.
+  static constexpr size_t kPortCount = 16;
+
+  // The maximum number of received frames queued per port.
+  static constexpr size_t kMaxQueuedFrames = 256;
+
+  // The default maximum number of frames to queue for transmission per port.
+  static constexpr size_t kDefaultMaxQueuedTxFrames = 16;
+
+  // The KISS command for a data frame.
+  static constexpr uint8_t kCommandData = 0x00;
+
+  // The KISS commands that set the channel access parameters of a port.
+  static constexpr uint8_t kCommandTxDelay = 0x01;
+  static constexpr uint8_t kCommandPersistence = 0x02;
+  static constexpr uint8_t kCommandSlotTime = 0x03;
+  static constexpr uint8_t kCommandTxTail = 0x04;
+  static constexpr uint8_t kCommandFullDuplex = 0x05;
+
+  // The KISS command of the ACKMODE extension. Data frames sent with this
+  // command carry a two byte sequence number that the TNC echoes once the
+  // frame has been transmitted.
+  static constexpr uint8_t kCommandAckMode = 0x0c;
+
+  // The maximum number of ACKMODE acknowledgements retained per port.
+  static constexpr size_t kMaxQueuedAcks = 64;
+
+  // Setup the connection to the TNC.
+  KISSConnection(const Config& config,
+      const std::string& hostname, uint16_t port);
+
+  // Writes any frames that are still queued and closes the connection.
+  ~KISSConnection();
+
+  // Returns the file descriptor of the connection, or -1 while the connection
+  // is being restored.
+  int GetFileDescriptor() const;
+
+  // Returns the time in milliseconds until ReadAvailable must be called to
+  // make progress restoring a lost connection, or -1 while connected.
+  int GetServiceTimeoutMs();
+
+  // Opens a port of the TNC. Frames received for ports that are not open are
+  // discarded.
+  void OpenPort(uint8_t port);
+
+  // Closes a port of the TNC once its queued frames have been handed to the
+  // writer. Frames that have been received for the port are discarded.
+  void ClosePort(uint8_t port);
+
+  // Queues an encoded KISS frame for transmission on the supplied port. Command
+  // frames share the queue with data frames so they take effect in order. If
+  // the queue is full, this waits or drops the frame according to the overflow
+  // policy.
+  SendResult SendFrame(uint8_t port, const uint8_t* kiss_frame, size_t size);
+
+  // Returns the number of frames waiting to be transmitted on a port.
+  size_t GetTxQueueSize(uint8_t port);
+
+  // Returns the transmit statistics of this connection.
+  TxStats GetTxStats();
+
+  // Returns statistics about the times the connection has been lost.
+  ReconnectBackoff::Stats GetReconnectStats();
+
+  // Waits for a data frame on the supplied port. A timeout of zero waits
+  // indefinitely. Returns true and moves the frame into the supplied frame if
+  // one is received, false if there is a timeout. The storage of the supplied
+  // frame is recycled by the connection.
+  bool ReceiveFrame(uint8_t port, KISSFrame* frame, uint32_t timeout_ms);
+
+  // Waits for the TNC to acknowledge the transmission of the ACKMODE frame
+  // with the supplied sequence number. Acknowledgements of earlier frames are
+  // discarded. Returns false if there is a timeout.
+  bool WaitForAck(uint8_t port, uint16_t sequence, uint32_t timeout_ms);
+
+  // Moves a data frame that has already been received on the supplied port
+  // into the frame without waiting. Returns true if one was available.
+  bool PopFrame(uint8_t port, KISSFrame* frame);
+
+  // Returns true if a data frame has already been received on the supplied
+  // port, such as by the thread of another port.
+  bool HasFrame(uint8_t port);
+
+  // Reads from the TNC without blocking and queues the frames received for
+  // each port. If the connection has been lost, this closes it and returns,
+  // and later calls attempt to restore it without blocking. Returns false if
+  // the connection is being closed.
+  bool ReadAvailable();
+
+ private:
+  // The size of the buffer used to read from the TNC.
+  static constexpr size_t kReadBufferSize = 4096;
+
+  // The maximum number of frames written by one gathered write.
+  static constexpr size_t kMaxTxBatchFrames = 64;
+
+  // The time to wait for an attempt to reconnect to complete.
+  static constexpr uint32_t kConnectTimeoutMs = 10000;
+
+  // The interval at which an attempt to reconnect is checked for completion.
+  static constexpr int kConnectPollIntervalMs = 50;
+
+  // The queues of a port that has been opened.
+  struct Port {
+    // Frames received on this port.
+    KISSFrameQueue rx_queue;
+
+    // Encoded frames waiting to be written to the TNC on this port.
+    KISSFrameQueue tx_queue;
+
+    // The sequence numbers of ACKMODE frames that the TNC has transmitted, in
+    // the order they were acknowledged.
+    std::vector<uint16_t> acked_sequences;
+
+    // Setup the port queues.
+    Port(size_t max_queued_tx_frames);
+  };
+
+  // The config to use for this KISSConnection.
+  const Config config_;
+
+  // The hostname of the TNC.
+  const std::string hostname_;
+
+  // The port of the TNC.
+  const uint16_t port_;
+
+  // Guards all members below.
+  std::mutex mutex_;
+
+  // Signalled when frames are queued for transmission or the writer should
+  // stop.
+  std::condition_variable tx_queued_cv_;
+
+  // Signalled when the writer has made room in the transmit queues or has
+  // finished writing a batch.
+  std::condition_variable tx_space_cv_;
+
+  // Signalled when the connection has been restored.
+  std::condition_variable reconnect_cv_;
+
+  // Signalled when frames or acknowledgements are queued for the ports, or
+  // when the reading thread has finished waiting on the socket.
+  std::condition_variable rx_cv_;
+
+  // The TCP socket used to communicate with the terminal node controller (TNC).
+  TCPSocket socket_;
+
+  // The socket of an attempt to reconnect that has been started and not yet
+  // completed.
+  TCPSocket connect_socket_;
+
+  // The buffer that bytes are read into from the TNC before decoding.
+  uint8_t read_buffer_[kReadBufferSize];
+
+  // Decodes KISS frames from the bytes read from the TNC.
+  KISSDeframer deframer_;
+
+  // The open ports, or nullptr for ports that are closed.
+  std::array<std::unique_ptr<Port>, kPortCount> ports_;
+
+  // The port to service first when writing queued frames. This rotates to
+  // share the connection fairly between ports.
+  size_t next_tx_port_;
+
+  // The transmit statistics of this connection.
+  TxStats tx_stats_;
+
+  // Set to true when writing to the TNC has failed and the connection is not
+  // being restored.
+  bool tx_failed_;
+
+  // Set to true from when the connection is lost until it has been restored.
+  bool reconnecting_;
+
+  // Set to true while a thread starts an attempt to reconnect with the mutex
+  // released.
+  bool connecting_;
+
+  // The time at which to start the next attempt to reconnect.
+  uint64_t next_connect_time_us_;
+
+  // The time at which the attempt in progress is abandoned.
+  uint64_t connect_deadline_us_;
+
+  // The index of the resolved address of the TNC to connect to next. This
+  // rotates after each failed attempt.
+  size_t connect_address_index_;
+
+  // Set to true while a thread waits for the socket to become readable with
+  // the mutex released. Only one thread waits on the socket at a time and the
+  // others wait for it to queue their frames.
+  bool reading_;
+
+  // An eventfd that wakes the reading thread when another thread has queued
+  // frames for the ports.
+  int rx_event_fd_;
+
+  // Paces attempts to reconnect when the connection is lost.
+  ReconnectBackoff backoff_;
+
+  // Set to true to stop the writer once the queues have been drained.
+  bool stopping_;
+
+  // Writes the transmit queues to the TNC.
+  std::thread writer_thread_;
+
+  // Reads from the TNC until the supplied function returns true, which is
+  // invoked with the mutex held. A timeout of zero waits indefinitely. Returns
+  // false if there is a timeout.
+  bool ReadUntil(const std::function<bool()>& done, uint32_t timeout_ms);
+
+  // Waits for the supplied socket or the receive eventfd to become readable
+  // and resets the eventfd. A negative timeout waits indefinitely. Returns 1
+  // if readable, 0 on timeout and -1 on error.
+  int WaitReadableOrWoken(int fd, int timeout_ms);
+
+  // Closes the connection once it has been lost and schedules the first
+  // attempt to restore it. Has no effect if another thread has already done
+  // so. The lock must hold the mutex, and is released while waiting for the
+  // writer and the reading thread to finish with the socket.
+  void DisconnectLocked(std::unique_lock<std::mutex>* lock);
+
+  // Makes progress restoring a lost connection without blocking, starting an
+  // attempt once the backoff delay has elapsed or completing the attempt in
+  // progress. The lock must hold the mutex, and is released while starting an
+  // attempt. Returns true if connected.
+  bool ServiceReconnectLocked(std::unique_lock<std::mutex>* lock);
+
+  // Schedules the next attempt to reconnect after a failed attempt. The mutex
+  // must be held.
+  void OnConnectFailedLocked();
+
+  // Returns the time in milliseconds until ServiceReconnectLocked should be
+  // called, or -1 while connected. The mutex must be held.
+  int GetServiceTimeoutMsLocked() const;
+
+  // Reads from the TNC and distributes decoded frames to the ports. The mutex
+  // must be held. Returns false if the connection has been lost.
+  bool ReadAvailableLocked();
+
+  // Moves a data frame from the port queue. The mutex must be held.
+  bool PopFrameLocked(uint8_t port, KISSFrame* frame);
+
+  // The writer thread. This waits for frames to be queued and writes them to
+  // the TNC in batches.
+  void WriterLoop();
+
+  // Moves up to kMaxTxBatchFrames queued frames into the supplied batch,
+  // taking from each port in turn. The mutex must be held. Returns the number
+  // of frames moved.
+  size_t TakeTxBatchLocked(std::vector<KISSFrame>* batch);
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_KISS_CONNECTION_H_
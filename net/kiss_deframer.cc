@@ -0,0 +1,121 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/kiss_deframer.h"
+
+#include "util/log.h"
+
+#define LOG_TAG "KISSDeframer"
+
+namespace au {
+namespace {
+
+// Special bytes of the KISS protocol.
+constexpr uint8_t kFEND = 0xc0;
+constexpr uint8_t kFESC = 0xdb;
+constexpr uint8_t kTFEND = 0xdc;
+constexpr uint8_t kTFESC = 0xdd;
+
+}  // anonymous namespace
+
+KISSDeframer::KISSDeframer()
+    : state_(State::kIdle),
+      frame_(nullptr),
+      frames_(kMaxQueuedFrames),
+      stats_() {}
+
+void KISSDeframer::Push(const uint8_t* data, size_t size) {
+  stats_.push_count++;
+  stats_.byte_count += size;
+
+  const uint8_t* end = data + size;
+  while (data < end) {
+    uint8_t byte = *data;
+    if (byte == kFEND) {
+      if (state_ == State::kData && !frame_->data.empty()) {
+        frames_.PushBack();
+        stats_.frame_count++;
+      } else if (state_ == State::kEscape) {
+        LOGE("frame ended in escape sequence");
+        stats_.error_count++;
+      }
+
+      state_ = State::kCommand;
+      data++;
+      continue;
+    }
+
+    switch (state_) {
+      case State::kIdle:
+        data++;
+        break;
+      case State::kCommand:
+        frame_ = frames_.GetBack();
+        frame_->port = byte >> 4;
+        frame_->command = byte & 0x0f;
+        state_ = State::kData;
+        data++;
+        break;
+      case State::kData: {
+        if (byte == kFESC) {
+          state_ = State::kEscape;
+          data++;
+          break;
+        }
+
+        // Copy the run of bytes up to the next special byte at once.
+        const uint8_t* run_end = data;
+        while (run_end < end && *run_end != kFEND && *run_end != kFESC) {
+          run_end++;
+        }
+
+        if (frame_->data.size() + (run_end - data) > kMaxFrameSize) {
+          LOGE("discarding frame that exceeds %zu bytes", kMaxFrameSize);
+          DiscardFrame();
+        } else {
+          frame_->data.insert(frame_->data.end(), data, run_end);
+        }
+
+        data = run_end;
+        break;
+      }
+      case State::kEscape:
+        if (frame_->data.size() == kMaxFrameSize) {
+          LOGE("discarding frame that exceeds %zu bytes", kMaxFrameSize);
+          DiscardFrame();
+        } else if (byte == kTFEND) {
+          frame_->data.push_back(kFEND);
+          state_ = State::kData;
+        } else if (byte == kTFESC) {
+          frame_->data.push_back(kFESC);
+          state_ = State::kData;
+        } else {
+          LOGE("invalid escape sequence");
+          DiscardFrame();
+        }
+
+        data++;
+        break;
+    }
+  }
+}
+
+void KISSDeframer::DiscardFrame() {
+  stats_.error_count++;
+  state_ = State::kIdle;
+}
+
+}  // namespace au
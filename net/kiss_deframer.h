@@ -0,0 +1,112 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_KISS_DEFRAMER_H_
+#define APRS_UTILS_NET_KISS_DEFRAMER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "net/kiss_frame_queue.h"
+#include "util/non_copyable.h"
+
+namespace au {
+
+// Decodes a stream of bytes from a KISS TNC into frames. The decoder state is
+// retained across calls to Push so that bytes can be supplied in whatever
+// sized pieces they are read from the TNC, and every complete frame is queued.
+class KISSDeframer : public NonCopyable {
+ public:
+  // Statistics about the frames decoded by this deframer.
+  struct Stats {
+    // The number of times bytes have been pushed into the deframer. This is
+    // typically the number of reads from the TNC.
+    uint64_t push_count;
+
+    // The number of bytes pushed into the deframer.
+    uint64_t byte_count;
+
+    // The number of complete frames decoded.
+    uint64_t frame_count;
+
+    // The number of frames discarded due to framing errors.
+    uint64_t error_count;
+  };
+
+  // The maximum size of a decoded frame. Larger frames are discarded.
+  static constexpr size_t kMaxFrameSize = 2048;
+
+  // The maximum number of decoded frames to hold before dropping the oldest.
+  static constexpr size_t kMaxQueuedFrames = 256;
+
+  // Setup the deframer in the idle state.
+  KISSDeframer();
+
+  // Decodes the supplied bytes, queueing all frames that are completed.
+  void Push(const uint8_t* data, size_t size);
+
+  // Returns true if a decoded frame is available.
+  bool HasFrame() const { return !frames_.IsEmpty(); }
+
+  // Returns the oldest decoded frame. This must only be called if HasFrame
+  // returns true and remains valid until PopFrame is called.
+  KISSFrame& GetFrame() { return frames_.GetFront(); }
+
+  // Removes the oldest decoded frame.
+  void PopFrame() { frames_.PopFront(); }
+
+  // Discards any partially decoded frame, such as when the connection to the
+  // TNC has been replaced. Decoded frames are retained.
+  void Reset() { state_ = State::kIdle; }
+
+  // Returns the statistics of this deframer.
+  const Stats& GetStats() const { return stats_; }
+
+ private:
+  // The states of the decoder.
+  enum class State {
+    // Waiting for a FEND to start a frame.
+    kIdle,
+
+    // A FEND has been received and the next byte is the command.
+    kCommand,
+
+    // Decoding the contents of a frame.
+    kData,
+
+    // A FESC has been received and the next byte is the escaped byte.
+    kEscape,
+  };
+
+  // The current decoder state.
+  State state_;
+
+  // The frame being decoded when in the kData or kEscape states.
+  KISSFrame* frame_;
+
+  // The frames that have been decoded.
+  KISSFrameQueue frames_;
+
+  // The statistics of this deframer.
+  Stats stats_;
+
+  // Discards the frame being decoded due to an error.
+  void DiscardFrame();
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_KISS_DEFRAMER_H_
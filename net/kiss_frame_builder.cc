@@ -0,0 +1,197 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/kiss_frame_builder.h"
+
+#include <algorithm>
+
+#include "net/ax25_frame_view.h"
+#include "util/base91.h"
+#include "util/log.h"
+
+#define LOG_TAG "KISSFrameBuilder"
+
+namespace au {
+namespace {
+
+// Special bytes of the KISS protocol.
+constexpr uint8_t kFEND = 0xc0;
+constexpr uint8_t kFESC = 0xdb;
+constexpr uint8_t kTFEND = 0xdc;
+constexpr uint8_t kTFESC = 0xdd;
+
+// The KISS command for a data frame that is acknowledged once transmitted.
+constexpr uint8_t kCommandAckMode = 0x0c;
+
+// The base64 alphabet.
+constexpr char kBase64Alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+}  // anonymous namespace
+
+void KISSFrameBuilder::Begin(uint8_t kiss_port, const CallsignConfig& source,
+    const CallsignConfig& destination,
+    const std::vector<CallsignConfig>& digipeaters) {
+  const auto& header = GetAddressHeader(source, destination, digipeaters);
+  frame_.clear();
+  frame_.push_back(kFEND);
+  frame_.push_back(kiss_port << 4);  // Data frame.
+  frame_.insert(frame_.end(), header.begin(), header.end());
+}
+
+void KISSFrameBuilder::BeginAckMode(uint8_t kiss_port, uint16_t sequence,
+    const CallsignConfig& source, const CallsignConfig& destination,
+    const std::vector<CallsignConfig>& digipeaters) {
+  const auto& header = GetAddressHeader(source, destination, digipeaters);
+  frame_.clear();
+  frame_.push_back(kFEND);
+  frame_.push_back((kiss_port << 4) | kCommandAckMode);
+  AppendEscaped(sequence >> 8, &frame_);
+  AppendEscaped(sequence & 0xff, &frame_);
+  frame_.insert(frame_.end(), header.begin(), header.end());
+}
+
+void KISSFrameBuilder::Append(const uint8_t* data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    AppendEscaped(data[i], &frame_);
+  }
+}
+
+void KISSFrameBuilder::AppendBase64(const uint8_t* data, size_t size) {
+  // None of the base64 characters require escaping, so they are written
+  // directly.
+  size_t offset = frame_.size();
+  frame_.resize(offset + ((size + 2) / 3) * 4);
+  uint8_t* output = &frame_[offset];
+  size_t i = 0;
+  for (; i + 3 <= size; i += 3) {
+    uint32_t bits = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    *output++ = kBase64Alphabet[(bits >> 18) & 0x3f];
+    *output++ = kBase64Alphabet[(bits >> 12) & 0x3f];
+    *output++ = kBase64Alphabet[(bits >> 6) & 0x3f];
+    *output++ = kBase64Alphabet[bits & 0x3f];
+  }
+
+  size_t remaining = size - i;
+  if (remaining > 0) {
+    uint32_t bits = data[i] << 16;
+    if (remaining == 2) {
+      bits |= data[i + 1] << 8;
+    }
+
+    *output++ = kBase64Alphabet[(bits >> 18) & 0x3f];
+    *output++ = kBase64Alphabet[(bits >> 12) & 0x3f];
+    *output++ = (remaining == 2) ? kBase64Alphabet[(bits >> 6) & 0x3f] : '=';
+    *output++ = '=';
+  }
+}
+
+void KISSFrameBuilder::AppendBase91(const uint8_t* data, size_t size) {
+  // None of the base91 characters require escaping either.
+  size_t offset = frame_.size();
+  frame_.resize(offset + Base91::GetMaxEncodedSize(size));
+  frame_.resize(offset + Base91::Encode(data, size,
+      reinterpret_cast<char*>(&frame_[offset])));
+}
+
+const std::vector<uint8_t>& KISSFrameBuilder::End() {
+  frame_.push_back(kFEND);
+  return frame_;
+}
+
+const std::vector<uint8_t>& KISSFrameBuilder::BuildCommand(uint8_t kiss_port,
+    uint8_t command, const uint8_t* data, size_t size) {
+  frame_.clear();
+  frame_.push_back(kFEND);
+  frame_.push_back((kiss_port << 4) | (command & 0x0f));
+  Append(data, size);
+  frame_.push_back(kFEND);
+  return frame_;
+}
+
+const std::vector<uint8_t>& KISSFrameBuilder::GetAddressHeader(
+    const CallsignConfig& source, const CallsignConfig& destination,
+    const std::vector<CallsignConfig>& digipeaters) {
+  auto header_it = std::find_if(headers_.begin(), headers_.end(),
+      [&](const AddressHeader& header) {
+        return header.source == source
+            && header.destination == destination
+            && header.digipeaters == digipeaters;
+      });
+  if (header_it != headers_.end()) {
+    std::rotate(headers_.begin(), header_it, header_it + 1);
+    return headers_.front().encoded;
+  }
+
+  if (digipeaters.size() > AX25FrameView::kMaxDigipeaterCount) {
+    LOGFATAL("too many digipeaters specified");
+  }
+
+  // Reuse the least recently used header once the cache is full.
+  if (headers_.size() < kMaxCachedHeaders) {
+    headers_.emplace_back();
+  }
+
+  std::rotate(headers_.begin(), headers_.end() - 1, headers_.end());
+  AddressHeader& header = headers_.front();
+  header.source = source;
+  header.destination = destination;
+  header.digipeaters = digipeaters;
+  header.encoded.clear();
+  AppendAX25Callsign(destination, /*last=*/false, &header.encoded);
+  AppendAX25Callsign(source, /*last=*/digipeaters.empty(), &header.encoded);
+  for (size_t i = 0; i < digipeaters.size(); i++) {
+    AppendAX25Callsign(digipeaters[i],
+        /*last=*/(i == (digipeaters.size() - 1)), &header.encoded);
+  }
+
+  AppendEscaped(AX25FrameView::kControlUIFrame, &header.encoded);
+  AppendEscaped(AX25FrameView::kProtocolIdNone, &header.encoded);
+  return header.encoded;
+}
+
+void KISSFrameBuilder::AppendEscaped(uint8_t byte,
+    std::vector<uint8_t>* buffer) {
+  if (byte == kFEND) {
+    buffer->push_back(kFESC);
+    buffer->push_back(kTFEND);
+  } else if (byte == kFESC) {
+    buffer->push_back(kFESC);
+    buffer->push_back(kTFESC);
+  } else {
+    buffer->push_back(byte);
+  }
+}
+
+void KISSFrameBuilder::AppendAX25Callsign(const CallsignConfig& config,
+    bool last, std::vector<uint8_t>* buffer) {
+  if (config.ssid < 0 || config.ssid > 15) {
+    LOGFATAL("invalid SSID: %d", config.ssid);
+  }
+
+  if (config.callsign.length() > AX25AddressView::kMaxCallsignLength) {
+    LOGFATAL("invalid callsign '%s'", config.callsign.c_str());
+  }
+
+  for (size_t i = 0; i < AX25AddressView::kMaxCallsignLength; i++) {
+    char c = (i < config.callsign.length()) ? config.callsign[i] : ' ';
+    AppendEscaped(static_cast<uint8_t>(c) << 1, buffer);
+  }
+
+  AppendEscaped(0x60 | (config.ssid << 1) | (last ? 0x01 : 0x00), buffer);
+}
+
+}  // namespace au
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_KISS_FRAME_BUILDER_H_
+#define APRS_UTILS_NET_KISS_FRAME_BUILDER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "util/callsign.h"
+#include "util/non_copyable.h"
+
+namespace au {
+
+// Builds KISS encapsulated AX.25 UI frames in a single pass into a reusable
+// buffer. The payload is escaped as it is written, and the encoded address
+// header is cached for the most recently used sets of addresses so that
+// repeated frames between the same stations only copy it.
+class KISSFrameBuilder : public NonCopyable {
+ public:
+  // The maximum number of encoded address headers to cache.
+  static constexpr size_t kMaxCachedHeaders = 8;
+
+  // Starts a new UI frame for the supplied port and addresses, discarding any
+  // frame in progress.
+  void Begin(uint8_t kiss_port, const CallsignConfig& source,
+      const CallsignConfig& destination,
+      const std::vector<CallsignConfig>& digipeaters);
+
+  // Starts a new UI frame using the KISS ACKMODE extension. The TNC replies
+  // with the sequence number once the frame has been transmitted.
+  void BeginAckMode(uint8_t kiss_port, uint16_t sequence,
+      const CallsignConfig& source, const CallsignConfig& destination,
+      const std::vector<CallsignConfig>& digipeaters);
+
+  // Appends bytes to the information field of the frame.
+  void Append(const uint8_t* data, size_t size);
+
+  // Appends a string to the information field of the frame.
+  void Append(const std::string& data) {
+    Append(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+  }
+
+  // Appends the base64 encoding of the supplied bytes to the information field
+  // of the frame.
+  void AppendBase64(const uint8_t* data, size_t size);
+
+  // Appends the base91 encoding of the supplied bytes to the information field
+  // of the frame.
+  void AppendBase91(const uint8_t* data, size_t size);
+
+  // Completes the frame and returns the encoded KISS frame. This remains valid
+  // until the next call to Begin.
+  const std::vector<uint8_t>& End();
+
+  // Builds a KISS command frame with the supplied parameter bytes, discarding
+  // any frame in progress. The returned frame remains valid until the next
+  // call to Begin or BuildCommand.
+  const std::vector<uint8_t>& BuildCommand(uint8_t kiss_port, uint8_t command,
+      const uint8_t* data, size_t size);
+
+ private:
+  // The encoded address header for a set of addresses.
+  struct AddressHeader {
+    // The addresses that this header was encoded for.
+    CallsignConfig source;
+    CallsignConfig destination;
+    std::vector<CallsignConfig> digipeaters;
+
+    // The KISS escaped addresses, control field and protocol id.
+    std::vector<uint8_t> encoded;
+  };
+
+  // The cached address headers, with the most recently used first.
+  std::vector<AddressHeader> headers_;
+
+  // The frame being built.
+  std::vector<uint8_t> frame_;
+
+  // Returns the encoded address header for the supplied addresses, encoding
+  // it if it is not cached.
+  const std::vector<uint8_t>& GetAddressHeader(const CallsignConfig& source,
+      const CallsignConfig& destination,
+      const std::vector<CallsignConfig>& digipeaters);
+
+  // Appends an escaped byte to the supplied buffer.
+  static void AppendEscaped(uint8_t byte, std::vector<uint8_t>* buffer);
+
+  // Appends an escaped AX.25 formatted callsign to the supplied buffer.
+  static void AppendAX25Callsign(const CallsignConfig& config, bool last,
+      std::vector<uint8_t>* buffer);
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_KISS_FRAME_BUILDER_H_
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/kiss_frame_queue.h"
+
+#include <algorithm>
+
+#include "util/log.h"
+
+#define LOG_TAG "KISSFrameQueue"
+
+namespace au {
+
+KISSFrameQueue::KISSFrameQueue(size_t max_size)
+    : max_size_(max_size),
+      head_(0),
+      size_(0),
+      dropped_count_(0) {
+  if (max_size_ == 0) {
+    LOGFATAL("queue must hold at least one frame");
+  }
+}
+
+KISSFrame& KISSFrameQueue::GetFront() {
+  if (IsEmpty()) {
+    LOGFATAL("front of empty queue requested");
+  }
+
+  return frames_[head_];
+}
+
+void KISSFrameQueue::PopFront() {
+  if (IsEmpty()) {
+    LOGFATAL("pop from empty queue requested");
+  }
+
+  head_ = (head_ + 1) % frames_.size();
+  size_--;
+}
+
+KISSFrame* KISSFrameQueue::GetBack() {
+  if (size_ == frames_.size()) {
+    // Grow the storage with the oldest frame at the start so that the ring
+    // remains contiguous.
+    std::rotate(frames_.begin(), frames_.begin() + head_, frames_.end());
+    head_ = 0;
+    frames_.emplace_back();
+  }
+
+  KISSFrame* frame = &frames_[(head_ + size_) % frames_.size()];
+  frame->port = 0;
+  frame->command = 0;
+  frame->data.clear();
+  return frame;
+}
+
+void KISSFrameQueue::PushBack() {
+  if (size_ == max_size_) {
+    head_ = (head_ + 1) % frames_.size();
+    size_--;
+    dropped_count_++;
+  }
+
+  size_++;
+}
+
+}  // namespace au
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_KISS_FRAME_QUEUE_H_
+#define APRS_UTILS_NET_KISS_FRAME_QUEUE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "util/non_copyable.h"
+
+namespace au {
+
+// A frame that has been exchanged with a KISS TNC.
+struct KISSFrame {
+  // The TNC port that this frame belongs to (the high nibble of the KISS
+  // command byte).
+  uint8_t port;
+
+  // The KISS command of this frame (the low nibble of the KISS command byte).
+  uint8_t command;
+
+  // The contents of this frame with KISS escaping removed.
+  std::vector<uint8_t> data;
+};
+
+// A ring of KISS frames. The storage for frames is retained as they are popped
+// and reused for subsequent frames, so a queue that has reached its working
+// size no longer allocates.
+class KISSFrameQueue : public NonCopyable {
+ public:
+  // Setup the queue with the maximum number of frames to hold. Once the queue
+  // is full, the oldest frame is dropped to make room for a new one.
+  explicit KISSFrameQueue(size_t max_size);
+
+  // Returns true if there are no frames in the queue.
+  bool IsEmpty() const { return size_ == 0; }
+
+  // Returns the number of frames in the queue.
+  size_t GetSize() const { return size_; }
+
+  // Returns the number of frames that have been dropped due to overflow.
+  uint64_t GetDroppedCount() const { return dropped_count_; }
+
+  // Returns the oldest frame in the queue. The queue must not be empty.
+  KISSFrame& GetFront();
+
+  // Removes the oldest frame from the queue. The queue must not be empty.
+  void PopFront();
+
+  // Returns cleared storage for a new frame at the back of the queue. The frame
+  // is not part of the queue until PushBack is called, and the same storage is
+  // returned until then.
+  KISSFrame* GetBack();
+
+  // Appends the frame returned by GetBack to the queue.
+  void PushBack();
+
+ private:
+  // The maximum number of frames to hold.
+  const size_t max_size_;
+
+  // The storage for frames. One more slot than max_size_ may be allocated to
+  // hold the frame being built by GetBack.
+  std::vector<KISSFrame> frames_;
+
+  // The index of the oldest frame in frames_.
+  size_t head_;
+
+  // The number of frames in the queue.
+  size_t size_;
+
+  // The number of frames dropped due to overflow.
+  uint64_t dropped_count_;
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_KISS_FRAME_QUEUE_H_
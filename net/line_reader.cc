@@ -0,0 +1,95 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/line_reader.h"
+
+#include <cstring>
+#include <utility>
+
+#include "util/log.h"
+
+#define LOG_TAG "LineReader"
+
+namespace au {
+
+LineReader::LineReader(size_t buffer_size)
+    : buffer_(buffer_size),
+      start_(0),
+      scan_(0),
+      end_(0),
+      stats_() {}
+
+ssize_t LineReader::Read(TCPSocket* socket) {
+  // Move the partial line to the start of the buffer to make room.
+  if (start_ > 0) {
+    memmove(buffer_.data(), buffer_.data() + start_, end_ - start_);
+    scan_ -= start_;
+    end_ -= start_;
+    start_ = 0;
+  }
+
+  if (end_ == buffer_.size()) {
+    LOGE("discarding line longer than %zu bytes", buffer_.size());
+    stats_.discarded_count++;
+    Clear();
+  }
+
+  ssize_t read_result = socket->Read(buffer_.data() + end_,
+      buffer_.size() - end_);
+  if (read_result > 0) {
+    end_ += read_result;
+    stats_.read_count++;
+    stats_.byte_count += read_result;
+  }
+
+  return read_result;
+}
+
+bool LineReader::GetLine(std::string_view* line) {
+  const char* newline = static_cast<const char*>(
+      memchr(buffer_.data() + scan_, '\n', end_ - scan_));
+  if (newline == nullptr) {
+    scan_ = end_;
+    return false;
+  }
+
+  const char* line_start = buffer_.data() + start_;
+  size_t length = newline - line_start;
+  if (length > 0 && line_start[length - 1] == '\r') {
+    length--;
+  }
+
+  *line = std::string_view(line_start, length);
+  start_ = scan_ = (newline - buffer_.data()) + 1;
+  stats_.line_count++;
+  return true;
+}
+
+void LineReader::Clear() {
+  start_ = 0;
+  scan_ = 0;
+  end_ = 0;
+}
+
+void LineReader::Swap(LineReader* other) {
+  buffer_.swap(other->buffer_);
+  std::swap(start_, other->start_);
+  std::swap(scan_, other->scan_);
+  std::swap(end_, other->end_);
+  std::swap(stats_, other->stats_);
+}
+
+}  // namespace au
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_LINE_READER_H_
+#define APRS_UTILS_NET_LINE_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "net/tcp_socket.h"
+#include "util/non_copyable.h"
+
+namespace au {
+
+// Splits the bytes read from a socket into lines. Bytes are read in bulk into
+// a large buffer and lines are returned as views into it, so a line is never
+// copied.
+class LineReader : public NonCopyable {
+ public:
+  // Statistics about the lines read by this reader.
+  struct Stats {
+    // The number of reads from the socket that returned bytes.
+    uint64_t read_count;
+
+    // The number of bytes read from the socket.
+    uint64_t byte_count;
+
+    // The number of complete lines returned.
+    uint64_t line_count;
+
+    // The number of lines discarded because they did not fit in the buffer.
+    uint64_t discarded_count;
+  };
+
+  // The default size of the buffer. This bounds the length of a line.
+  static constexpr size_t kDefaultBufferSize = 64 * 1024;
+
+  // Setup the reader with an empty buffer.
+  LineReader(size_t buffer_size = kDefaultBufferSize);
+
+  // Reads the bytes that are available from the socket without blocking.
+  // Returns the number of bytes read, 0 if no bytes are available and -1 if
+  // the connection has failed. Views returned by GetLine are invalidated.
+  ssize_t Read(TCPSocket* socket);
+
+  // Returns the next complete line without the line terminator. Lines end with
+  // "\r\n" or "\n". The view remains valid until the next call to Read or
+  // Clear. Returns false if no complete line is buffered.
+  bool GetLine(std::string_view* line);
+
+  // Discards all buffered bytes, such as when the connection is replaced.
+  void Clear();
+
+  // Exchanges the buffered bytes and statistics of this reader and the
+  // supplied reader, such as when a connection is handed over.
+  void Swap(LineReader* other);
+
+  // Returns the statistics of this reader.
+  const Stats& GetStats() const { return stats_; }
+
+ private:
+  // The buffer that bytes are read into.
+  std::vector<char> buffer_;
+
+  // The offset of the first byte that has not been returned as part of a line.
+  size_t start_;
+
+  // The offset of the first byte that has not been searched for the end of a
+  // line.
+  size_t scan_;
+
+  // The offset after the last byte read into the buffer.
+  size_t end_;
+
+  // The statistics of this reader.
+  Stats stats_;
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_LINE_READER_H_
@@ -16,7 +16,9 @@
 
 #include "net/packet_chunk_receiver.h"
 
+#include <algorithm>
 #include <cinttypes>
+#include <utility>
 
 #include "util/log.h"
 #include "util/time.h"
@@ -25,7 +27,7 @@
 
 namespace au {
 
-bool PacketChunkReceiver::PushPacketChunk(
+bool PacketChunkReceiver::PushPacketChunk(const CallsignConfig& source,
     const PacketChunk::Chunk& chunk, Packet* packet) {
   if (!chunk.has_payload_id()) {
     LOGE("received packet chunk with missing payload id");
@@ -39,11 +41,22 @@ bool PacketChunkReceiver::PushPacketChunk(
   } else if (!chunk.has_payload()) {
     LOGE("received packet chunk with missing payload");
     return false;
+  } else if (chunk.has_fec_source_count()
+      && (!chunk.has_fec_symbol_id() || !chunk.has_total_payload_size())) {
+    LOGE("received erasure coded packet chunk with missing symbol");
+    return false;
+  } else if (chunk.has_fec_source_count()
+      && (chunk.fec_source_count() == 0
+          || chunk.fec_source_count() > ErasureCode::kMaxSymbolCount
+          || chunk.total_payload_size() < chunk.fec_source_count())) {
+    LOGE("received erasure coded packet chunk with invalid source count %"
+        PRIu32, chunk.fec_source_count());
+    return false;
   }
 
+  auto completed_id = std::make_pair(source, chunk.payload_id());
   auto completed_it = std::find(
-      completed_packets_.begin(), completed_packets_.end(),
-      chunk.payload_id());
+      completed_packets_.begin(), completed_packets_.end(), completed_id);
   if (completed_it != completed_packets_.end()) {
     LOGI("received packet chunk for completed payload %" PRIu32,
         chunk.payload_id());
@@ -52,7 +65,8 @@ bool PacketChunkReceiver::PushPacketChunk(
 
   for (size_t i = 0; i < packets_.size(); i++) {
     auto& packet_chunks = packets_[i];
-    if (packet_chunks.chunks.front().payload_id() == chunk.payload_id()) {
+    if (packet_chunks.source == source
+        && packet_chunks.chunks.front().payload_id() == chunk.payload_id()) {
       // Update the last seen time for this packet id.
       packet_chunks.last_fragment_time_us = GetTimeNowUs();
 
@@ -70,9 +84,9 @@ bool PacketChunkReceiver::PushPacketChunk(
 
       // Append the new fragment and check if we have a complete frame yet.
       packet_chunks.chunks.push_back(chunk);
-      bool is_complete = packet_chunks.IsComplete(packet);
+      bool is_complete = packet_chunks.PushChunk(chunk, packet);
       if (is_complete) {
-        completed_packets_.push_back(chunk.payload_id());
+        completed_packets_.push_back(completed_id);
         packets_.erase(packets_.begin() + i);
       }
 
@@ -85,17 +99,68 @@ bool PacketChunkReceiver::PushPacketChunk(
   LOGI("receiving new payload with id %" PRIu32, chunk.payload_id());
 
   PacketChunks packet_chunks;
+  packet_chunks.source = source;
   packet_chunks.last_fragment_time_us = GetTimeNowUs();
   packet_chunks.chunks.push_back(chunk);
-  if (packet_chunks.IsComplete(packet)) {
-    completed_packets_.push_back(chunk.payload_id());
+  if (packet_chunks.PushChunk(chunk, packet)) {
+    completed_packets_.push_back(completed_id);
     return true;
   }
 
-  packets_.push_back(packet_chunks);
+  packets_.push_back(std::move(packet_chunks));
   return false;
 }
 
+bool PacketChunkReceiver::GetChunkAck(const CallsignConfig& source,
+    uint32_t payload_id, PacketChunk::ChunkAck* ack) const {
+  ack->Clear();
+  ack->set_payload_id(payload_id);
+  if (std::find(completed_packets_.begin(), completed_packets_.end(),
+        std::make_pair(source, payload_id)) != completed_packets_.end()) {
+    ack->set_complete(true);
+    return true;
+  }
+
+  auto packet_it = std::find_if(packets_.begin(), packets_.end(),
+      [&](const PacketChunks& packet_chunks) {
+        return packet_chunks.source == source
+            && packet_chunks.chunks.front().payload_id() == payload_id;
+      });
+  if (packet_it == packets_.end()) {
+    return false;
+  }
+
+  std::vector<uint32_t> chunk_ids;
+  for (const auto& chunk : packet_it->chunks) {
+    chunk_ids.push_back(chunk.chunk_id());
+  }
+
+  std::sort(chunk_ids.begin(), chunk_ids.end());
+  uint32_t cumulative_chunk_id = 0;
+  std::string bitmap;
+  for (uint32_t chunk_id : chunk_ids) {
+    if (chunk_id == cumulative_chunk_id + 1 && bitmap.empty()) {
+      cumulative_chunk_id = chunk_id;
+      continue;
+    }
+
+    size_t bit = chunk_id - cumulative_chunk_id - 2;
+    if (bit >= kMaxAckBitmapChunks) {
+      break;
+    }
+
+    bitmap.resize(bit / 8 + 1, '\0');
+    bitmap[bit / 8] |= 1 << (bit % 8);
+  }
+
+  ack->set_chunk_id(cumulative_chunk_id);
+  if (!bitmap.empty()) {
+    ack->set_received_bitmap(bitmap);
+  }
+
+  return true;
+}
+
 bool PacketChunkReceiver::PacketChunks::IsComplete(Packet* packet) {
   std::sort(chunks.begin(), chunks.end(),
       [](const PacketChunk::Chunk& a, const PacketChunk::Chunk& b) {
@@ -130,4 +195,56 @@ bool PacketChunkReceiver::PacketChunks::IsComplete(Packet* packet) {
   return true;
 }
 
+bool PacketChunkReceiver::PacketChunks::AddErasureCodedChunk(
+    const PacketChunk::Chunk& chunk, Packet* packet) {
+  if (decoder == nullptr) {
+    size_t symbol_size = (chunk.total_payload_size()
+        + chunk.fec_source_count() - 1) / chunk.fec_source_count();
+    decoder = std::make_unique<ErasureDecoder>(
+        chunk.fec_source_count(), symbol_size);
+  } else if (decoder->GetSourceCount() != chunk.fec_source_count()) {
+    LOGE("packet %" PRIu32 " chunk source count %" PRIu32
+        " does not match %zu", chunk.payload_id(), chunk.fec_source_count(),
+        decoder->GetSourceCount());
+    return false;
+  }
+
+  if (!decoder->AddSymbol(chunk.fec_symbol_id(), chunk.payload())) {
+    LOGI("packet %" PRIu32 " symbol %" PRIu32 " does not add information",
+        chunk.payload_id(), chunk.fec_symbol_id());
+    return false;
+  } else if (!decoder->IsComplete()) {
+    LOGI("packet %" PRIu32 " received %zu/%zu symbols", chunk.payload_id(),
+        decoder->GetRank(), decoder->GetSourceCount());
+    return false;
+  }
+
+  // The last source symbol is padded to the symbol size, so trim the source
+  // back to the payload size.
+  std::string serialized_payload;
+  decoder->GetSource(&serialized_payload);
+  serialized_payload.resize(chunk.total_payload_size());
+  if (!packet->ParseFromString(serialized_payload)) {
+    LOGE("failed to deserialize erasure coded payload %" PRIu32,
+        chunk.payload_id());
+    return false;
+  }
+
+  LOGI("complete packet %" PRIu32 " decoded from %zu chunks",
+      chunk.payload_id(), chunks.size());
+  return true;
+}
+
+bool PacketChunkReceiver::PacketChunks::PushChunk(
+    const PacketChunk::Chunk& chunk, Packet* packet) {
+  if (chunk.has_fec_source_count()) {
+    // The payload of the chunk is held by the decoder from here on, and only
+    // the chunk id is needed to ignore repeats.
+    chunks.back().clear_payload();
+    return AddErasureCodedChunk(chunk, packet);
+  }
+
+  return IsComplete(packet);
+}
+
 }  // namespace au
@@ -17,39 +17,73 @@
 #ifndef APRS_UTILS_NET_PACKET_CHUNK_RECEIVER_H_
 #define APRS_UTILS_NET_PACKET_CHUNK_RECEIVER_H_
 
+#include <memory>
+#include <utility>
 #include <vector>
 
+#include "net/erasure_code.h"
 #include "proto/packet.pb.h"
+#include "util/callsign.h"
 #include "util/non_copyable.h"
 
 namespace au {
 
-// Handles incoming packet fragments and forms complete packets.
+// Handles incoming packet fragments and forms complete packets. Payload ids
+// are scoped to the callsign of the station that sent them, so that stations
+// using short payload ids do not collide.
 class PacketChunkReceiver : public NonCopyable {
  public:
-  // Pushes a new fragment into the fragment manager. Returns true if a
-  // complete packet is received and populates the supplied packet.
-  bool PushPacketChunk(const PacketChunk::Chunk& chunk, Packet* packet);
+  // Pushes a new fragment from the supplied source into the fragment manager.
+  // Returns true if a complete packet is received and populates the supplied
+  // packet.
+  bool PushPacketChunk(const CallsignConfig& source,
+      const PacketChunk::Chunk& chunk, Packet* packet);
+
+  // Populates an acknowledgement of the chunks received for a payload from the
+  // supplied source. Returns false if no chunks have been received for the
+  // payload.
+  bool GetChunkAck(const CallsignConfig& source, uint32_t payload_id,
+      PacketChunk::ChunkAck* ack) const;
 
  private:
+  // The maximum number of chunks beyond the cumulative acknowledgement that
+  // are reported in the bitmap of a ChunkAck.
+  static constexpr size_t kMaxAckBitmapChunks = 64;
+
   // Incoming chunks for a given packet.
   struct PacketChunks {
+    // The station that is sending this packet.
+    CallsignConfig source;
+
     // The timestamp of the last chunk received for this packet.
     uint64_t last_fragment_time_us;
 
     // The chunks received for this packet thus far.
     std::vector<PacketChunk::Chunk> chunks;
 
+    // The decoder for payloads sent with forward error correction, created
+    // with the first erasure coded chunk.
+    std::unique_ptr<ErasureDecoder> decoder;
+
     // Returns true if the chunks make a complete packet. If the packet is
     // complete, the supplied pointer is populated.
     bool IsComplete(Packet* packet);
+
+    // Adds an erasure coded chunk to the decoder. Returns true if this
+    // completes the packet and populates the supplied pointer.
+    bool AddErasureCodedChunk(const PacketChunk::Chunk& chunk, Packet* packet);
+
+    // Pushes a chunk that has been appended to the chunks and returns true if
+    // it completes the packet.
+    bool PushChunk(const PacketChunk::Chunk& chunk, Packet* packet);
   };
 
   // The list of incoming packet chunks.
   std::vector<PacketChunks> packets_;
 
-  // The list of completed packets to avoid receiving the same frame twice.
-  std::vector<uint32_t> completed_packets_;
+  // The list of completed packets to avoid receiving the same frame twice,
+  // identified by source and payload id.
+  std::vector<std::pair<CallsignConfig, uint32_t>> completed_packets_;
 };
 
 }  // namespace au
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/reconnect_backoff.h"
+
+#include <algorithm>
+
+#include "util/time.h"
+
+namespace au {
+
+ReconnectBackoff::ReconnectBackoff(uint32_t initial_delay_ms,
+    uint32_t max_delay_ms)
+    : initial_delay_ms_(std::max<uint32_t>(initial_delay_ms, 1)),
+      max_delay_ms_(std::max(max_delay_ms, initial_delay_ms_)),
+      next_delay_ms_(initial_delay_ms_),
+      disconnected_(false),
+      disconnected_time_us_(0),
+      attempt_count_(0),
+      random_(GetTimeNowUs()),
+      stats_() {}
+
+void ReconnectBackoff::OnDisconnected() {
+  if (!disconnected_) {
+    disconnected_ = true;
+    disconnected_time_us_ = GetTimeNowUs();
+    next_delay_ms_ = initial_delay_ms_;
+    attempt_count_ = 0;
+  }
+}
+
+uint32_t ReconnectBackoff::GetNextDelayMs() {
+  if (!disconnected_) {
+    return 0;
+  }
+
+  uint32_t delay_ms = next_delay_ms_;
+  next_delay_ms_ = std::min(next_delay_ms_ * 2, max_delay_ms_);
+  attempt_count_++;
+
+  std::uniform_int_distribution<uint32_t> jitter(delay_ms / 2, delay_ms);
+  return jitter(random_);
+}
+
+uint64_t ReconnectBackoff::OnConnected() {
+  if (!disconnected_) {
+    return 0;
+  }
+
+  uint64_t downtime_us = GetTimeNowUs() - disconnected_time_us_;
+  disconnected_ = false;
+  next_delay_ms_ = initial_delay_ms_;
+  stats_.reconnect_count++;
+  stats_.failed_attempt_count += attempt_count_ > 0 ? attempt_count_ - 1 : 0;
+  stats_.downtime_us += downtime_us;
+  return downtime_us;
+}
+
+}  // namespace au
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_RECONNECT_BACKOFF_H_
+#define APRS_UTILS_NET_RECONNECT_BACKOFF_H_
+
+#include <cstdint>
+#include <random>
+
+#include "util/non_copyable.h"
+
+namespace au {
+
+// Tracks attempts to restore a lost connection. The delay between attempts
+// grows exponentially with random jitter so that many clients of a failed
+// server do not reconnect in lockstep, and the time spent disconnected is
+// recorded.
+class ReconnectBackoff : public NonCopyable {
+ public:
+  // Statistics about the connection losses.
+  struct Stats {
+    // The number of times the connection has been restored.
+    uint64_t reconnect_count;
+
+    // The number of attempts to reconnect that failed before the connection
+    // was restored.
+    uint64_t failed_attempt_count;
+
+    // The total time spent disconnected, in microseconds.
+    uint64_t downtime_us;
+  };
+
+  // The default delay before the first attempt to reconnect.
+  static constexpr uint32_t kDefaultInitialDelayMs = 250;
+
+  // The default upper bound on the delay between attempts.
+  static constexpr uint32_t kDefaultMaxDelayMs = 30000;
+
+  // Setup the backoff in the connected state.
+  ReconnectBackoff(uint32_t initial_delay_ms = kDefaultInitialDelayMs,
+      uint32_t max_delay_ms = kDefaultMaxDelayMs);
+
+  // Records that the connection has been lost. Has no effect if it is already
+  // disconnected.
+  void OnDisconnected();
+
+  // Returns the time to wait before the next attempt to reconnect, which is
+  // counted as an attempt. Each call doubles the delay up to the maximum, and
+  // the returned delay is chosen randomly between half of and the full delay.
+  uint32_t GetNextDelayMs();
+
+  // Records that the connection has been restored and resets the delay.
+  // Returns the time spent disconnected in microseconds.
+  uint64_t OnConnected();
+
+  // Returns true if the connection has been lost and not yet restored.
+  bool IsDisconnected() const { return disconnected_; }
+
+  // Returns the statistics of this backoff.
+  const Stats& GetStats() const { return stats_; }
+
+ private:
+  // The delay before the first attempt to reconnect.
+  const uint32_t initial_delay_ms_;
+
+  // The upper bound on the delay between attempts.
+  const uint32_t max_delay_ms_;
+
+  // The delay to use for the next attempt, before jitter.
+  uint32_t next_delay_ms_;
+
+  // Set to true while the connection is lost.
+  bool disconnected_;
+
+  // The time that the connection was lost.
+  uint64_t disconnected_time_us_;
+
+  // The number of attempts to reconnect since the connection was lost.
+  uint64_t attempt_count_;
+
+  // The source of jitter.
+  std::minstd_rand random_;
+
+  // The statistics of this backoff.
+  Stats stats_;
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_RECONNECT_BACKOFF_H_
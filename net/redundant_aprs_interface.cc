@@ -0,0 +1,201 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/redundant_aprs_interface.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "util/log.h"
+#include "util/time.h"
+
+#define LOG_TAG "RedundantAPRSInterface"
+
+namespace au {
+
+RedundantAPRSInterface::RedundantAPRSInterface(
+    const APRSInterface::Config& config,
+    std::vector<std::unique_ptr<InternetAPRSInterface>> interfaces,
+    uint32_t duplicate_window_ms)
+    : APRSInterface(config),
+      duplicate_window_ms_(duplicate_window_ms),
+      connections_(interfaces.size()),
+      stats_(),
+      running_(true) {
+  event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (event_fd_ < 0) {
+    LOGFATAL("failed to create eventfd: %s (%d)", strerror(errno), errno);
+  }
+
+  for (size_t i = 0; i < interfaces.size(); i++) {
+    auto& connection = connections_[i];
+    connection.aprs_interface = std::move(interfaces[i]);
+    connection.first_arrival_count = 0;
+    connection.reader_thread = std::thread(
+        &RedundantAPRSInterface::ReadFrames, this, &connection);
+  }
+}
+
+RedundantAPRSInterface::~RedundantAPRSInterface() {
+  running_ = false;
+  for (auto& connection : connections_) {
+    connection.aprs_interface->Stop();
+  }
+
+  for (size_t i = 0; i < connections_.size(); i++) {
+    connections_[i].reader_thread.join();
+    LOGI("connection %zu received %" PRIu64 " frames first", i,
+        connections_[i].first_arrival_count);
+  }
+
+  LOGI("delivered %" PRIu64 " frames, dropped %" PRIu64 " duplicates and "
+      "%" PRIu64 " overflowed frames", stats_.frame_count,
+      stats_.duplicate_count, stats_.dropped_count);
+  close(event_fd_);
+}
+
+RedundantAPRSInterface::Stats RedundantAPRSInterface::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+std::vector<uint64_t> RedundantAPRSInterface::GetFirstArrivalCounts() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<uint64_t> counts;
+  for (const auto& connection : connections_) {
+    counts.push_back(connection.first_arrival_count);
+  }
+
+  return counts;
+}
+
+bool RedundantAPRSInterface::Send(const std::string& /*payload*/,
+    const CallsignConfig& /*source*/, const CallsignConfig& /*destination*/,
+    const std::vector<CallsignConfig>& /*digipeaters*/) {
+  LOGE("sending via the internet is not supported");
+  return false;
+}
+
+bool RedundantAPRSInterface::Receive(
+    CallsignConfig* source, CallsignConfig* destination,
+    std::vector<CallsignConfig>* digipeaters, std::string* payload,
+    uint32_t timeout_ms) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto frame_queued = [this]() { return !frames_.empty(); };
+  if (timeout_ms == 0) {
+    frame_queued_cv_.wait(lock, frame_queued);
+  } else if (!frame_queued_cv_.wait_for(lock,
+        std::chrono::milliseconds(timeout_ms), frame_queued)) {
+    LOGV("timeout receiving frame");
+    return false;
+  }
+
+  Frame frame;
+  PopFrame(&frame);
+  *source = std::move(frame.source);
+  *destination = std::move(frame.destination);
+  *digipeaters = std::move(frame.digipeaters);
+  *payload = std::move(frame.payload);
+  return true;
+}
+
+int RedundantAPRSInterface::GetFileDescriptor() const {
+  return event_fd_;
+}
+
+bool RedundantAPRSInterface::ReceiveAvailable(const FrameCallback& callback) {
+  // Reset the eventfd before consuming the queue so that frames queued after
+  // this point wake the event loop again.
+  uint64_t count;
+  if (read(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+    LOGE("failed to read eventfd: %s (%d)", strerror(errno), errno);
+    return false;
+  }
+
+  Frame frame;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (frames_.empty()) {
+        return true;
+      }
+
+      PopFrame(&frame);
+    }
+
+    callback(frame.source, frame.destination, frame.digipeaters,
+        frame.payload);
+  }
+}
+
+void RedundantAPRSInterface::ReadFrames(Connection* connection) {
+  APRSInterface* aprs_interface = connection->aprs_interface.get();
+  Frame frame;
+  while (running_) {
+    if (aprs_interface->Receive(&frame.source, &frame.destination,
+          &frame.digipeaters, &frame.payload, kReceiveTimeoutMs)) {
+      QueueFrame(connection, &frame);
+    }
+  }
+}
+
+void RedundantAPRSInterface::QueueFrame(Connection* connection,
+    Frame* frame) {
+  // The digipeater path differs between copies, so it is not part of the key.
+  std::string key = frame->source.ToString() + ">"
+      + frame->destination.ToString() + ":" + frame->payload;
+  uint64_t time_now_us = GetTimeNowUs();
+  uint64_t window_us = static_cast<uint64_t>(duplicate_window_ms_) * 1000;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (!recent_frame_order_.empty()
+      && time_now_us - recent_frame_order_.front().first >= window_us) {
+    recent_frames_.erase(recent_frame_order_.front().second);
+    recent_frame_order_.pop_front();
+  }
+
+  if (!recent_frames_.emplace(key, time_now_us).second) {
+    stats_.duplicate_count++;
+    return;
+  }
+
+  recent_frame_order_.emplace_back(time_now_us, std::move(key));
+  connection->first_arrival_count++;
+  if (frames_.size() == kMaxQueuedFrames) {
+    frames_.pop_front();
+    stats_.dropped_count++;
+  }
+
+  frames_.push_back(std::move(*frame));
+  stats_.frame_count++;
+  frame_queued_cv_.notify_one();
+
+  uint64_t increment = 1;
+  if (write(event_fd_, &increment, sizeof(increment)) < 0) {
+    LOGE("failed to write eventfd: %s (%d)", strerror(errno), errno);
+  }
+}
+
+void RedundantAPRSInterface::PopFrame(Frame* frame) {
+  *frame = std::move(frames_.front());
+  frames_.pop_front();
+}
+
+}  // namespace au
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_REDUNDANT_APRS_INTERFACE_H_
+#define APRS_UTILS_NET_REDUNDANT_APRS_INTERFACE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "net/aprs_interface.h"
+#include "net/internet_aprs_interface.h"
+#include "util/non_copyable.h"
+
+namespace au {
+
+// Receives from several APRS-IS servers at the same time and merges their
+// streams. Each connection is read from its own thread so that a server that
+// stalls or is reconnecting does not hold up the others. A frame is delivered
+// from whichever connection receives it first, and the copies that arrive from
+// the other connections within the duplicate window are dropped.
+class RedundantAPRSInterface : public APRSInterface,
+                               public NonCopyable {
+ public:
+  // Statistics about the frames received from all connections.
+  struct Stats {
+    // The number of frames delivered.
+    uint64_t frame_count;
+
+    // The number of frames dropped as copies of a delivered frame.
+    uint64_t duplicate_count;
+
+    // The number of frames dropped because they were not consumed in time.
+    uint64_t dropped_count;
+  };
+
+  // The default time in milliseconds to drop copies of a frame for. This
+  // matches the duplicate detection of APRS-IS servers.
+  static constexpr uint32_t kDefaultDuplicateWindowMs = 30000;
+
+  // The maximum number of received frames to hold before dropping the oldest.
+  static constexpr size_t kMaxQueuedFrames = 256;
+
+  // The time in milliseconds that each connection waits for a frame before
+  // checking whether it should stop.
+  static constexpr uint32_t kReceiveTimeoutMs = 500;
+
+  // Setup the interface to receive from the supplied connections.
+  RedundantAPRSInterface(const APRSInterface::Config& config,
+      std::vector<std::unique_ptr<InternetAPRSInterface>> interfaces,
+      uint32_t duplicate_window_ms = kDefaultDuplicateWindowMs);
+
+  // Stops receiving and closes the connections.
+  ~RedundantAPRSInterface() override;
+
+  // Returns statistics about the frames received.
+  Stats GetStats() const;
+
+  // Returns the number of frames that each connection received first, in the
+  // order that the connections were supplied.
+  std::vector<uint64_t> GetFirstArrivalCounts() const;
+
+ protected:
+  // APRSInterface implementation.
+  bool Send(const std::string& payload,
+      const CallsignConfig& source, const CallsignConfig& destination,
+      const std::vector<CallsignConfig>& digipeaters) final;
+  bool Receive(CallsignConfig* source, CallsignConfig* destination,
+      std::vector<CallsignConfig>* digipeaters, std::string* payload,
+      uint32_t timeout_ms) final;
+  int GetFileDescriptor() const final;
+  bool ReceiveAvailable(const FrameCallback& callback) final;
+
+ private:
+  // A frame received from one of the connections.
+  struct Frame {
+    CallsignConfig source;
+    CallsignConfig destination;
+    std::vector<CallsignConfig> digipeaters;
+    std::string payload;
+  };
+
+  // A connection to one server.
+  struct Connection {
+    // The interface used to receive from the server.
+    std::unique_ptr<InternetAPRSInterface> aprs_interface;
+
+    // The number of frames that this connection received first.
+    uint64_t first_arrival_count;
+
+    // Reads frames from the server.
+    std::thread reader_thread;
+  };
+
+  // The time in milliseconds to drop copies of a frame for.
+  const uint32_t duplicate_window_ms_;
+
+  // The connections to receive from.
+  std::vector<Connection> connections_;
+
+  // Guards all members below.
+  mutable std::mutex mutex_;
+
+  // Signalled when a frame has been queued.
+  std::condition_variable frame_queued_cv_;
+
+  // The frames that have been received and not yet consumed.
+  std::deque<Frame> frames_;
+
+  // The frames delivered within the duplicate window, mapped to the time they
+  // were received in microseconds.
+  std::unordered_map<std::string, uint64_t> recent_frames_;
+
+  // The keys of recent_frames_ in the order they were received, to expire
+  // them.
+  std::deque<std::pair<uint64_t, std::string>> recent_frame_order_;
+
+  // The statistics of the frames received.
+  Stats stats_;
+
+  // An eventfd that is readable while frames are queued.
+  int event_fd_;
+
+  // Set to false to stop the reader threads.
+  std::atomic<bool> running_;
+
+  // Reads frames from the supplied connection until stopped.
+  void ReadFrames(Connection* connection);
+
+  // Queues a frame received from the supplied connection unless it is a copy
+  // of a frame delivered within the duplicate window.
+  void QueueFrame(Connection* connection, Frame* frame);
+
+  // Removes the oldest queued frame into the supplied frame. The mutex must be
+  // held and the queue must not be empty.
+  void PopFrame(Frame* frame);
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_REDUNDANT_APRS_INTERFACE_H_
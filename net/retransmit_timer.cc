@@ -0,0 +1,56 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/retransmit_timer.h"
+
+#include <algorithm>
+
+namespace au {
+
+RetransmitTimer::RetransmitTimer(uint64_t initial_timeout_us,
+    uint64_t min_timeout_us, uint64_t max_timeout_us)
+    : min_timeout_us_(min_timeout_us),
+      max_timeout_us_(std::max(max_timeout_us, min_timeout_us)),
+      has_sample_(false),
+      srtt_us_(0),
+      rttvar_us_(0),
+      estimate_us_(std::clamp(initial_timeout_us, min_timeout_us_,
+          max_timeout_us_)),
+      timeout_us_(estimate_us_) {}
+
+void RetransmitTimer::AddSample(uint64_t rtt_us) {
+  if (!has_sample_) {
+    has_sample_ = true;
+    srtt_us_ = rtt_us;
+    rttvar_us_ = rtt_us / 2;
+  } else {
+    // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R.
+    uint64_t error_us = srtt_us_ > rtt_us
+        ? srtt_us_ - rtt_us : rtt_us - srtt_us_;
+    rttvar_us_ = (3 * rttvar_us_ + error_us) / 4;
+    srtt_us_ = (7 * srtt_us_ + rtt_us) / 8;
+  }
+
+  estimate_us_ = std::clamp(srtt_us_ + 4 * rttvar_us_, min_timeout_us_,
+      max_timeout_us_);
+  timeout_us_ = estimate_us_;
+}
+
+void RetransmitTimer::OnTimeout() {
+  timeout_us_ = std::min(timeout_us_ * 2, max_timeout_us_);
+}
+
+}  // namespace au
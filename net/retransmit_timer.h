@@ -0,0 +1,90 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_RETRANSMIT_TIMER_H_
+#define APRS_UTILS_NET_RETRANSMIT_TIMER_H_
+
+#include <cstdint>
+
+#include "util/non_copyable.h"
+
+namespace au {
+
+// Estimates the round trip time of a directed link from acknowledgements and
+// derives the time to wait for an acknowledgement before retransmitting. This
+// follows RFC 6298: the timeout is the smoothed round trip time plus four
+// times its variation, and it doubles after each timeout until an
+// acknowledgement is received.
+class RetransmitTimer : public NonCopyable {
+ public:
+  // The default timeout before any round trip time has been measured.
+  static constexpr uint64_t kDefaultInitialTimeoutUs = 30000000;
+
+  // The default lower bound on the timeout.
+  static constexpr uint64_t kDefaultMinTimeoutUs = 5000000;
+
+  // The default upper bound on the timeout.
+  static constexpr uint64_t kDefaultMaxTimeoutUs = 120000000;
+
+  // Setup the timer with no round trip time measured.
+  RetransmitTimer(uint64_t initial_timeout_us = kDefaultInitialTimeoutUs,
+      uint64_t min_timeout_us = kDefaultMinTimeoutUs,
+      uint64_t max_timeout_us = kDefaultMaxTimeoutUs);
+
+  // Adds a round trip time measurement. Only frames that were sent once may be
+  // measured, as the acknowledgement of a retransmitted frame is ambiguous.
+  // This clears any backoff.
+  void AddSample(uint64_t rtt_us);
+
+  // Doubles the timeout after waiting for an acknowledgement timed out.
+  void OnTimeout();
+
+  // Restores the timeout to the estimate once an acknowledgement has been
+  // received, even if it could not be measured.
+  void ClearBackoff() { timeout_us_ = estimate_us_; }
+
+  // Returns the time to wait for an acknowledgement.
+  uint64_t GetTimeoutUs() const { return timeout_us_; }
+
+  // Returns the smoothed round trip time, or zero if it has not been measured.
+  uint64_t GetSmoothedRttUs() const { return srtt_us_; }
+
+ private:
+  // The lower bound on the timeout.
+  const uint64_t min_timeout_us_;
+
+  // The upper bound on the timeout.
+  const uint64_t max_timeout_us_;
+
+  // Set to true once a round trip time has been measured.
+  bool has_sample_;
+
+  // The smoothed round trip time.
+  uint64_t srtt_us_;
+
+  // The smoothed variation of the round trip time.
+  uint64_t rttvar_us_;
+
+  // The timeout derived from the round trip time, without any backoff.
+  uint64_t estimate_us_;
+
+  // The current timeout, including any backoff.
+  uint64_t timeout_us_;
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_RETRANSMIT_TIMER_H_
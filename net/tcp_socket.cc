@@ -0,0 +1,305 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/tcp_socket.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <climits>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "util/log.h"
+
+#define LOG_TAG "TCPSocket"
+
+namespace au {
+
+TCPSocket::TCPSocket() : fd_(-1) {}
+
+TCPSocket::~TCPSocket() {
+  Close();
+}
+
+std::string TCPSocket::Address::ToString() const {
+  char host[NI_MAXHOST];
+  char service[NI_MAXSERV];
+  int result = getnameinfo(reinterpret_cast<const struct sockaddr*>(&storage),
+      size, host, sizeof(host), service, sizeof(service),
+      NI_NUMERICHOST | NI_NUMERICSERV);
+  if (result != 0) {
+    return "unknown";
+  } else if (storage.ss_family == AF_INET6) {
+    return std::string("[") + host + "]:" + service;
+  }
+
+  return std::string(host) + ":" + service;
+}
+
+bool TCPSocket::Resolve(const std::string& hostname, uint16_t port,
+    std::vector<Address>* addresses) {
+  struct addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  std::string service = std::to_string(port);
+  struct addrinfo* results;
+  int result = getaddrinfo(hostname.c_str(), service.c_str(),
+      &hints, &results);
+  if (result != 0) {
+    LOGE("failed to resolve %s: %s", hostname.c_str(), gai_strerror(result));
+    return false;
+  }
+
+  // Split the addresses by whether they share the family of the first one,
+  // preserving the order of the resolver within each family.
+  std::vector<Address> preferred;
+  std::vector<Address> others;
+  for (auto* info = results; info != nullptr; info = info->ai_next) {
+    if (info->ai_addrlen > sizeof(Address::storage)) {
+      continue;
+    }
+
+    Address address = {};
+    memcpy(&address.storage, info->ai_addr, info->ai_addrlen);
+    address.size = info->ai_addrlen;
+    if (preferred.empty()
+        || preferred.front().storage.ss_family == info->ai_family) {
+      preferred.push_back(address);
+    } else {
+      others.push_back(address);
+    }
+  }
+
+  freeaddrinfo(results);
+  addresses->clear();
+  for (size_t i = 0; i < std::max(preferred.size(), others.size()); i++) {
+    if (i < preferred.size()) {
+      addresses->push_back(preferred[i]);
+    }
+
+    if (i < others.size()) {
+      addresses->push_back(others[i]);
+    }
+  }
+
+  if (addresses->empty()) {
+    LOGE("no addresses found for %s", hostname.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool TCPSocket::Connect(const std::string& hostname, uint16_t port) {
+  Close();
+
+  std::vector<Address> addresses;
+  if (!Resolve(hostname, port, &addresses)) {
+    return false;
+  }
+
+  for (const auto& address : addresses) {
+    int fd = socket(address.storage.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+      continue;
+    }
+
+    if (connect(fd, reinterpret_cast<const struct sockaddr*>(
+            &address.storage), address.size) == 0) {
+      fd_ = fd;
+      break;
+    }
+
+    close(fd);
+  }
+
+  if (fd_ < 0) {
+    LOGE("failed to connect to %s:%" PRIu16 ": %s (%d)", hostname.c_str(),
+        port, strerror(errno), errno);
+    return false;
+  }
+
+  int flags = fcntl(fd_, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd_, F_SETFL, flags | O_NONBLOCK) < 0) {
+    LOGE("failed to make socket non-blocking: %s (%d)",
+        strerror(errno), errno);
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+bool TCPSocket::StartConnect(const Address& address) {
+  Close();
+
+  fd_ = socket(address.storage.ss_family,
+      SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd_ < 0) {
+    LOGE("failed to create socket: %s (%d)", strerror(errno), errno);
+    return false;
+  }
+
+  if (connect(fd_, reinterpret_cast<const struct sockaddr*>(&address.storage),
+        address.size) < 0 && errno != EINPROGRESS) {
+    LOGE("failed to connect to %s: %s (%d)", address.ToString().c_str(),
+        strerror(errno), errno);
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+bool TCPSocket::FinishConnect() {
+  int error = 0;
+  socklen_t error_size = sizeof(error);
+  if (getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &error_size) < 0) {
+    error = errno;
+  }
+
+  if (error != 0) {
+    LOGE("failed to connect: %s (%d)", strerror(error), error);
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void TCPSocket::Swap(TCPSocket* other) {
+  std::swap(fd_, other->fd_);
+}
+
+void TCPSocket::Close() {
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void TCPSocket::Shutdown() {
+  if (fd_ >= 0) {
+    shutdown(fd_, SHUT_RDWR);
+  }
+}
+
+int TCPSocket::WaitReadable(int timeout_ms) {
+  struct pollfd poll_fd = {};
+  poll_fd.fd = fd_;
+  poll_fd.events = POLLIN;
+  int result = poll(&poll_fd, 1, timeout_ms);
+  if (result < 0) {
+    if (errno == EINTR) {
+      return 0;
+    }
+
+    LOGE("failed to poll socket: %s (%d)", strerror(errno), errno);
+    return -1;
+  }
+
+  // Errors and hangups are reported as readable so that the subsequent read
+  // returns the failure.
+  return result > 0 ? 1 : 0;
+}
+
+ssize_t TCPSocket::Read(void* buffer, size_t size) {
+  ssize_t result = recv(fd_, buffer, size, 0);
+  if (result > 0) {
+    return result;
+  } else if (result == 0) {
+    LOGE("connection closed by peer");
+    return -1;
+  } else if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+    return 0;
+  }
+
+  LOGE("failed to read from socket: %s (%d)", strerror(errno), errno);
+  return -1;
+}
+
+bool TCPSocket::WriteVector(struct iovec* iov, int count) {
+  while (count > 0) {
+    // This is writev, but with MSG_NOSIGNAL to report a closed connection as
+    // an error rather than a signal.
+    struct msghdr message = {};
+    message.msg_iov = iov;
+    message.msg_iovlen = std::min(count, IOV_MAX);
+    ssize_t result = sendmsg(fd_, &message, MSG_NOSIGNAL);
+    if (result >= 0) {
+      // Skip the buffers that have been written completely and advance into
+      // the buffer that was written partially.
+      size_t bytes_written = result;
+      while (count > 0 && bytes_written >= iov->iov_len) {
+        bytes_written -= iov->iov_len;
+        iov++;
+        count--;
+      }
+
+      if (count > 0) {
+        iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + bytes_written;
+        iov->iov_len -= bytes_written;
+      }
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      struct pollfd poll_fd = {};
+      poll_fd.fd = fd_;
+      poll_fd.events = POLLOUT;
+      if (poll(&poll_fd, 1, -1) < 0 && errno != EINTR) {
+        LOGE("failed to poll socket: %s (%d)", strerror(errno), errno);
+        return false;
+      }
+    } else if (errno != EINTR) {
+      LOGE("failed to write to socket: %s (%d)", strerror(errno), errno);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool TCPSocket::Write(const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  size_t total_bytes_written = 0;
+  while (total_bytes_written < size) {
+    ssize_t result = send(fd_, &bytes[total_bytes_written],
+        size - total_bytes_written, MSG_NOSIGNAL);
+    if (result >= 0) {
+      total_bytes_written += result;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      struct pollfd poll_fd = {};
+      poll_fd.fd = fd_;
+      poll_fd.events = POLLOUT;
+      if (poll(&poll_fd, 1, -1) < 0 && errno != EINTR) {
+        LOGE("failed to poll socket: %s (%d)", strerror(errno), errno);
+        return false;
+      }
+    } else if (errno != EINTR) {
+      LOGE("failed to write to socket: %s (%d)", strerror(errno), errno);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace au
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_TCP_SOCKET_H_
+#define APRS_UTILS_NET_TCP_SOCKET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "util/non_copyable.h"
+
+namespace au {
+
+// A TCP connection over a native non-blocking socket.
+class TCPSocket : public NonCopyable {
+ public:
+  // Setup the socket in the closed state.
+  TCPSocket();
+
+  // Closes the socket if open.
+  ~TCPSocket();
+
+  // A resolved address of a host.
+  struct Address {
+    // The native address.
+    struct sockaddr_storage storage;
+
+    // The size of the native address.
+    socklen_t size;
+
+    // Formats the numeric host and port of this address into a string.
+    std::string ToString() const;
+  };
+
+  // Resolves all of the addresses of the supplied host and port. The address
+  // families are interleaved, starting with the first family returned by the
+  // resolver, so that connecting in order alternates between them. Returns
+  // true if at least one address was found.
+  static bool Resolve(const std::string& hostname, uint16_t port,
+      std::vector<Address>* addresses);
+
+  // Connects to the supplied host and port. Returns true if successful.
+  bool Connect(const std::string& hostname, uint16_t port);
+
+  // Starts connecting to the supplied address without blocking. The socket
+  // becomes writable once the attempt completes, after which FinishConnect
+  // must be called. Returns true if the attempt was started.
+  bool StartConnect(const Address& address);
+
+  // Completes an attempt started with StartConnect. Returns true if the
+  // connection was established, otherwise the socket is closed.
+  bool FinishConnect();
+
+  // Exchanges the connections of this socket and the supplied socket.
+  void Swap(TCPSocket* other);
+
+  // Closes the socket.
+  void Close();
+
+  // Shuts down the connection without closing the socket. Threads that are
+  // blocked reading or writing the socket return with an error.
+  void Shutdown();
+
+  // Returns true if the socket is open.
+  bool IsOpen() const { return fd_ >= 0; }
+
+  // Returns the file descriptor of the socket, or -1 if it is closed.
+  int GetFileDescriptor() const { return fd_; }
+
+  // Waits for the socket to become readable. A negative timeout waits
+  // indefinitely. Returns 1 if readable, 0 on timeout and -1 on error.
+  int WaitReadable(int timeout_ms);
+
+  // Reads up to size bytes that are available from the socket without
+  // blocking. Returns the number of bytes read, 0 if no bytes are available
+  // and -1 if there is an error or the connection has been closed.
+  ssize_t Read(void* buffer, size_t size);
+
+  // Writes all of the supplied bytes to the socket, waiting for the socket to
+  // become writable as needed. Returns true if successful.
+  bool Write(const void* data, size_t size);
+
+  // Writes all of the supplied buffers to the socket with gathered writes,
+  // waiting for the socket to become writable as needed. The iovec entries are
+  // modified to track partial writes. Returns true if successful.
+  bool WriteVector(struct iovec* iov, int count);
+
+ private:
+  // The native socket, or -1 if closed.
+  int fd_;
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_TCP_SOCKET_H_
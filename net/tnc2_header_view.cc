@@ -0,0 +1,143 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/tnc2_header_view.h"
+
+#include "net/aprs_is_line_filter.h"
+#include "util/log.h"
+
+#define LOG_TAG "TNC2HeaderView"
+
+namespace au {
+
+void TNC2AddressView::Init(std::string_view address) {
+  repeated_ = !address.empty() && address.back() == '*';
+  address_ = repeated_ ? address.substr(0, address.size() - 1) : address;
+}
+
+bool TNC2AddressView::Matches(const CallsignConfig& config) const {
+  auto callsign = GetCallsign();
+  if (callsign != config.callsign) {
+    return false;
+  }
+
+  // Compare the SSID as digits to avoid formatting the config.
+  auto ssid = address_.substr(callsign.size());
+  if (config.ssid == 0) {
+    return ssid.empty();
+  } else if (config.ssid < 10) {
+    return ssid.size() == 2 && ssid[1] == '0' + config.ssid;
+  }
+
+  return ssid.size() == 3 && ssid[1] == '0' + config.ssid / 10
+      && ssid[2] == '0' + config.ssid % 10;
+}
+
+bool TNC2HeaderView::Parse(std::string_view line) {
+  size_t source_end;
+  size_t header_end;
+  APRSISLineFilter::FindHeaderDelimiters(line.data(), line.size(),
+      &source_end, &header_end);
+  if (header_end == line.size()) {
+    LOGV("header missing payload separator");
+    return false;
+  } else if (source_end > header_end) {
+    LOGV("header missing source/destination separator");
+    return false;
+  } else if (source_end == 0 || line.substr(0, source_end) == "*") {
+    LOGV("header missing source");
+    return false;
+  }
+
+  source_.Init(line.substr(0, source_end));
+  payload_ = line.substr(header_end + 1);
+
+  // Split the destination and path on commas.
+  auto addresses = line.substr(source_end + 1, header_end - source_end - 1);
+  path_size_ = 0;
+  digipeater_count_ = kMaxPathSize;
+  bool first = true;
+  while (true) {
+    auto comma_pos = addresses.find(',');
+    auto address = addresses.substr(0, comma_pos);
+    if (address.empty() || address == "*") {
+      LOGV("header has empty address");
+      return false;
+    }
+
+    if (first) {
+      destination_.Init(address);
+      first = false;
+    } else if (path_size_ == kMaxPathSize) {
+      LOGV("header path too long");
+      return false;
+    } else {
+      auto& entry = path_[path_size_];
+      entry.Init(address);
+      if (entry.IsQConstruct() && digipeater_count_ == kMaxPathSize) {
+        digipeater_count_ = path_size_;
+      }
+
+      path_size_++;
+    }
+
+    if (comma_pos == std::string_view::npos) {
+      break;
+    }
+
+    addresses.remove_prefix(comma_pos + 1);
+  }
+
+  if (digipeater_count_ == kMaxPathSize) {
+    digipeater_count_ = path_size_;
+  }
+
+  return true;
+}
+
+bool TNC2HeaderView::ToAPRSFrame(CallsignConfig* source,
+    CallsignConfig* destination, std::vector<CallsignConfig>* digipeaters,
+    std::string* payload) const {
+  if (!source_.ToCallsignConfig(source)) {
+    LOGV("unsupported source callsign");
+    return false;
+  } else if (!destination_.ToCallsignConfig(destination)) {
+    LOGV("unsupported destination callsign");
+    return false;
+  }
+
+  // Digipeaters such as D-STAR gateways with alphabetic SSIDs do not affect
+  // the handling of the frame, so they are skipped rather than dropping it.
+  digipeaters->resize(digipeater_count_);
+  size_t digipeater_count = 0;
+  for (size_t i = 0; i < digipeater_count_; i++) {
+    auto& digipeater = (*digipeaters)[digipeater_count];
+    if (!path_[i].ToCallsignConfig(&digipeater)) {
+      LOGV("skipping unsupported digipeater callsign");
+      continue;
+    }
+
+    digipeater.repeated = path_[i].HasBeenRepeated();
+    digipeater_count++;
+  }
+
+  digipeaters->resize(digipeater_count);
+
+  payload->assign(payload_);
+  return true;
+}
+
+}  // namespace au
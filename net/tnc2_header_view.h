@@ -0,0 +1,146 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_TNC2_HEADER_VIEW_H_
+#define APRS_UTILS_NET_TNC2_HEADER_VIEW_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "net/ax25_frame_view.h"
+#include "util/callsign.h"
+
+namespace au {
+
+// A non-owning view of an address within a TNC2 header, such as N0CALL-9 or
+// WIDE1-1*.
+class TNC2AddressView {
+ public:
+  // Setup the view over an address, including any SSID and used flag.
+  void Init(std::string_view address);
+
+  // Returns the address, including the SSID but excluding the used flag.
+  std::string_view GetAddress() const { return address_; }
+
+  // Returns the callsign, excluding the SSID.
+  std::string_view GetCallsign() const {
+    return address_.substr(0, address_.find('-'));
+  }
+
+  // Returns true if the address is followed by the used flag ('*'). This is
+  // only meaningful for digipeater addresses.
+  bool HasBeenRepeated() const { return repeated_; }
+
+  // Returns true if this is an APRS-IS q-construct such as qAR.
+  bool IsQConstruct() const {
+    return address_.size() == 3 && address_[0] == 'q' && address_[1] == 'A';
+  }
+
+  // Returns true if this address matches the supplied callsign and SSID.
+  bool Matches(const CallsignConfig& config) const;
+
+  // Populates the supplied config with this address. Returns false if the
+  // address can not be represented, such as with an alphanumeric SSID.
+  bool ToCallsignConfig(CallsignConfig* config) const {
+    return config->FromString(address_);
+  }
+
+ private:
+  // The address, excluding the used flag.
+  std::string_view address_;
+
+  // Whether the address was followed by the used flag.
+  bool repeated_;
+};
+
+// A non-owning view of the header of a packet in the TNC2 monitor format used
+// by APRS-IS, formatted as SOURCE>DESTINATION,PATH:PAYLOAD. The path holds
+// digipeaters, optionally followed by a q-construct and the callsign of the
+// igate that the packet entered APRS-IS through. The line is parsed in place
+// and no memory is allocated, so the view is only valid for as long as the
+// line that it was parsed from.
+class TNC2HeaderView {
+ public:
+  // The maximum number of addresses in the path. This allows for a full set of
+  // AX.25 digipeaters followed by a q-construct and igate.
+  static constexpr size_t kMaxPathSize =
+      AX25FrameView::kMaxDigipeaterCount + 2;
+
+  // Parses the supplied line. Returns true if the header is well formed.
+  bool Parse(std::string_view line);
+
+  // Returns the source address.
+  const TNC2AddressView& GetSource() const { return source_; }
+
+  // Returns the destination address.
+  const TNC2AddressView& GetDestination() const { return destination_; }
+
+  // Returns the number of digipeater addresses, which precede any
+  // q-construct.
+  size_t GetDigipeaterCount() const { return digipeater_count_; }
+
+  // Returns a digipeater address.
+  const TNC2AddressView& GetDigipeater(size_t index) const {
+    return path_[index];
+  }
+
+  // Returns the q-construct, or an empty view if the path does not have one.
+  std::string_view GetQConstruct() const {
+    return digipeater_count_ < path_size_
+        ? path_[digipeater_count_].GetAddress() : std::string_view();
+  }
+
+  // Returns the igate that follows the q-construct, or an empty view if the
+  // path does not have one.
+  std::string_view GetIGate() const {
+    return digipeater_count_ + 1 < path_size_
+        ? path_[digipeater_count_ + 1].GetAddress() : std::string_view();
+  }
+
+  // Returns the payload.
+  std::string_view GetPayload() const { return payload_; }
+
+  // Populates the addresses and payload of an APRS frame. Returns false if the
+  // source or destination can not be represented by a CallsignConfig.
+  // Digipeaters that can not be represented are left out of the frame.
+  bool ToAPRSFrame(CallsignConfig* source, CallsignConfig* destination,
+      std::vector<CallsignConfig>* digipeaters, std::string* payload) const;
+
+ private:
+  // The source address.
+  TNC2AddressView source_;
+
+  // The destination address.
+  TNC2AddressView destination_;
+
+  // The addresses of the path.
+  TNC2AddressView path_[kMaxPathSize];
+
+  // The number of valid entries in path_.
+  size_t path_size_;
+
+  // The number of entries in path_ that precede the q-construct.
+  size_t digipeater_count_;
+
+  // The payload.
+  std::string_view payload_;
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_TNC2_HEADER_VIEW_H_
@@ -16,6 +16,8 @@
 
 #include "net/tnc_aprs_interface.h"
 
+#include <cinttypes>
+
 #include "util/log.h"
 #include "util/time.h"
 
@@ -25,255 +27,222 @@ namespace au {
 
 TNCAPRSInterface::TNCAPRSInterface(const APRSInterface::Config& config,
     const std::string& hostname, uint16_t port)
-  : APRSInterface(config) {
-  IPaddress ip;
-  if (SDLNet_ResolveHost(&ip, hostname.c_str(), port) < 0) {
-    LOGFATAL("failed to resolve TNC host: %s",
-        SDLNet_GetError());
-  }
-
-  tnc_socket_ = SDLNet_TCP_Open(&ip);
-  if (!tnc_socket_) {
-    LOGFATAL("failed to open TNC socket: %s",
-        SDLNet_GetError());
-  }
+    : TNCAPRSInterface(config,
+        std::make_shared<KISSConnection>(KISSConnection::Config({
+            KISSConnection::kDefaultMaxQueuedTxFrames,
+            KISSConnection::OverflowPolicy::kBlock}), hostname, port),
+        /*kiss_port=*/0) {}
 
-  // Setup the SocketSet.
-  socket_set_ = SDLNet_AllocSocketSet(1);
-  if (socket_set_ == nullptr) {
-    LOGFATAL("failed to init SocketSet: %s",
-        SDLNet_GetError());
-  }
-
-  if (SDLNet_TCP_AddSocket(socket_set_, tnc_socket_) < 0) {
-    LOGFATAL("failed to add socket: %s",
-        SDLNet_GetError());
-  }
+TNCAPRSInterface::TNCAPRSInterface(const APRSInterface::Config& config,
+    std::shared_ptr<KISSConnection> connection, uint8_t kiss_port)
+    : APRSInterface(config),
+      connection_(connection),
+      kiss_port_(kiss_port),
+      ack_mode_(false),
+      next_ack_sequence_(0),
+      ack_pending_(false),
+      pending_ack_sequence_(0) {
+  connection_->OpenPort(kiss_port_);
 }
 
 TNCAPRSInterface::~TNCAPRSInterface() {
-  SDLNet_FreeSocketSet(socket_set_);
-  SDLNet_TCP_Close(tnc_socket_);
+  connection_->ClosePort(kiss_port_);
 }
 
 bool TNCAPRSInterface::Send(const std::string& payload,
     const CallsignConfig& source,
     const CallsignConfig& destination,
     const std::vector<CallsignConfig>& digipeaters) {
-  if (digipeaters.size() > 8) {
-    LOGFATAL("too many digipeaters specified");
-  }
-
-  // Encode addresses.
-  std::string ax25_addresses;
-  ax25_addresses += EncodeAX25Callsign(destination);
-  ax25_addresses += EncodeAX25Callsign(source, /*last=*/digipeaters.empty());
-  for (size_t i = 0; i < digipeaters.size(); i++) {
-    ax25_addresses += EncodeAX25Callsign(digipeaters[i],
-        /*last=*/(i == (digipeaters.size() - 1)));
-  }
+  BeginFrame(source, destination, digipeaters);
+  frame_builder_.Append(payload);
+  return SendBuiltFrame();
+}
 
-  // Build frame body.
-  std::string ax25_frame;
-  ax25_frame += ax25_addresses;
-  ax25_frame += "\x03"; // UI-Frame.
-  ax25_frame += "\xf0"; // No layer 3 protocol.
-  ax25_frame += payload;
-
-  // Format HDLC and then encapsulate in a KISS frame.
-  std::string kiss_frame = EncodeKISSFrame(ax25_frame);
-  if (SDLNet_TCP_Send(tnc_socket_,
-        kiss_frame.data(), kiss_frame.size()) < 0) {
-    LOGE("failed to send frame: %s", SDLNet_GetError());
-    return false;
+bool TNCAPRSInterface::SendBinaryPayload(const uint8_t* data, size_t size,
+    PayloadEncoding encoding, const CallsignConfig& source,
+    const CallsignConfig& destination,
+    const std::vector<CallsignConfig>& digipeaters) {
+  const uint8_t prefix[] = {kBinaryPayloadPrefix, kBase91PayloadMarker};
+  BeginFrame(source, destination, digipeaters);
+  if (encoding == PayloadEncoding::kBase91) {
+    frame_builder_.Append(prefix, 2);
+    frame_builder_.AppendBase91(data, size);
+  } else {
+    frame_builder_.Append(prefix, 1);
+    frame_builder_.AppendBase64(data, size);
   }
 
-  return true;
+  return SendBuiltFrame();
 }
 
 bool TNCAPRSInterface::Receive(CallsignConfig* source,
     CallsignConfig* destination, std::vector<CallsignConfig>* digipeaters,
     std::string* payload, uint32_t timeout_ms) {
-  std::string frame = DecodeKISSFrame(timeout_ms);
-  if (frame.empty()) {
+  if (!connection_->ReceiveFrame(kiss_port_, &rx_frame_, timeout_ms)) {
     return false;
   }
 
-  size_t offset = 0;
-  bool last = false;
-  offset = DecodeAX25Callsign(frame, offset, destination, &last);
-  if (offset == 0) {
+  AX25FrameView frame;
+  if (!frame.Parse(rx_frame_.data.data(), rx_frame_.data.size())) {
     return false;
   }
 
-  offset = DecodeAX25Callsign(frame, offset, source, &last);
-  if (offset == 0) {
+  return frame.ToAPRSFrame(source, destination, digipeaters, payload);
+}
+
+bool TNCAPRSInterface::ReceiveFrame(AX25FrameView* frame,
+    uint32_t timeout_ms) {
+  if (!connection_->ReceiveFrame(kiss_port_, &rx_frame_, timeout_ms)) {
     return false;
   }
 
-  for (size_t i = 0; i < 8 && !last; i++) {
-    CallsignConfig digipeater;
-    offset = DecodeAX25Callsign(frame, offset, &digipeater, &last);
-    if (offset == 0) {
-      return false;
-    }
-
-    digipeaters->push_back(digipeater);
-    if (i == 7 && last) {
-      LOGE("too many digipeaters");
-      return false;
-    }
-  }
+  return frame->Parse(rx_frame_.data.data(), rx_frame_.data.size());
+}
 
-  if (static_cast<uint8_t>(frame[offset]) != 0x03) {
-    LOGE("invalid frame type: 0x%02x",
-        static_cast<uint8_t>(frame[offset]));
+bool TNCAPRSInterface::SetTxDelay(uint32_t tx_delay_ms) {
+  return SendTimeCommand(KISSConnection::kCommandTxDelay, tx_delay_ms);
+}
+
+bool TNCAPRSInterface::SetPersistence(uint8_t persistence) {
+  return SendCommand(KISSConnection::kCommandPersistence, persistence);
+}
+
+bool TNCAPRSInterface::SetSlotTime(uint32_t slot_time_ms) {
+  return SendTimeCommand(KISSConnection::kCommandSlotTime, slot_time_ms);
+}
+
+bool TNCAPRSInterface::SetTxTail(uint32_t tx_tail_ms) {
+  return SendTimeCommand(KISSConnection::kCommandTxTail, tx_tail_ms);
+}
+
+bool TNCAPRSInterface::SetFullDuplex(bool full_duplex) {
+  return SendCommand(KISSConnection::kCommandFullDuplex, full_duplex ? 1 : 0);
+}
+
+bool TNCAPRSInterface::SetKISSParameters(const KISSParameters& parameters) {
+  return SetTxDelay(parameters.tx_delay_ms)
+      && SetPersistence(parameters.persistence)
+      && SetSlotTime(parameters.slot_time_ms)
+      && SetTxTail(parameters.tx_tail_ms)
+      && SetFullDuplex(parameters.full_duplex);
+}
+
+void TNCAPRSInterface::SetAckMode(bool ack_mode) {
+  ack_mode_ = ack_mode;
+}
+
+bool TNCAPRSInterface::WaitForTransmitComplete() {
+  if (!ack_pending_.exchange(false)) {
     return false;
   }
 
-  offset++;
-  if (static_cast<uint8_t>(frame[offset]) != 0xf0) {
-    LOGE("invalid layer 3 protocol: 0x%02x",
-        static_cast<uint8_t>(frame[offset]));
+  uint16_t sequence = pending_ack_sequence_;
+  if (!connection_->WaitForAck(kiss_port_, sequence, kAckTimeoutMs)) {
+    LOGE("timeout waiting for TNC to transmit frame %" PRIu16, sequence);
     return false;
   }
 
-  offset++;
-  *payload = frame.substr(offset);
   return true;
 }
 
-std::string TNCAPRSInterface::EncodeAX25Callsign(
-    const CallsignConfig& config, bool last) {
-  if (config.ssid < 0 || config.ssid > 15) {
-    LOGFATAL("invalid SSID: %d", config.ssid);
+int TNCAPRSInterface::GetFileDescriptor() const {
+  return connection_->GetFileDescriptor();
+}
+
+bool TNCAPRSInterface::ReceiveAvailable(const FrameCallback& callback) {
+  // Frames for this port may have been read by another port of the TNC.
+  while (connection_->PopFrame(kiss_port_, &rx_frame_)) {
+    DispatchFrame(callback);
+  }
+
+  if (!connection_->ReadAvailable()) {
+    LOGE("failed to read from TNC socket");
+    return false;
   }
 
-  if (config.callsign.length() > 6) {
-    LOGFATAL("invalid callsign '%s'", config.callsign);
+  while (connection_->PopFrame(kiss_port_, &rx_frame_)) {
+    DispatchFrame(callback);
   }
 
-  std::string padded_callsign = config.callsign;
-  padded_callsign.resize(6, ' ');
+  return true;
+}
+
+int TNCAPRSInterface::GetServiceTimeoutMs() const {
+  // Frames that were read while waiting for an acknowledgement or by another
+  // port do not make the socket readable. A lost connection is restored by
+  // ReceiveAvailable once the connection needs to be serviced.
+  return connection_->HasFrame(kiss_port_)
+      ? 0 : connection_->GetServiceTimeoutMs();
+}
 
-  std::string formatted_callsign;
-  for (size_t i = 0; i < padded_callsign.size(); i++) {
-    formatted_callsign += (padded_callsign[i] << 1);
+void TNCAPRSInterface::DispatchFrame(const FrameCallback& callback) {
+  AX25FrameView frame;
+  if (!frame.Parse(rx_frame_.data.data(), rx_frame_.data.size())) {
+    return;
   }
 
-  return formatted_callsign + static_cast<char>(
-      0x60 | (config.ssid << 1) | (last ? 0x01 : 0x00));
+  CallsignConfig source;
+  CallsignConfig destination;
+  std::vector<CallsignConfig> digipeaters;
+  std::string payload;
+  if (frame.ToAPRSFrame(&source, &destination, &digipeaters, &payload)) {
+    callback(source, destination, digipeaters, payload);
+  }
 }
 
-size_t TNCAPRSInterface::DecodeAX25Callsign(
-    const std::string& frame, size_t offset,
-    CallsignConfig* config, bool* last) {
-  if ((offset + 7) > frame.size()) {
-    LOGE("unable to decode callsign with short frame");
-    return 0;
+void TNCAPRSInterface::BeginFrame(const CallsignConfig& source,
+    const CallsignConfig& destination,
+    const std::vector<CallsignConfig>& digipeaters) {
+  if (ack_mode_) {
+    frame_builder_.BeginAckMode(kiss_port_, next_ack_sequence_,
+        source, destination, digipeaters);
+  } else {
+    frame_builder_.Begin(kiss_port_, source, destination, digipeaters);
   }
+}
 
-  // Check that the SSID mask matches.
-  if ((frame[offset + 6] & 0x60) != 0x60) {
-    LOGE("unable to decode callsign with SSID mask");
-    return 0;
+bool TNCAPRSInterface::SendBuiltFrame() {
+  const auto& kiss_frame = frame_builder_.End();
+  auto result = connection_->SendFrame(kiss_port_,
+      kiss_frame.data(), kiss_frame.size());
+  if (result == KISSConnection::SendResult::kFailed) {
+    LOGE("failed to send frame");
+    return false;
+  } else if (result == KISSConnection::SendResult::kDropped) {
+    // The frame is lost as if on air, and there is no transmission to wait
+    // for.
+    ack_pending_ = false;
+    return true;
   }
 
-  config->callsign.clear();
-  for (size_t i = offset; i < (offset + 6); i++) {
-    char c = (static_cast<uint8_t>(frame[i]) >> 1);
-    if (c == ' ') {
-      break;
-    } else {
-      config->callsign += c;
-    }
+  if (ack_mode_) {
+    ack_pending_ = true;
+    pending_ack_sequence_ = next_ack_sequence_++;
   }
 
-  *last = (frame[offset + 6] & 0x01) > 0;
-  config->ssid = (static_cast<uint8_t>(frame[offset + 6] & 0x17) >> 1);
-  return offset + 7;
+  return true;
 }
 
-std::string TNCAPRSInterface::EncodeKISSFrame(const std::string& hdlc_frame) {
-  std::string kiss_frame = "\xc0";
-  kiss_frame += '\0';  // Channel. TODO: Make configurable.
-  for (const auto& byte : hdlc_frame) {
-    if (byte == 0xc0) {
-      kiss_frame += "\xdb\xdc";
-    } else if (byte == 0xdb) {
-      kiss_frame += "\xdb\xdd";
-    } else {
-      kiss_frame += byte;
-    }
+bool TNCAPRSInterface::SendCommand(uint8_t command, uint8_t value) {
+  const auto& kiss_frame = frame_builder_.BuildCommand(kiss_port_, command,
+      &value, 1);
+  if (connection_->SendFrame(kiss_port_, kiss_frame.data(),
+        kiss_frame.size()) != KISSConnection::SendResult::kQueued) {
+    LOGE("failed to send KISS command 0x%02x", command);
+    return false;
   }
 
-  kiss_frame += "\xc0";
-  return kiss_frame;
+  return true;
 }
 
-std::string TNCAPRSInterface::DecodeKISSFrame(uint32_t timeout_ms) {
-  std::string frame;
-  bool in_frame = false;
-  bool in_escape = false;
-  bool next_byte_is_header = false;
-  uint64_t time_start_us = GetTimeNowUs();
-  while (true) {
-    if (timeout_ms != 0 &&
-        (GetTimeNowUs() - time_start_us) > (timeout_ms * 1000)) {
-      LOGE("timeout reading packet");
-      return std::string();
-    }
-
-    int check_result = SDLNet_CheckSockets(socket_set_, /*timeout_ms=*/1);
-    if (check_result < 0) {
-      LOGFATAL("failed to check sockets: %s", SDLNet_GetError());
-    } else if (check_result >= 1) {
-      uint8_t byte;
-      int read_result = SDLNet_TCP_Recv(tnc_socket_, &byte, 1);
-      if (read_result <= 0) {
-        LOGFATAL("failed to read from TNC socket: %s", SDLNet_GetError());
-      } else if (byte == 0xc0) {
-        if (!frame.empty()) {
-          return frame;
-        }
-
-        next_byte_is_header = true;
-      } else if (next_byte_is_header) {
-        if ((byte & 0x0f) == 0) {
-          in_frame = true;
-        } else {
-          LOGE("invalid KISS command: %02x", byte);
-        }
-
-        next_byte_is_header = false;
-      } else if (in_frame) {
-        if (byte == 0xdb) {
-          if (in_escape) {
-            LOGE("invalid escape sequence");
-            in_escape = false;
-            frame.clear();
-          } else {
-            in_escape = true;
-          }
-        } else if (in_escape) {
-          in_escape = false;
-          if (byte == 0xdc) {
-            frame += "\xc0";
-          } else if (byte == 0xdd) {
-            frame += "\xdb";
-          } else {
-            LOGE("invalid escape sequence");
-            in_frame = false;
-            frame.clear();
-          }
-        } else {
-          frame += byte;
-        }
-      } else {
-        LOGE("KISS byte received out of frame");
-      }
-    }
+bool TNCAPRSInterface::SendTimeCommand(uint8_t command, uint32_t time_ms) {
+  if (time_ms > kMaxKISSTimeMs) {
+    LOGE("KISS time of %" PRIu32 "ms exceeds %" PRIu32 "ms", time_ms,
+        kMaxKISSTimeMs);
+    return false;
   }
+
+  return SendCommand(command, static_cast<uint8_t>(time_ms / 10));
 }
 
 }  // namespace au
@@ -17,24 +17,92 @@
 #ifndef APRS_UTILS_NET_TNC_APRS_INTERFACE_H_
 #define APRS_UTILS_NET_TNC_APRS_INTERFACE_H_
 
-#include <SDL_net.h>
+#include <atomic>
+#include <memory>
 
 #include "net/aprs_interface.h"
+#include "net/ax25_frame_view.h"
+#include "net/kiss_connection.h"
+#include "net/kiss_frame_builder.h"
 #include "util/non_copyable.h"
 
 namespace au {
 
-// A connection to a TNC for sending/receiving frames.
+// A port of a TNC for sending/receiving frames. Each port of a multi-port TNC
+// is exposed as its own interface that shares a KISSConnection.
 class TNCAPRSInterface : public APRSInterface,
                          public NonCopyable {
  public:
-  // Setup the connection to the TNC.
+  // The channel access parameters of a KISS port. Times are in milliseconds
+  // and are sent to the TNC in units of 10ms.
+  struct KISSParameters {
+    // The time to wait after keying the transmitter before sending data.
+    uint32_t tx_delay_ms;
+
+    // The probability of transmitting when the channel is clear, scaled to
+    // 0-255.
+    uint8_t persistence;
+
+    // The time to wait between checks of the channel.
+    uint32_t slot_time_ms;
+
+    // The time to hold the transmitter after the data has been sent.
+    uint32_t tx_tail_ms;
+
+    // Set to true to transmit without waiting for the channel to clear.
+    bool full_duplex;
+  };
+
+  // The default parameters from the KISS protocol specification.
+  static constexpr KISSParameters kDefaultKISSParameters = {
+    /*tx_delay_ms=*/500,
+    /*persistence=*/63,
+    /*slot_time_ms=*/100,
+    /*tx_tail_ms=*/0,
+    /*full_duplex=*/false,
+  };
+
+  // The longest time that can be sent in a KISS parameter.
+  static constexpr uint32_t kMaxKISSTimeMs = 2550;
+
+  // The time to wait for the TNC to acknowledge a transmission in ACKMODE.
+  static constexpr uint32_t kAckTimeoutMs = 60000;
+
+  // Setup the connection to the TNC and use the first KISS port.
   TNCAPRSInterface(const APRSInterface::Config& config,
       const std::string& hostname, uint16_t port);
 
+  // Setup the interface for a KISS port of an existing TNC connection.
+  TNCAPRSInterface(const APRSInterface::Config& config,
+      std::shared_ptr<KISSConnection> connection, uint8_t kiss_port);
+
   // Close the connection.
   ~TNCAPRSInterface();
 
+  // Receives a frame and parses it in place without copying. The view remains
+  // valid until the next frame is received by this interface. Returns false if
+  // there is a timeout or the frame is malformed.
+  bool ReceiveFrame(AX25FrameView* frame, uint32_t timeout_ms);
+
+  // Set the channel access parameters of the KISS port of this interface. These
+  // are queued behind any frames that are waiting to be sent. Returns false if
+  // the value cannot be represented or the command could not be sent.
+  bool SetTxDelay(uint32_t tx_delay_ms);
+  bool SetPersistence(uint8_t persistence);
+  bool SetSlotTime(uint32_t slot_time_ms);
+  bool SetTxTail(uint32_t tx_tail_ms);
+  bool SetFullDuplex(bool full_duplex);
+
+  // Sets all of the channel access parameters of the KISS port. The TNC does
+  // not report its parameters, so this is also used to restore the defaults
+  // after a transfer.
+  bool SetKISSParameters(const KISSParameters& parameters);
+
+  // Set to true to send frames with the KISS ACKMODE extension, so that the
+  // TNC reports when each frame has been transmitted. The TNC must support
+  // ACKMODE or frames are not transmitted at all.
+  void SetAckMode(bool ack_mode);
+
  protected:
   // APRSInterface implementation.
   bool Send(const std::string& payload,
@@ -44,30 +112,60 @@ class TNCAPRSInterface : public APRSInterface,
   bool Receive(CallsignConfig* source, CallsignConfig* destination,
       std::vector<CallsignConfig>* digipeaters, std::string* payload,
       uint32_t timeout_ms) final;
+  bool SendBinaryPayload(const uint8_t* data, size_t size,
+      PayloadEncoding encoding, const CallsignConfig& source,
+      const CallsignConfig& destination,
+      const std::vector<CallsignConfig>& digipeaters) final;
+  int GetFileDescriptor() const final;
+  bool ReceiveAvailable(const FrameCallback& callback) final;
+  int GetServiceTimeoutMs() const final;
+  bool WaitForTransmitComplete() final;
 
  private:
-  // The TCP socket used to communicate with the terminal node controller (TNC).
-  TCPsocket tnc_socket_;
+  // The connection to the terminal node controller (TNC).
+  const std::shared_ptr<KISSConnection> connection_;
+
+  // The KISS port of the TNC that this interface uses.
+  const uint8_t kiss_port_;
+
+  // Builds frames for transmission.
+  KISSFrameBuilder frame_builder_;
 
-  // The SocketSet used to implement timeouts for receive.
-  SDLNet_SocketSet socket_set_;
+  // Set to true when frames are sent with the KISS ACKMODE extension.
+  bool ack_mode_;
+
+  // The ACKMODE sequence number of the next frame to send.
+  uint16_t next_ack_sequence_;
+
+  // Set to true when a frame has been sent in ACKMODE and its acknowledgement
+  // has not been waited for. This is also read by the waiting thread without
+  // the send mutex.
+  std::atomic<bool> ack_pending_;
+
+  // The ACKMODE sequence number of the most recently sent frame. If another
+  // frame is sent before the wait begins, the wait is for the later frame.
+  std::atomic<uint16_t> pending_ack_sequence_;
+
+  // The most recently received frame. The storage is exchanged with the
+  // connection rather than copied.
+  KISSFrame rx_frame_;
+
+  // Starts building a frame, using ACKMODE if it is enabled.
+  void BeginFrame(const CallsignConfig& source,
+      const CallsignConfig& destination,
+      const std::vector<CallsignConfig>& digipeaters);
 
-  // Encodes an AX.25 formatted callsign.
-  std::string EncodeAX25Callsign(const CallsignConfig& config,
-      bool last = false);
+  // Sends the frame that has been built by frame_builder_.
+  bool SendBuiltFrame();
 
-  // Decodes an AX25 callsign from the supplied string at the supplied offset.
-  // Returns the location of the next callsign if one is found. If this returns
-  // 0, then there was a failure to decode and the frame may be invalid.
-  size_t DecodeAX25Callsign(const std::string& frame, size_t offset,
-      CallsignConfig* config, bool* last);
+  // Sends a KISS command with a one byte parameter to the port.
+  bool SendCommand(uint8_t command, uint8_t value);
 
-  // Encodes a KISS TNC frame.
-  std::string EncodeKISSFrame(const std::string& hdlc_frame);
+  // Sends a KISS command with a time parameter to the port.
+  bool SendTimeCommand(uint8_t command, uint32_t time_ms);
 
-  // Decodes a KISS TNC frame, or returns an empty string if there is a
-  // timeout.
-  std::string DecodeKISSFrame(uint32_t timeout_ms);
+  // Decodes rx_frame_ and invokes the callback if it is valid.
+  void DispatchFrame(const FrameCallback& callback);
 };
 
 }  // namespace au
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/transmit_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+
+#include "util/log.h"
+#include "util/time.h"
+
+#define LOG_TAG "TransmitScheduler"
+
+namespace au {
+namespace {
+
+// The number of microseconds per minute.
+constexpr double kUsPerMinute = 60.0 * kUsPerS;
+
+// Returns the time in microseconds to accumulate the supplied number of
+// tokens at a rate per minute.
+uint64_t GetRefillTimeUs(double tokens, double rate_per_minute) {
+  return tokens <= 0.0 ? 0 : std::ceil(tokens * kUsPerMinute / rate_per_minute);
+}
+
+}  // anonymous namespace
+
+TransmitScheduler::Flow::Flow(TransmitScheduler* scheduler,
+    Priority priority, uint32_t weight, uint64_t deadline_us)
+    : scheduler_(scheduler),
+      priority_(priority),
+      weight_(std::max<uint32_t>(weight, 1)),
+      deadline_us_(deadline_us),
+      finish_tag_(0.0) {}
+
+bool TransmitScheduler::Flow::Acquire(size_t size) {
+  return scheduler_->Acquire(this, size);
+}
+
+uint64_t TransmitScheduler::Flow::GetWaitTimeUs(size_t size) const {
+  std::lock_guard<std::mutex> lock(scheduler_->mutex_);
+  scheduler_->Refill(GetTimeNowUs());
+  return scheduler_->GetWaitTimeUsLocked(size);
+}
+
+TransmitScheduler::TransmitScheduler(const Budget& budget)
+    : budget_(budget),
+      frame_capacity_(1.0),
+      byte_capacity_(budget.frames_per_minute > 0.0f
+          ? budget.bytes_per_minute / budget.frames_per_minute
+          : budget.bytes_per_minute / 60.0),
+      frame_tokens_(frame_capacity_),
+      byte_tokens_(byte_capacity_),
+      refill_time_us_(GetTimeNowUs()),
+      virtual_times_(),
+      stats_() {}
+
+TransmitScheduler::~TransmitScheduler() {
+  static const char* const kPriorityNames[kPriorityCount] = {
+    "control", "interactive", "bulk",
+  };
+
+  LOGI("granted %" PRIu64 " frames with %" PRIu64 " bytes, %" PRIu64
+      " late", stats_.frame_count, stats_.byte_count,
+      stats_.late_frame_count);
+  for (size_t i = 0; i < kPriorityCount; i++) {
+    const auto& class_stats = stats_.class_stats[i];
+    if (class_stats.frame_count != 0) {
+      LOGI("%s: %" PRIu64 " frames waited %" PRIu64 "ms on average, %"
+          PRIu64 "ms at most", kPriorityNames[i], class_stats.frame_count,
+          class_stats.wait_time_us / class_stats.frame_count / 1000,
+          class_stats.max_wait_time_us / 1000);
+    }
+  }
+}
+
+void TransmitScheduler::OnTransmitComplete() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Refill(GetTimeNowUs());
+  frame_tokens_ = std::min(frame_tokens_, 0.0);
+}
+
+TransmitScheduler::Stats TransmitScheduler::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+bool TransmitScheduler::Acquire(Flow* flow, size_t size) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  uint64_t start_time_us = GetTimeNowUs();
+  size_t priority = static_cast<size_t>(flow->priority_);
+  Waiter waiter = {flow, size,
+      std::max(virtual_times_[priority], flow->finish_tag_)};
+  waiters_.push_back(&waiter);
+  condition_.notify_all();
+
+  uint64_t now_us = start_time_us;
+  while (true) {
+    Refill(now_us);
+    uint64_t wait_time_us = GetWaitTimeUsLocked(size);
+    if (wait_time_us == 0 && SelectWaiter(now_us) == &waiter) {
+      break;
+    }
+
+    // Waiters that are not selected wake when a frame is granted, and also
+    // when the bucket refills in case a deadline has made them urgent.
+    condition_.wait_for(lock, std::chrono::microseconds(
+        std::max<uint64_t>(wait_time_us, 1000)));
+    now_us = GetTimeNowUs();
+  }
+
+  waiters_.erase(std::find(waiters_.begin(), waiters_.end(), &waiter));
+  frame_tokens_ -= 1.0;
+  byte_tokens_ -= size;
+  virtual_times_[priority] = waiter.start_tag;
+  flow->finish_tag_ = waiter.start_tag
+      + static_cast<double>(size) / flow->weight_;
+
+  bool late = flow->deadline_us_ != 0 && now_us > flow->deadline_us_;
+  uint64_t wait_time_us = now_us - start_time_us;
+  auto& class_stats = stats_.class_stats[priority];
+  stats_.frame_count++;
+  stats_.byte_count += size;
+  stats_.late_frame_count += late;
+  class_stats.frame_count++;
+  class_stats.wait_time_us += wait_time_us;
+  class_stats.max_wait_time_us = std::max(class_stats.max_wait_time_us,
+      wait_time_us);
+  condition_.notify_all();
+  return !late;
+}
+
+void TransmitScheduler::Refill(uint64_t now_us) {
+  if (now_us <= refill_time_us_) {
+    return;
+  }
+
+  double elapsed_minutes = (now_us - refill_time_us_) / kUsPerMinute;
+  refill_time_us_ = now_us;
+  frame_tokens_ = std::min(frame_capacity_,
+      frame_tokens_ + elapsed_minutes * budget_.frames_per_minute);
+  byte_tokens_ = std::min(byte_capacity_,
+      byte_tokens_ + elapsed_minutes * budget_.bytes_per_minute);
+}
+
+uint64_t TransmitScheduler::GetWaitTimeUsLocked(size_t size) const {
+  uint64_t wait_time_us = 0;
+  if (budget_.frames_per_minute > 0.0f) {
+    wait_time_us = GetRefillTimeUs(frame_capacity_ - frame_tokens_,
+        budget_.frames_per_minute);
+  }
+
+  // A frame larger than the bucket is sent once the bucket is full, and the
+  // bucket is left in debt.
+  if (budget_.bytes_per_minute > 0) {
+    double byte_tokens = std::min<double>(size, byte_capacity_);
+    wait_time_us = std::max(wait_time_us, GetRefillTimeUs(
+        byte_tokens - byte_tokens_, budget_.bytes_per_minute));
+  }
+
+  return wait_time_us;
+}
+
+const TransmitScheduler::Waiter* TransmitScheduler::SelectWaiter(
+    uint64_t now_us) const {
+  // Only the highest priority class with a frame waiting is served.
+  Priority priority = Priority::kBulk;
+  for (const auto* waiter : waiters_) {
+    priority = std::min(priority, waiter->flow->priority_);
+  }
+
+  // A flow is urgent if its deadline would pass before every waiting flow has
+  // had a turn.
+  uint64_t round_time_us = budget_.frames_per_minute > 0.0f
+      ? waiters_.size() * kUsPerMinute / budget_.frames_per_minute : 0;
+  const Waiter* urgent = nullptr;
+  const Waiter* fair = nullptr;
+  for (const auto* waiter : waiters_) {
+    if (waiter->flow->priority_ != priority) {
+      continue;
+    }
+
+    uint64_t deadline_us = waiter->flow->deadline_us_;
+    if (deadline_us != 0 && deadline_us <= now_us + round_time_us
+        && (urgent == nullptr
+            || deadline_us < urgent->flow->deadline_us_)) {
+      urgent = waiter;
+    }
+
+    if (fair == nullptr || waiter->start_tag < fair->start_tag) {
+      fair = waiter;
+    }
+  }
+
+  return urgent != nullptr ? urgent : fair;
+}
+
+}  // namespace au
@@ -0,0 +1,212 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_NET_TRANSMIT_SCHEDULER_H_
+#define APRS_UTILS_NET_TRANSMIT_SCHEDULER_H_
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "util/non_copyable.h"
+
+namespace au {
+
+// Shares the airtime of one radio channel between any number of concurrent
+// senders. A token bucket limits the frames and bytes sent per minute so that
+// the station as a whole never exceeds its share of the channel, however many
+// transfers are running. Senders open a Flow with a weight and an optional
+// deadline and acquire permission before sending each frame.
+//
+// Each flow belongs to a priority class. When the bucket allows another frame
+// it is granted to the highest class with a frame waiting, so a short message
+// preempts a long transfer at the next frame boundary. Within a class, a flow
+// whose deadline would pass before every other waiting flow has had a turn is
+// served first, earliest deadline first. Otherwise frames are granted by
+// start-time fair queuing, so each flow receives airtime in proportion to its
+// weight.
+class TransmitScheduler : public NonCopyable {
+ public:
+  // The priority classes of flows, from highest to lowest.
+  enum class Priority {
+    // Frames that keep other transfers moving, such as acknowledgements.
+    kControl,
+
+    // Short messages that a person is waiting on.
+    kInteractive,
+
+    // Large transfers such as files.
+    kBulk,
+  };
+
+  // The number of priority classes.
+  static constexpr size_t kPriorityCount = 3;
+
+  // The airtime that may be used on the channel.
+  struct Budget {
+    // The number of frames that may be sent per minute, or zero for no limit.
+    float frames_per_minute;
+
+    // The number of bytes that may be sent per minute, or zero for no limit.
+    uint32_t bytes_per_minute;
+  };
+
+  // A sender of frames through the scheduler. This must not outlive the
+  // scheduler and is used by one thread at a time.
+  class Flow : public NonCopyable {
+   public:
+    // Opens a flow in the supplied priority class with a weight, which must
+    // be at least one, and an absolute deadline in microseconds, or zero for
+    // none.
+    Flow(TransmitScheduler* scheduler, Priority priority = Priority::kBulk,
+        uint32_t weight = 1, uint64_t deadline_us = 0);
+
+    // Blocks until a frame of the supplied size may be sent and charges it to
+    // the budget. Returns false if the frame is sent after the deadline.
+    bool Acquire(size_t size);
+
+    // Returns the time until a frame of the supplied size could be sent if no
+    // other flow were waiting.
+    uint64_t GetWaitTimeUs(size_t size) const;
+
+    // Returns the scheduler of this flow.
+    TransmitScheduler* GetScheduler() const { return scheduler_; }
+
+   private:
+    friend class TransmitScheduler;
+
+    // The scheduler that this flow sends through.
+    TransmitScheduler* const scheduler_;
+
+    // The priority class of this flow.
+    const Priority priority_;
+
+    // The share of airtime of this flow relative to others.
+    const uint32_t weight_;
+
+    // The deadline of this flow, or zero for none.
+    const uint64_t deadline_us_;
+
+    // The virtual finish time of the last frame granted to this flow.
+    double finish_tag_;
+  };
+
+  // Statistics about the frames of one priority class.
+  struct ClassStats {
+    // The number of frames granted.
+    uint64_t frame_count;
+
+    // The total time that frames waited to be granted, in microseconds.
+    uint64_t wait_time_us;
+
+    // The longest time that a frame waited to be granted, in microseconds.
+    uint64_t max_wait_time_us;
+  };
+
+  // Statistics about the frames that have been scheduled.
+  struct Stats {
+    // The number of frames granted.
+    uint64_t frame_count;
+
+    // The number of bytes granted.
+    uint64_t byte_count;
+
+    // The number of frames granted after the deadline of their flow.
+    uint64_t late_frame_count;
+
+    // The statistics of each priority class, indexed by Priority.
+    std::array<ClassStats, kPriorityCount> class_stats;
+  };
+
+  // Setup the scheduler with a full bucket, so the first frame is sent
+  // without waiting.
+  TransmitScheduler(const Budget& budget);
+
+  // Logs the statistics of the scheduler.
+  ~TransmitScheduler();
+
+  // Records that the last granted frame has just left the radio. Tokens that
+  // accumulated while the frame was queued are discarded so that frames are
+  // paced from when they were transmitted.
+  void OnTransmitComplete();
+
+  // Returns the statistics of this scheduler.
+  Stats GetStats() const;
+
+ private:
+  // A frame that is waiting to be granted.
+  struct Waiter {
+    // The flow that the frame belongs to.
+    Flow* flow;
+
+    // The size of the frame.
+    size_t size;
+
+    // The virtual start time of the frame for fair queuing.
+    double start_tag;
+  };
+
+  // The budget of the channel.
+  const Budget budget_;
+
+  // The number of frames and bytes that the bucket holds when full.
+  const double frame_capacity_;
+  const double byte_capacity_;
+
+  // Guards the state below.
+  mutable std::mutex mutex_;
+
+  // Signalled when a frame is granted so that other waiters re-evaluate.
+  std::condition_variable condition_;
+
+  // The tokens in the bucket.
+  double frame_tokens_;
+  double byte_tokens_;
+
+  // The time that the bucket was last refilled.
+  uint64_t refill_time_us_;
+
+  // The virtual time of fair queuing in each priority class, which is the
+  // start tag of the last frame granted in the class.
+  std::array<double, kPriorityCount> virtual_times_;
+
+  // The frames that are waiting to be granted.
+  std::vector<Waiter*> waiters_;
+
+  // The statistics of this scheduler.
+  Stats stats_;
+
+  // Blocks until the frame may be sent. Returns false if it is sent after the
+  // deadline of its flow.
+  bool Acquire(Flow* flow, size_t size);
+
+  // Adds the tokens accumulated since the last refill.
+  void Refill(uint64_t now_us);
+
+  // Returns the time until the bucket holds enough tokens for a frame of the
+  // supplied size, assuming it has been refilled.
+  uint64_t GetWaitTimeUsLocked(size_t size) const;
+
+  // Returns the waiter that is next to be granted.
+  const Waiter* SelectWaiter(uint64_t now_us) const;
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_NET_TRANSMIT_SCHEDULER_H_
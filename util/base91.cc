@@ -0,0 +1,131 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/base91.h"
+
+#include <array>
+
+namespace au {
+namespace {
+
+// The number of values that a pair of characters is split at. Values of 13
+// bits above this are packed as 13 bits, and the rest take 14 bits, which
+// keeps every pair below 91 * 91.
+constexpr uint32_t kSplitValue = 88;
+
+// Returns the table that maps characters to their value, or -1 for characters
+// that are not part of the alphabet.
+const std::array<int8_t, 256>& GetDecodeTable() {
+  static const std::array<int8_t, 256> table = [] {
+    std::array<int8_t, 256> table;
+    table.fill(-1);
+    for (size_t i = 0; Base91::kAlphabet[i] != '\0'; i++) {
+      table[static_cast<uint8_t>(Base91::kAlphabet[i])] = i;
+    }
+
+    return table;
+  }();
+  return table;
+}
+
+}  // anonymous namespace
+
+const char Base91::kAlphabet[] = "!\"#$%&'()*+,-./0123456789:;<=>?@"
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ[]^_`abcdefghijklmnopqrstuvwxyz{}";
+
+static_assert(sizeof(Base91::kAlphabet) == 92,
+    "base91 requires an alphabet of 91 characters");
+
+size_t Base91::GetMaxEncodedSize(size_t size) {
+  return (size * 8 + 12) / 13 * 2;
+}
+
+size_t Base91::Encode(const uint8_t* data, size_t size, char* output) {
+  char* start = output;
+  uint32_t queue = 0;
+  uint32_t bit_count = 0;
+  for (size_t i = 0; i < size; i++) {
+    queue |= static_cast<uint32_t>(data[i]) << bit_count;
+    bit_count += 8;
+    if (bit_count > 13) {
+      uint32_t value = queue & 0x1fff;
+      if (value > kSplitValue) {
+        queue >>= 13;
+        bit_count -= 13;
+      } else {
+        value = queue & 0x3fff;
+        queue >>= 14;
+        bit_count -= 14;
+      }
+
+      *output++ = kAlphabet[value % 91];
+      *output++ = kAlphabet[value / 91];
+    }
+  }
+
+  // The remaining bits are written as one character if they fit, otherwise as
+  // a pair.
+  if (bit_count > 0) {
+    *output++ = kAlphabet[queue % 91];
+    if (bit_count > 7 || queue > 90) {
+      *output++ = kAlphabet[queue / 91];
+    }
+  }
+
+  return output - start;
+}
+
+std::string Base91::Encode(const std::string& data) {
+  std::string output(GetMaxEncodedSize(data.size()), '\0');
+  output.resize(Encode(reinterpret_cast<const uint8_t*>(data.data()),
+      data.size(), &output[0]));
+  return output;
+}
+
+bool Base91::Decode(const char* data, size_t size, std::string* output) {
+  const auto& table = GetDecodeTable();
+  uint32_t queue = 0;
+  uint32_t bit_count = 0;
+  int32_t value = -1;
+  for (size_t i = 0; i < size; i++) {
+    int8_t digit = table[static_cast<uint8_t>(data[i])];
+    if (digit < 0) {
+      return false;
+    } else if (value < 0) {
+      value = digit;
+      continue;
+    }
+
+    value += digit * 91;
+    queue |= static_cast<uint32_t>(value) << bit_count;
+    bit_count += (value & 0x1fff) > kSplitValue ? 13 : 14;
+    do {
+      output->push_back(queue & 0xff);
+      queue >>= 8;
+      bit_count -= 8;
+    } while (bit_count > 7);
+    value = -1;
+  }
+
+  if (value >= 0) {
+    output->push_back((queue | static_cast<uint32_t>(value) << bit_count)
+        & 0xff);
+  }
+
+  return true;
+}
+
+}  // namespace au
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APRS_UTILS_UTIL_BASE91_H_
+#define APRS_UTILS_UTIL_BASE91_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace au {
+
+// A base91 text encoding of binary data that is safe to carry in an APRS
+// information field. This is the basE91 algorithm, which packs 13 or 14 bits
+// into each pair of characters for about 23% overhead, compared to 33% for
+// base64. The alphabet is the printable ASCII characters other than space and
+// the '|', '~' and backslash characters, which APRS reserves or some software
+// treats as escapes.
+class Base91 {
+ public:
+  // The characters of the encoding, in order of value.
+  static const char kAlphabet[];
+
+  // Returns the maximum number of characters that the supplied number of bytes
+  // encode to.
+  static size_t GetMaxEncodedSize(size_t size);
+
+  // Encodes the supplied bytes into the output, which must hold at least
+  // GetMaxEncodedSize characters. Returns the number of characters written.
+  static size_t Encode(const uint8_t* data, size_t size, char* output);
+
+  // Encodes the supplied string.
+  static std::string Encode(const std::string& data);
+
+  // Decodes the supplied characters and appends the bytes to the output.
+  // Returns false if a character is not part of the alphabet.
+  static bool Decode(const char* data, size_t size, std::string* output);
+};
+
+}  // namespace au
+
+#endif  // APRS_UTILS_UTIL_BASE91_H_
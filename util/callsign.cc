@@ -24,16 +24,31 @@ namespace au {
 // requesting another if this tool gains traction.
 const char* kBroadcastCallsign = "APZ222";
 
-bool CallsignConfig::FromString(const std::string& str) {
+bool CallsignConfig::FromString(std::string_view str) {
   auto dash_pos = str.find('-');
-  if (dash_pos == std::string::npos) {
-    callsign = str;
-  } else {
-    callsign = str.substr(0, dash_pos);
-    // TODO(aarossig): parse the SSID.
+  callsign.assign(str.substr(0, dash_pos));
+  ssid = 0;
+  repeated = false;
+  if (callsign.empty()) {
+    return false;
+  } else if (dash_pos == std::string_view::npos) {
+    return true;
+  }
+
+  auto ssid_str = str.substr(dash_pos + 1);
+  if (ssid_str.empty() || ssid_str.size() > 2) {
+    return false;
+  }
+
+  for (char c : ssid_str) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+
+    ssid = ssid * 10 + (c - '0');
   }
 
-  return true;
+  return ssid <= kMaxSSID;
 }
 
 std::string CallsignConfig::ToString() const {
@@ -18,6 +18,7 @@
 #define APRS_UTILS_UTIL_CALLSIGN_H_
 
 #include <string>
+#include <string_view>
 
 // Utils for handling callsigns.
 
@@ -25,13 +26,22 @@ namespace au {
 
 extern const char* kBroadcastCallsign;
 
+// The largest SSID that can be encoded in an AX.25 address.
+constexpr int kMaxSSID = 15;
+
 // A config for a callsign and ssid.
 struct CallsignConfig {
   std::string callsign;
   int ssid = 0;
 
-  // Attempts to parse a callsign into this config from a string.
-  bool FromString(const std::string& str);
+  // Set on the digipeaters of a received frame that have repeated it. This is
+  // not compared for equality and is ignored when sending.
+  bool repeated = false;
+
+  // Attempts to parse a callsign into this config from a string formatted as
+  // CALLSIGN or CALLSIGN-SSID. Returns false if the callsign is empty or the
+  // SSID is not a number from 0 to kMaxSSID.
+  bool FromString(std::string_view str);
 
   // Formats this callsign into a string.
   std::string ToString() const;
@@ -29,7 +29,12 @@
 #define LOGV(format, ...) \
   fprintf(stderr, LOG_TAG ": " format "\n", ##__VA_ARGS__)
 #else
-#define LOGV(format, ...)
+// The arguments are still compiled, and so count as used, but never printed.
+#define LOGV(format, ...) do { \
+    if (false) { \
+      fprintf(stderr, LOG_TAG ": " format "\n", ##__VA_ARGS__); \
+    } \
+  } while (0)
 #endif
 
 // Informational logs.
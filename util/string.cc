@@ -73,6 +73,9 @@ std::string StringFormat(const char* format, ...) {
 
   va_end(vl_copy);
   va_end(vl);
+
+  // Drop the null terminator written by vsnprintf.
+  output.resize(size);
   return output;
 }
 